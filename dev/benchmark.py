@@ -0,0 +1,261 @@
+# Gummi: benchmark.py
+# Development tool to measure the compile-to-preview loop without a desktop.
+#
+# Generates fixture documents, replays an edit trace against each of them
+# with `gummi --replay TRACE --stats` on a private Xvfb display and reports
+# edit-to-preview latency, render throughput, scan times and peak RSS as
+# JSON, so regressions show up as numbers in CI.
+#
+# usage: python3 dev/benchmark.py [--gummi PATH] [--output REPORT.json]
+#            [--baseline OLD.json [--tolerance PERCENT]] [FIXTURE ...]
+#
+# Requires Xvfb and a TeX installation. With --baseline the script exits
+# with status 1 when a metric got worse than the tolerance allows.
+
+import argparse
+import json
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+
+WORDS = ("lorem ipsum dolor sit amet consectetur adipiscing elit sed do "
+         "eiusmod tempor incididunt ut labore et dolore magna aliqua").split()
+
+# metric name, lower is better
+METRICS = (
+    ("edit_to_preview_p50_ms", True),
+    ("edit_to_preview_p95_ms", True),
+    ("typesetter_p50_ms", True),
+    ("render_pages_per_s", False),
+    ("load_document_p50_ms", True),
+    ("biblio_parse_max_ms", True),
+    ("package_scan_max_ms", True),
+    ("peak_rss_mb", True),
+)
+
+
+def paragraph(seed, words=120):
+    return " ".join(WORDS[(seed * 7 + i * 3) % len(WORDS)]
+                    for i in range(words))
+
+
+def write(path, text):
+    os.makedirs(os.path.dirname(path), exist_ok=True)
+    with open(path, "w") as f:
+        f.write(text)
+
+
+def preamble(extra=""):
+    return ("\\documentclass{article}\n" + extra +
+            "\\begin{document}\n")
+
+
+def fixture_pages(directory, pages):
+    """A document of the given number of pages, about 3 paragraphs each"""
+    body = []
+    for page in range(pages):
+        body.append("\\section{Section %d}\n" % (page + 1))
+        body.extend(paragraph(page * 3 + i) + "\n\n" for i in range(3))
+        body.append("\\newpage\n")
+    main = os.path.join(directory, "pages%d.tex" % pages)
+    write(main, preamble() + "".join(body) + "\\end{document}\n")
+    return main, len(body) // 2
+
+
+def fixture_bib(directory, entries=25000):
+    """A short document citing from a large bibliography database"""
+    bib = []
+    for i in range(entries):
+        bib.append("@article{key%d,\n"
+                   "  author = {Author %d and Other, Some},\n"
+                   "  title = {{%s}},\n"
+                   "  journal = {Journal of %s},\n"
+                   "  year = %d,\n"
+                   "}\n\n" % (i, i, paragraph(i, 8), WORDS[i % len(WORDS)],
+                              1950 + i % 70))
+    write(os.path.join(directory, "refs.bib"), "".join(bib))
+    cites = ",".join("key%d" % (i * (entries // 50)) for i in range(50))
+    main = os.path.join(directory, "bib.tex")
+    write(main, preamble() + paragraph(1) + "\n\n\\cite{" + cites + "}\n\n" +
+          "\\bibliographystyle{plain}\n\\bibliography{refs}\n"
+          "\\end{document}\n")
+    return main, 3
+
+
+def fixture_project(directory, files=200):
+    """A main file including many chapter files"""
+    inputs = []
+    for i in range(files):
+        name = "chapters/ch%03d" % i
+        write(os.path.join(directory, name + ".tex"),
+              "\\section{Chapter %d}\n%s\n\n%s\n" %
+              (i, paragraph(i), paragraph(i + 1)))
+        inputs.append("\\input{%s}\n" % name)
+    main = os.path.join(directory, "project.tex")
+    write(main, preamble() + "".join(inputs) + "\\end{document}\n")
+    return main, files // 2 + 3
+
+
+FIXTURES = {
+    "pages10": lambda d: fixture_pages(d, 10),
+    "pages100": lambda d: fixture_pages(d, 100),
+    "pages1000": lambda d: fixture_pages(d, 1000),
+    "bib25k": fixture_bib,
+    "project200": fixture_project,
+}
+
+
+def edit_trace(line, edits=5):
+    """Waits for the first preview, then types a sentence in the middle of
+    the document and waits for each preview, then renders every page once"""
+    steps = ["# generated by dev/benchmark.py", "sync", "wait 2000",
+             "reset", "delay 30"]
+    for i in range(edits):
+        steps += ["goto %d" % (line + i), "type %s\\n\\n" % paragraph(i, 6),
+                  "sync", "wait 500"]
+    steps += ["render", "quit"]
+    return "\n".join(steps) + "\n"
+
+
+def start_xvfb():
+    read, write_fd = os.pipe()
+    xvfb = subprocess.Popen(["Xvfb", "-displayfd", str(write_fd),
+                             "-screen", "0", "1600x1200x24", "-nolisten",
+                             "tcp"], pass_fds=(write_fd,),
+                            stderr=subprocess.DEVNULL)
+    os.close(write_fd)
+    display = os.read(read, 16).decode().strip()
+    os.close(read)
+    return xvfb, ":" + display
+
+
+def peak_rss(pid):
+    """VmHWM of a running process in MB, None once it has exited"""
+    try:
+        with open("/proc/%d/status" % pid) as f:
+            for line in f:
+                if line.startswith("VmHWM:"):
+                    return int(line.split()[1]) / 1024.0
+    except (IOError, OSError):
+        pass
+    return None
+
+
+def run_fixture(gummi, name, workdir, display, timeout):
+    directory = os.path.join(workdir, name)
+    main, line = FIXTURES[name](directory)
+    trace = os.path.join(directory, "trace.txt")
+    write(trace, edit_trace(line))
+
+    env = dict(os.environ, DISPLAY=display,
+               XDG_CONFIG_HOME=os.path.join(directory, "config"),
+               XDG_CACHE_HOME=os.path.join(directory, "cache"))
+    log = open(os.path.join(directory, "gummi.log"), "w")
+    started = time.time()
+    proc = subprocess.Popen([gummi, "--stats", "--replay", trace, main],
+                            stdout=subprocess.PIPE, stderr=log, env=env,
+                            universal_newlines=True)
+    rss = 0.0
+    while proc.poll() is None:
+        rss = max(rss, peak_rss(proc.pid) or 0.0)
+        if time.time() - started > timeout:
+            proc.kill()
+            raise RuntimeError("%s: timed out after %d s" % (name, timeout))
+        time.sleep(0.1)
+    output = proc.stdout.read()
+    log.close()
+
+    if proc.returncode != 0 or "{" not in output:
+        raise RuntimeError("%s: gummi exited with %d, see %s" %
+                           (name, proc.returncode, log.name))
+    stats = json.loads(output[output.index("{"):])
+    render = stats["do_render"]
+    return {
+        "edit_to_preview_p50_ms": stats["edit_to_preview"]["p50_ms"],
+        "edit_to_preview_p95_ms": stats["edit_to_preview"]["p95_ms"],
+        "typesetter_p50_ms": stats["typesetter"]["p50_ms"],
+        "render_pages_per_s": (1000.0 / render["mean_ms"]
+                               if render["mean_ms"] else 0.0),
+        "load_document_p50_ms": stats["load_document"]["p50_ms"],
+        "biblio_parse_max_ms": stats["biblio_parse"]["max_ms"],
+        "package_scan_max_ms": stats["package_scan"]["max_ms"],
+        "peak_rss_mb": round(rss, 1),
+        "wall_s": round(time.time() - started, 1),
+        "spans": stats,
+    }
+
+
+def compare(report, baseline, tolerance):
+    """Prints the metrics that got worse than the tolerance, returns the
+    number of regressions"""
+    regressions = 0
+    for name, result in report.items():
+        old = baseline.get(name)
+        if not old:
+            continue
+        for metric, lower_is_better in METRICS:
+            new_value, old_value = result[metric], old.get(metric)
+            if not old_value or not new_value:
+                continue
+            change = (new_value - old_value) / old_value * 100
+            if not lower_is_better:
+                change = -change
+            if change > tolerance:
+                regressions += 1
+                print("REGRESSION %s %s: %.2f -> %.2f (%+.1f%%)" %
+                      (name, metric, old_value, new_value, change))
+    return regressions
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Benchmark the compile-to-preview loop of Gummi")
+    parser.add_argument("fixtures", nargs="*", metavar="FIXTURE",
+                        help="any of %s (default: all)" %
+                        ", ".join(sorted(FIXTURES)))
+    parser.add_argument("--gummi", default="gummi",
+                        help="gummi binary to benchmark")
+    parser.add_argument("--output", help="write the report to this file")
+    parser.add_argument("--baseline", help="report to compare against")
+    parser.add_argument("--tolerance", type=float, default=10.0,
+                        help="allowed regression in percent (default 10)")
+    parser.add_argument("--timeout", type=int, default=600,
+                        help="seconds allowed per fixture (default 600)")
+    parser.add_argument("--keep", action="store_true",
+                        help="keep the generated fixtures and logs")
+    args = parser.parse_args()
+    for name in args.fixtures:
+        if name not in FIXTURES:
+            parser.error("unknown fixture '%s'" % name)
+
+    workdir = tempfile.mkdtemp(prefix="gummi-bench-")
+    xvfb, display = start_xvfb()
+    report = {}
+    try:
+        for name in args.fixtures or sorted(FIXTURES):
+            report[name] = run_fixture(args.gummi, name, workdir, display,
+                                       args.timeout)
+            print("%-12s %s" % (name, " ".join(
+                "%s=%s" % (metric, report[name][metric])
+                for metric, _ in METRICS)))
+    finally:
+        xvfb.terminate()
+        if args.keep:
+            print("fixtures kept in %s" % workdir)
+        else:
+            shutil.rmtree(workdir, ignore_errors=True)
+
+    if args.output:
+        with open(args.output, "w") as f:
+            json.dump(report, f, indent=2, sort_keys=True)
+    if args.baseline:
+        with open(args.baseline) as f:
+            if compare(report, json.load(f), args.tolerance):
+                sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,387 @@
+/**
+ * @file   bench.c
+ * @brief  micro-benchmarks of the text processing hot paths
+ *
+ * Copyright (C) 2009 Gummi Developers
+ * All Rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/* Standalone benchmarks of the parsers and scanners, built with `make bench`
+ * from the modules of Gummi without its main window. Every benchmark runs
+ * on a generated corpus whose size is set with --size, and reports the
+ * throughput and the number of allocations per operation. */
+
+#include <glib.h>
+#include <gtk/gtk.h>
+#include <locale.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "biblio.h"
+#include "completion.h"
+#include "latex.h"
+#include "snippets.h"
+#include "utils.h"
+
+/* private to iofunctions.c */
+gchar* iofunctions_decode_text (gchar* text);
+
+static gint size = 1000;
+static gdouble min_time = 0.5;
+static gchar* filter = NULL;
+
+static GOptionEntry entries[] = {
+    { (const gchar*)"size", (gchar)'s', 0, G_OPTION_ARG_INT,
+        &size, (gchar*)"number of sections, entries or lines of the corpora",
+        (gchar*)"N"},
+    { (const gchar*)"time", (gchar)'t', 0, G_OPTION_ARG_DOUBLE,
+        &min_time, (gchar*)"minimum seconds spent in each benchmark",
+        (gchar*)"SECS"},
+    { (const gchar*)"filter", (gchar)'f', 0, G_OPTION_ARG_STRING,
+        &filter, (gchar*)"only run the benchmarks containing TEXT",
+        (gchar*)"TEXT"},
+    { NULL, 0, 0, G_OPTION_ARG_NONE, NULL, NULL, NULL }
+};
+
+/* Allocations are counted by wrapping the allocator of glibc, which GLib
+ * uses since 2.46. Allocations made within libc itself are not seen. */
+#ifdef __GLIBC__
+extern void* __libc_malloc (size_t size);
+extern void* __libc_calloc (size_t n, size_t size);
+extern void* __libc_realloc (void* ptr, size_t size);
+
+static gint counting = FALSE;
+static gint allocations = 0;
+
+void* malloc (size_t size) {
+    if (counting) g_atomic_int_inc (&allocations);
+    return __libc_malloc (size);
+}
+
+void* calloc (size_t n, size_t size) {
+    if (counting) g_atomic_int_inc (&allocations);
+    return __libc_calloc (n, size);
+}
+
+void* realloc (void* ptr, size_t size) {
+    if (counting) g_atomic_int_inc (&allocations);
+    return __libc_realloc (ptr, size);
+}
+#   define ALLOCATIONS_COUNTED TRUE
+#else
+static gint counting = FALSE;
+static gint allocations = 0;
+#   define ALLOCATIONS_COUNTED FALSE
+#endif
+
+typedef void (*BenchFunc) (gpointer data);
+
+/**
+ * Calls func with data until min_time has passed and prints the throughput,
+ * where each call handles bytes of input made of items of unit.
+ */
+static void bench_run (const gchar* name, BenchFunc func, gpointer data,
+                       gsize bytes, gsize items, const gchar* unit) {
+    guint64 calls = 0, batch = 1, i;
+    gint64 start, elapsed;
+    gdouble secs;
+    gchar* rate = NULL;
+
+    if (filter && !strstr (name, filter)) return;
+
+    func (data); /* warm up, e.g. compile the regular expressions */
+    allocations = 0;
+    counting = TRUE;
+    start = g_get_monotonic_time ();
+    do {
+        for (i = 0; i < batch; ++i) func (data);
+        calls += batch;
+        batch *= 2;
+        elapsed = g_get_monotonic_time () - start;
+    } while (elapsed < min_time * G_USEC_PER_SEC);
+    counting = FALSE;
+
+    secs = elapsed / (gdouble)G_USEC_PER_SEC;
+    rate = g_strdup_printf ("%.0f %s/s", items * calls / secs, unit);
+    printf ("%-24s %10.2f MB/s %22s %12.1f", name,
+            bytes * calls / secs / 1e6, rate,
+            (gdouble)allocations / calls);
+    printf (ALLOCATIONS_COUNTED? " allocs/op\n": " (not counted)\n");
+    g_free (rate);
+}
+
+/* Corpora */
+
+static const gchar* words[] = {
+    "lorem", "ipsum", "dolor", "sit", "amet", "consectetur", "adipiscing",
+    "elit", "sed", "do", "eiusmod", "tempor", "incididunt", "ut", "labore",
+    "et", "dolore", "magna", "aliqua", "\xc3\xa9t\xc3\xa9", "na\xc3\xafve"
+};
+
+static void corpus_words (GString* out, gint seed, gint n) {
+    gint i;
+
+    for (i = 0; i < n; ++i) {
+        g_string_append (out, words[(seed * 7 + i * 3) % G_N_ELEMENTS (words)]);
+        g_string_append_c (out, (i + 1 < n)? ' ': '\n');
+    }
+}
+
+/* A document with a section, label, command, environment and bibitem per
+ * section */
+static gchar* corpus_tex (gint n) {
+    GString* out = g_string_new ("\\documentclass{article}\n");
+    gint i;
+
+    for (i = 0; i < n; ++i) {
+        g_string_append_printf (out,
+                "\\newcommand{\\cmd%d}[2][opt]{#1 and #2}\n"
+                "\\newenvironment{env%d}{\\begin{center}}{\\end{center}}\n"
+                "\\section{Section %d}\\label{sec:%d}\n", i, i, i, i);
+        corpus_words (out, i, 80);
+        g_string_append_printf (out, "\\bibitem{item%d} ", i);
+        corpus_words (out, i + 1, 12);
+    }
+    return g_string_free (out, FALSE);
+}
+
+static gchar* corpus_bib (gint n) {
+    GString* out = g_string_new ("@string{jo = \"Journal\"}\n");
+    gint i;
+
+    for (i = 0; i < n; ++i) {
+        g_string_append_printf (out, "@article{key%d,\n"
+                "  author = {Author, %d and Other, Some},\n  title = {{", i, i);
+        corpus_words (out, i, 8);
+        g_string_append_printf (out, "}},\n  journal = jo # \" of %s\",\n"
+                "  year = %d,\n}\n\n", words[i % G_N_ELEMENTS (words)],
+                1950 + i % 70);
+    }
+    return g_string_free (out, FALSE);
+}
+
+/* A compile log with an error every 50 lines */
+static gchar* corpus_log (gint n) {
+    GString* out = g_string_new (NULL);
+    gint i;
+
+    for (i = 0; i < n; ++i) {
+        if (i % 50 == 49)
+            g_string_append_printf (out, "./document.tex:%d: Undefined "
+                                    "control sequence.\n", i);
+        else
+            g_string_append_printf (out, "(/usr/share/texmf/tex/latex/base/"
+                                    "file%d.sty) [%d] Overfull \\hbox\n",
+                                    i, i);
+    }
+    return g_string_free (out, FALSE);
+}
+
+static GPtrArray* corpus_snippets (gint n) {
+    static const gchar* bodies[] = {
+        "\\begin{${1:env}}\n\t$0\n\\end{$1}",
+        "\\section{${1:title}}\\label{sec:${2:$1}}\n$0",
+        "\\frac{$1}{$2}$0",
+        "\\includegraphics[width=${1:0.8}\\textwidth]{${2:$BASENAME}}",
+        "\\begin{figure}[${1:htbp}]\n\\centering\n$SELECTED_TEXT\n"
+            "\\caption{${2:caption}}\n\\label{fig:${3:label}}\n\\end{figure}"
+    };
+    GPtrArray* snippets = g_ptr_array_new ();
+    gint i;
+
+    for (i = 0; i < n; ++i)
+        g_ptr_array_add (snippets, (gpointer)bodies[i % G_N_ELEMENTS (bodies)]);
+    return snippets;
+}
+
+/* Completion proposals of command names, sorted by text like the ones of
+ * the provider */
+typedef struct {
+    GeeArrayList* proposals;
+    const gchar** patterns;
+    gsize bytes;        /* of the commands, times the number of patterns */
+    guint matches;
+} CompletionCorpus;
+
+static gint compare_commands (gconstpointer a, gconstpointer b) {
+    return strcmp (*(const gchar**)a, *(const gchar**)b);
+}
+
+static CompletionCorpus* corpus_completion (gint n) {
+    static const gchar* stems[] = {
+        "\\section", "\\subsection", "\\begin", "\\textbf", "\\emph",
+        "\\includegraphics", "\\mathbb", "\\frac", "\\label", "\\ref"
+    };
+    static const gchar* patterns[] = {
+        "\\se", "\\sbsec", "\\tb", "\\inc", "\\Ma", "\\lbl", NULL
+    };
+    CompletionCorpus* corpus = g_new0 (CompletionCorpus, 1);
+    GPtrArray* commands = g_ptr_array_new_with_free_func (g_free);
+    gint i;
+
+    for (i = 0; i < n; ++i)
+        g_ptr_array_add (commands, g_strdup_printf ("%s%s%d",
+                stems[i % G_N_ELEMENTS (stems)],
+                words[i % G_N_ELEMENTS (words)], i));
+    g_ptr_array_sort (commands, compare_commands);
+
+    corpus->proposals = gee_array_list_new (GU_COMPLETION_TYPE_PROPOSAL,
+            (GBoxedCopyFunc)gu_completion_proposal_ref,
+            (GDestroyNotify)gu_completion_proposal_unref, NULL, NULL, NULL);
+    corpus->patterns = patterns;
+    for (i = 0; i < n; ++i) {
+        const gchar* command = g_ptr_array_index (commands, i);
+        GuCompletionProposal* proposal =
+            gu_completion_proposal_new (command, command, NULL, NULL);
+        gee_abstract_collection_add ((GeeAbstractCollection*)corpus->proposals,
+                                     proposal);
+        gu_completion_proposal_unref (proposal);
+        corpus->bytes += strlen (command);
+    }
+    corpus->bytes *= g_strv_length ((gchar**)patterns);
+    g_ptr_array_unref (commands);
+    return corpus;
+}
+
+/* Benchmarks */
+
+static void run_scan_for_definitions (gpointer data) {
+    g_variant_unref (g_variant_ref_sink (scan_for_definitions (data)));
+}
+
+static void run_scan_for_labels (gpointer data) {
+    scan_for_labels (data);
+}
+
+static void run_scan_for_bibitems (gpointer data) {
+    scan_for_bibitems (data);
+}
+
+static void run_biblio_parse_entries (gpointer data) {
+    g_ptr_array_unref (biblio_parse_entries (data));
+}
+
+static void run_snippets_parse (gpointer data) {
+    GPtrArray* snippets = data;
+    guint i;
+
+    for (i = 0; i < snippets->len; ++i)
+        snippet_template_free (snippets_parse (g_ptr_array_index (snippets, i)));
+}
+
+static void run_latex_analyse_errors (gpointer data) {
+    GuLatex* latex = data;
+
+    latex->errorlines[0] = 0;
+    latex_analyse_errors (latex);
+}
+
+static void run_decode_text (gpointer data) {
+    g_free (iofunctions_decode_text (data));
+}
+
+static void run_completion_filter (gpointer data) {
+    CompletionCorpus* corpus = data;
+    const gchar** pattern;
+
+    for (pattern = corpus->patterns; *pattern; ++pattern) {
+        GList* matches = gu_completion_filter_proposals (
+                (GeeList*)corpus->proposals, *pattern, NULL);
+        corpus->matches += g_list_length (matches);
+        g_list_free_full (matches, g_object_unref);
+    }
+}
+
+int main (int argc, char *argv[]) {
+    GError* error = NULL;
+    GOptionContext* context = g_option_context_new (NULL);
+    gboolean display = FALSE;
+    gchar* tex = NULL;
+    gchar* bib = NULL;
+    gchar* log = NULL;
+    GPtrArray* snippets = NULL;
+    CompletionCorpus* completion = NULL;
+    GuLatex* latex = NULL;
+    gsize snippet_bytes = 0;
+    guint i;
+
+    setlocale (LC_ALL, "");
+    g_option_context_set_summary (context, "Micro-benchmarks of the parsers "
+                                  "and scanners of Gummi");
+    g_option_context_add_main_entries (context, entries, NULL);
+    if (!g_option_context_parse (context, &argc, &argv, &error)) {
+        fprintf (stderr, "%s\n", error->message);
+        return 1;
+    }
+    g_option_context_free (context);
+    size = MAX (size, 1);
+
+    /* The completion provider needs a display for its icons */
+    display = gtk_init_check (&argc, &argv);
+
+    tex = corpus_tex (size);
+    bib = corpus_bib (size);
+    log = corpus_log (size);
+    snippets = corpus_snippets (size);
+    completion = corpus_completion (size);
+    latex = latex_init ();
+    latex->compilelog = log;
+    for (i = 0; i < snippets->len; ++i)
+        snippet_bytes += strlen (g_ptr_array_index (snippets, i));
+
+    printf ("%-24s %15s %22s %22s\n", "benchmark", "throughput", "items",
+            "allocations");
+    bench_run ("scan_for_definitions", run_scan_for_definitions, tex,
+               strlen (tex), size, "sections");
+    if (display) {
+        bench_run ("scan_for_labels", run_scan_for_labels, tex,
+                   strlen (tex), size, "labels");
+        bench_run ("scan_for_bibitems", run_scan_for_bibitems, tex,
+                   strlen (tex), size, "bibitems");
+    } else {
+        printf ("scan_for_labels and scan_for_bibitems need a display\n");
+    }
+    bench_run ("biblio_parse_entries", run_biblio_parse_entries, bib,
+               strlen (bib), size, "entries");
+    bench_run ("snippets_parse", run_snippets_parse, snippets,
+               snippet_bytes, size, "snippets");
+    bench_run ("latex_analyse_errors", run_latex_analyse_errors, latex,
+               strlen (log), size, "lines");
+    bench_run ("iofunctions_decode_text", run_decode_text, tex,
+               strlen (tex), size, "sections");
+    bench_run ("completion_filter", run_completion_filter, completion,
+               completion->bytes,
+               size * g_strv_length ((gchar**)completion->patterns),
+               "candidates");
+
+    g_free (tex);
+    g_free (bib);
+    g_free (log);
+    g_free (latex);
+    g_ptr_array_unref (snippets);
+    g_object_unref (completion->proposals);
+    g_free (completion);
+    return 0;
+}
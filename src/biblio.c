@@ -28,14 +28,18 @@
  */
 
 #include <gtk/gtk.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <glib/gstdio.h>
 
 #include "biblio.h"
 #include "constants.h"
 #include "completion.h"
 #include "environment.h"
 #include "latex.h"
+#include "stats.h"
 #include "utils.h"
 
 
@@ -49,8 +53,8 @@ GuBiblio* biblio_init (GtkBuilder* builder) {
         GTK_PROGRESS_BAR (gtk_builder_get_object (builder, "bibprogressbar"));
     b->progressval = 0.0;
 
-    b->list_biblios =
-        GTK_LIST_STORE (gtk_builder_get_object (builder, "list_biblios"));
+    b->list_biblios = g_object_ref (
+        GTK_LIST_STORE (gtk_builder_get_object (builder, "list_biblios")));
     b->filenm_label =
         GTK_LABEL (gtk_builder_get_object (builder, "bibfilenm"));
     b->refnr_label =
@@ -63,39 +67,371 @@ GuBiblio* biblio_init (GtkBuilder* builder) {
     return b;
 }
 
+/* Returns name resolved against dirname when it is relative */
+static gchar* biblio_resolve (const gchar* dirname, const gchar* name) {
+    if (dirname && !g_path_is_absolute (name))
+        return g_build_filename (dirname, name, NULL);
+    return g_strdup (name);
+}
+
+/* Adds the bibliography resources named in content to resources, relative
+ * ones resolved against dirname, the directory of the file declaring them,
+ * if any. A \bibliography takes a comma separated list of databases with an
+ * optional .bib extension, an \addbibresource a single file name. */
+static void biblio_scan_resources (const gchar* content, const gchar* dirname,
+                                   GPtrArray* resources) {
+    static GRegex* bib_regex = NULL;
+    GMatchInfo* match_info = NULL;
+
+    if (g_once_init_enter (&bib_regex)) {
+        g_once_init_leave (&bib_regex, g_regex_new (
+            "^[^%\n]*\\\\(bibliography|addbibresource)\\s*(?:\\[[^]]*\\])?"
+            "\\s*{([^{}]*)}", G_REGEX_MULTILINE | G_REGEX_OPTIMIZE, 0, NULL));
+    }
+
+    g_regex_match (bib_regex, content, 0, &match_info);
+    while (g_match_info_matches (match_info)) {
+        gchar* command = g_match_info_fetch (match_info, 1);
+        gchar* argument = g_match_info_fetch (match_info, 2);
+
+        if (STR_EQU (command, "addbibresource")) {
+            g_ptr_array_add (resources,
+                             biblio_resolve (dirname, g_strstrip (argument)));
+        } else {
+            gchar** names = g_strsplit (argument, ",", 0);
+            gint i;
+            for (i = 0; names[i]; ++i) {
+                gchar* name = g_strstrip (names[i]);
+                if (!*name) continue;
+                if (g_str_has_suffix (name, ".bib")) {
+                    g_ptr_array_add (resources, biblio_resolve (dirname, name));
+                } else {
+                    gchar* bibname = g_strconcat (name, ".bib", NULL);
+                    g_ptr_array_add (resources,
+                                     biblio_resolve (dirname, bibname));
+                    g_free (bibname);
+                }
+            }
+            g_strfreev (names);
+        }
+        g_free (command);
+        g_free (argument);
+        g_match_info_next (match_info, NULL);
+    }
+    g_match_info_free (match_info);
+}
+
+/* Scans a document of the project that is not open, as found on disk */
+static void biblio_scan_file (const gchar* filename, GPtrArray* resources) {
+    gchar* content = NULL;
+    gchar* decoded = NULL;
+    gchar* dirname = NULL;
+    gsize length = 0;
+
+    if (!g_file_get_contents (filename, &content, &length, NULL)) return;
+
+    if (!g_utf8_validate (content, length, NULL)) {
+        decoded = g_convert (content, length, "UTF-8", "ISO-8859-1",
+                             NULL, NULL, NULL);
+    }
+    dirname = g_path_get_dirname (filename);
+    biblio_scan_resources (decoded? decoded: content, dirname, resources);
+
+    g_free (dirname);
+    g_free (decoded);
+    g_free (content);
+}
+
 gboolean biblio_detect_bibliography (GuEditor* ec) {
+    GPtrArray* resources = g_ptr_array_new_with_free_func (g_free);
+    GList* editors = NULL;
+    GList* node;
+    gchar** files = NULL;
+    gchar* projdir = NULL;
     gchar* content = NULL;
-    gchar* bibfn = NULL;
-    gchar** result = NULL;
-    GMatchInfo *match_info;
-    GRegex* bib_regex = NULL;
+    gchar* dirname = NULL;
     gboolean state = FALSE;
+    gint i;
 
+    /* The resources of a project may be declared in any of its documents,
+     * those of the document itself come first. The open documents are
+     * scanned from their buffer, the others from disk. */
     content = editor_grab_buffer (ec);
-    bib_regex = g_regex_new ("^[^%]*\\\\bibliography{\\s*([^{}\\s]*)\\s*}",
-        G_REGEX_MULTILINE, 0, NULL);
-    if (g_regex_match (bib_regex, content, 0, &match_info)) {
-        result = g_match_info_fetch_all (match_info);
-        if (result[1]) {
-            if (!STR_EQU (result[1] +strlen (result[1]) -4, ".bib"))
-                bibfn = g_strconcat (result[1], ".bib", NULL);
-            else
-                bibfn = g_strdup (result[1]);
-            state = editor_fileinfo_update_biblio (ec, bibfn);
-            g_free (bibfn);
-        }
-        slog (L_INFO, "Detect bibliography file: %s\n", ec->bibfile);
-        g_strfreev (result);
-    }
+    dirname = ec->filename? g_path_get_dirname (ec->filename): NULL;
+    biblio_scan_resources (content, dirname, resources);
+    g_free (dirname);
     g_free (content);
-    g_match_info_free (match_info);
-    g_regex_unref (bib_regex);
+
+    if (ec->projfile) {
+        editors = gummi_get_all_editors ();
+        files = project_get_files (ec->projfile);
+        projdir = g_path_get_dirname (ec->projfile);
+    }
+    for (i = 0; files && files[i]; ++i) {
+        gchar* filename = g_path_is_absolute (files[i])
+                ? g_strdup (files[i])
+                : g_build_filename (projdir, files[i], NULL);
+        GuEditor* open = NULL;
+
+        for (node = editors; node && !open; node = node->next) {
+            GuEditor* other = node->data;
+            if (STR_EQU (other->filename, filename)) open = other;
+        }
+        if (open == ec) {
+            /* Already scanned */
+        } else if (open) {
+            content = editor_grab_buffer (open);
+            dirname = g_path_get_dirname (filename);
+            biblio_scan_resources (content, dirname, resources);
+            g_free (dirname);
+            g_free (content);
+        } else {
+            biblio_scan_file (filename, resources);
+        }
+        g_free (filename);
+    }
+    g_list_free (editors);
+    g_strfreev (files);
+    g_free (projdir);
+
+    g_ptr_array_add (resources, NULL);
+    state = editor_fileinfo_update_biblio (ec, (gchar**)resources->pdata);
+    for (i = 0; ec->bibfiles[i]; ++i)
+        slog (L_INFO, "Detect bibliography file: %s\n", ec->bibfiles[i]);
+    g_ptr_array_free (resources, TRUE);
     return state;
 }
 
-gboolean biblio_compile_bibliography (GuBiblio* bc, GuEditor* ec) {
+gchar* biblio_get_basenames (gchar** bibfiles) {
+    GString* names = g_string_new (NULL);
+    gint i;
+
+    for (i = 0; bibfiles && bibfiles[i]; ++i) {
+        gchar* basename = g_path_get_basename (bibfiles[i]);
+        if (i > 0) g_string_append (names, ", ");
+        g_string_append (names, basename);
+        g_free (basename);
+    }
+    return g_string_free (names, FALSE);
+}
+
+/* Bibliography backends
+ *
+ * A backend reads the citations of a document from a file written by the
+ * typesetter next to the pdf, and writes the .bbl file. It is only run if
+ * the digest of that file's citation data and of the databases changed
+ * since its last successful run. Its output is parsed into messages. */
+
+typedef struct _GuBibBackend {
+    const gchar* program;
+    const gchar* input_ext;
+    gchar* (*get_command) (const gchar* auxname);
+    void (*digest_input) (GChecksum* checksum, const gchar* content);
+    void (*parse_output) (const gchar* output, GPtrArray* messages);
+} GuBibBackend;
+
+static GuBibMessage* biblio_message_new (gboolean warning, const gchar* text,
+                                         const gchar* file, gint line) {
+    GuBibMessage* message = g_new0 (GuBibMessage, 1);
+    message->warning = warning;
+    message->text = g_strstrip (g_strdup (text));
+    message->file = g_strdup (file);
+    message->line = line;
+    return message;
+}
+
+static void biblio_message_free (GuBibMessage* message) {
+    g_free (message->text);
+    g_free (message->file);
+    g_free (message);
+}
+
+void biblio_result_free (GuBibResult* result) {
+    g_ptr_array_unref (result->messages);
+    g_free (result->output);
+    g_free (result);
+}
+
+static gchar* bibtex_get_command (const gchar* auxname) {
+    return g_strdup_printf ("%s bibtex \"%s\"", C_TEXSEC, auxname);
+}
+
+/* Only the citations, databases, style and included aux files matter */
+static void bibtex_digest_input (GChecksum* checksum, const gchar* content) {
+    gchar** lines = g_strsplit (content, "\n", -1);
+    gint i;
+
+    for (i = 0; lines[i]; ++i) {
+        if (g_str_has_prefix (lines[i], "\\citation{") ||
+            g_str_has_prefix (lines[i], "\\bibdata{") ||
+            g_str_has_prefix (lines[i], "\\bibstyle{") ||
+            g_str_has_prefix (lines[i], "\\@input{")) {
+            g_checksum_update (checksum, (guchar*)lines[i], -1);
+            g_checksum_update (checksum, (guchar*)"\n", 1);
+        }
+    }
+    g_strfreev (lines);
+}
+
+/* bibtex reports errors on the line before a "---line N of file F" one */
+static void bibtex_parse_output (const gchar* output, GPtrArray* messages) {
+    gchar** lines = g_strsplit (output, "\n", -1);
+    gint i;
+
+    for (i = 0; lines[i]; ++i) {
+        gint line = 0;
+        gchar file[256];
+
+        if (g_str_has_prefix (lines[i], "Warning--")) {
+            g_ptr_array_add (messages, biblio_message_new (TRUE,
+                        lines[i] + strlen ("Warning--"), NULL, 0));
+        } else if (sscanf (lines[i], "---line %d of file %255[^\n]",
+                           &line, file) == 2) {
+            g_ptr_array_add (messages, biblio_message_new (FALSE,
+                        i > 0? lines[i - 1]: "", file, line));
+        } else if (g_str_has_prefix (lines[i], "I couldn't open") ||
+                   g_str_has_prefix (lines[i], "I found no")) {
+            g_ptr_array_add (messages, biblio_message_new (FALSE,
+                        lines[i], NULL, 0));
+        }
+    }
+    g_strfreev (lines);
+}
+
+static gchar* biber_get_command (const gchar* auxname) {
+    gchar* dirname = g_path_get_dirname (auxname);
+    gchar* basename = g_path_get_basename (auxname);
+    gchar* command = g_strdup_printf ("%s biber --output-directory=\"%s\" "
+                                      "\"%s\"", C_TEXSEC, dirname, basename);
+    g_free (dirname);
+    g_free (basename);
+    return command;
+}
+
+/* The .bcf only holds what biber needs */
+static void biber_digest_input (GChecksum* checksum, const gchar* content) {
+    g_checksum_update (checksum, (guchar*)content, -1);
+}
+
+static void biber_parse_output (const gchar* output, GPtrArray* messages) {
+    gchar** lines = g_strsplit (output, "\n", -1);
+    gint i;
+
+    for (i = 0; lines[i]; ++i) {
+        const gchar* text = NULL;
+        gboolean warning = FALSE;
+        gint line = 0;
+
+        if ((text = strstr (lines[i], "ERROR - "))) {
+            text += strlen ("ERROR - ");
+        } else if ((text = strstr (lines[i], "WARN - "))) {
+            text += strlen ("WARN - ");
+            warning = TRUE;
+        } else {
+            continue;
+        }
+        if (strstr (text, ", line "))
+            line = atoi (strstr (text, ", line ") + strlen (", line "));
+        g_ptr_array_add (messages, biblio_message_new (warning, text,
+                                                       NULL, line));
+    }
+    g_strfreev (lines);
+}
+
+static const GuBibBackend bibtex_backend = {
+    "bibtex", ".aux",
+    bibtex_get_command, bibtex_digest_input, bibtex_parse_output
+};
+
+static const GuBibBackend biber_backend = {
+    "biber", ".bcf",
+    biber_get_command, biber_digest_input, biber_parse_output
+};
+
+static guint64 biblio_file_mtime (const gchar* filename) {
+    GStatBuf st;
+    return g_stat (filename, &st) == 0? (guint64)st.st_mtime: 0;
+}
+
+/* biblatex writes a .bcf for biber, a .bcf older than the .aux was left
+ * over from an earlier version of the document */
+static const GuBibBackend* biblio_get_backend (const gchar* auxname) {
+    gchar* aux = g_strconcat (auxname, ".aux", NULL);
+    gchar* bcf = g_strconcat (auxname, ".bcf", NULL);
+    guint64 bcf_mtime = biblio_file_mtime (bcf);
+    const GuBibBackend* backend = &bibtex_backend;
+
+    if (bcf_mtime && bcf_mtime >= biblio_file_mtime (aux))
+        backend = &biber_backend;
+    g_free (aux);
+    g_free (bcf);
+    return backend;
+}
+
+/* The draft pass that writes the .aux is only needed if the document
+ * changed since the last compile, or if it never completed */
+static void biblio_update_auxfile (GuEditor* ec, const gchar* auxname) {
+    gchar* text = editor_grab_buffer (ec);
+    gchar* current = NULL;
+    gchar* aux = g_strconcat (auxname, ".aux", NULL);
+    gboolean stale = FALSE;
+
+    if (!g_file_get_contents (ec->workfile, &current, NULL, NULL)
+            || !STR_EQU (current, text)) {
+        g_free (latex_update_workfile (ec));
+        stale = TRUE;
+    }
+    if (stale || biblio_file_mtime (aux) < biblio_file_mtime (ec->workfile))
+        latex_update_auxfile (ec);
+
+    g_free (aux);
+    g_free (current);
+    g_free (text);
+}
+
+static gchar* biblio_compute_digest (const GuBibBackend* backend,
+                                     const gchar* auxname, GuEditor* ec) {
+    GChecksum* checksum = g_checksum_new (G_CHECKSUM_SHA256);
+    gchar* input = g_strconcat (auxname, backend->input_ext, NULL);
+    gchar* content = NULL;
+    gsize length = 0;
+    gchar* digest = NULL;
+    gint i;
+
+    g_checksum_update (checksum, (guchar*)backend->program, -1);
+    if (g_file_get_contents (input, &content, NULL, NULL)) {
+        backend->digest_input (checksum, content);
+        g_free (content);
+    }
+    for (i = 0; ec->bibfiles && ec->bibfiles[i]; ++i) {
+        if (g_file_get_contents (ec->bibfiles[i], &content, &length, NULL)) {
+            g_checksum_update (checksum, (guchar*)ec->bibfiles[i], -1);
+            g_checksum_update (checksum, (guchar*)content, length);
+            g_free (content);
+        }
+    }
+
+    digest = g_strdup (g_checksum_get_string (checksum));
+    g_checksum_free (checksum);
+    g_free (input);
+    return digest;
+}
+
+GuBibResult* biblio_compile_bibliography (GuBiblio* bc, GuEditor* ec) {
+    GuBibResult* result = g_new0 (GuBibResult, 1);
+    const GuBibBackend* backend = NULL;
     gchar* dirname = g_path_get_dirname (ec->workfile);
     gchar* auxname = NULL;
+    gchar* bblname = NULL;
+    gchar* digest = NULL;
+    gchar* command = NULL;
+    gchar* program = NULL;
+    gboolean success = FALSE;
+    GError* err = NULL;
+    Tuple2 res;
+
+    result->messages =
+        g_ptr_array_new_with_free_func ((GDestroyNotify)biblio_message_free);
 
     if (ec->filename) {
         auxname = g_strdup (ec->pdffile);
@@ -103,106 +439,812 @@ gboolean biblio_compile_bibliography (GuBiblio* bc, GuEditor* ec) {
     } else
         auxname = g_strdup (ec->fdname);
 
-    if (g_find_program_in_path ("bibtex")) {
-        gboolean success = FALSE;
-        char* command = g_strdup_printf ("%s bibtex \"%s\"",
-                                         C_TEXSEC, auxname);
+    biblio_update_auxfile (ec, auxname);
+    backend = biblio_get_backend (auxname);
+    result->backend = backend->program;
 
-        g_free (auxname);
-        latex_update_workfile (ec);
-        latex_update_auxfile (ec);
-        Tuple2 res = utils_popen_r (command, dirname);
-        gtk_widget_set_tooltip_text (GTK_WIDGET (bc->progressbar),
-                (gchar*)res.second);
-        g_free (command);
-        g_free (dirname);
-        success = ! (strstr ((gchar*)res.second, "Database file #1") == NULL);
-        g_free (res.second);
-        return success;
+    if (!(program = g_find_program_in_path (backend->program))) {
+        slog (L_WARNING, "%s command is not present or executable.\n",
+                         backend->program);
+        result->status = BIBLIO_COMPILE_FAILED;
+        goto cleanup;
     }
-    slog (L_WARNING, "bibtex command is not present or executable.\n");
+
+    bblname = g_strconcat (auxname, ".bbl", NULL);
+    digest = biblio_compute_digest (backend, auxname, ec);
+    if (!bc->digests) {
+        bc->digests = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                             g_free, g_free);
+    }
+    if (utils_path_exists (bblname) &&
+            STR_EQU (g_hash_table_lookup (bc->digests, auxname), digest)) {
+        slog (L_INFO, "Bibliography of %s is up to date\n", auxname);
+        result->status = BIBLIO_COMPILE_SKIPPED;
+        goto cleanup;
+    }
+
+    command = backend->get_command (auxname);
+    res = utils_popen_r (command, dirname);
+    result->output = (gchar*)res.second;
+    if (result->output)
+        backend->parse_output (result->output, result->messages);
+
+    success = g_spawn_check_exit_status ((gint)(glong)res.first, &err);
+    /* bibtex exits with 1 when there were only warnings */
+    if (!success && backend == &bibtex_backend)
+        success = g_error_matches (err, G_SPAWN_EXIT_ERROR, 1);
+    g_clear_error (&err);
+
+    if (success) {
+        result->status = BIBLIO_COMPILE_SUCCESS;
+        g_hash_table_replace (bc->digests, g_strdup (auxname), digest);
+        digest = NULL;
+    } else {
+        result->status = BIBLIO_COMPILE_FAILED;
+        g_hash_table_remove (bc->digests, auxname);
+    }
+    gtk_widget_set_tooltip_text (GTK_WIDGET (bc->progressbar),
+                                 result->output);
+
+cleanup:
+    g_free (command);
+    g_free (digest);
+    g_free (bblname);
+    g_free (program);
     g_free (auxname);
     g_free (dirname);
+    return result;
+}
+
+/* BibTeX tokenizer
+ *
+ * A single pass over the database. Text outside of entries is ignored, as
+ * are @comment and @preamble groups. @string macros are expanded in the
+ * field values that follow them. Field values are stored with braces,
+ * quotes and runs of whitespace removed. A malformed entry is skipped up to
+ * the next '@', like bibtex itself does. */
+
+typedef struct _BibScanner {
+    const gchar* pos;
+    GHashTable* macros;
+    GString* value;
+} BibScanner;
+
+void biblio_entry_free (GuBibEntry* entry) {
+    if (!entry) return;
+    g_free (entry->ident);
+    g_free (entry->title);
+    g_free (entry->author);
+    g_free (entry->year);
+    g_free (entry);
+}
+
+static void bib_skip_space (BibScanner* s) {
+    while (g_ascii_isspace (*s->pos)) ++s->pos;
+}
+
+static gboolean bib_is_name_char (gchar c) {
+    return c && !g_ascii_isspace (c) && !strchr ("\"#%'(),={}", c);
+}
+
+/* Returns the length of the name starting at the current position */
+static gsize bib_scan_name (BibScanner* s) {
+    const gchar* start = s->pos;
+    while (bib_is_name_char (*s->pos)) ++s->pos;
+    return s->pos - start;
+}
+
+static void bib_append_char (BibScanner* s, gchar c) {
+    if (g_ascii_isspace (c)) {
+        if (s->value->len && s->value->str[s->value->len - 1] != ' ')
+            g_string_append_c (s->value, ' ');
+    } else {
+        g_string_append_c (s->value, c);
+    }
+}
+
+/* Scans a {...} or "..." delimited part of a value, the opening delimiter
+ * being at the current position. Nested braces are balanced, and quotes
+ * inside of them do not terminate a quoted part. */
+static gboolean bib_scan_delimited (BibScanner* s, gboolean append) {
+    gchar close = (*s->pos == '{')? '}': '"';
+    gint depth = 0;
+
+    for (++s->pos; *s->pos; ++s->pos) {
+        if (*s->pos == '{') {
+            ++depth;
+        } else if (*s->pos == '}') {
+            if (depth == 0) {
+                if (close != '}') return FALSE;
+                ++s->pos;
+                return TRUE;
+            }
+            --depth;
+        } else if (*s->pos == close && depth == 0) {
+            ++s->pos;
+            return TRUE;
+        } else if (append) {
+            bib_append_char (s, *s->pos);
+        }
+    }
     return FALSE;
 }
 
-int biblio_parse_entries (GuBiblio* bc, gchar *bib_content) {
-    int entry_total = 0;
-
-    GtkTreeIter iter;
-    GRegex* regex_entry;
-    GRegex* subregex_ident;
-    GRegex* subregex_title;
-    GRegex* subregex_author;
-    GRegex* subregex_year;
-    GRegex* regex_formatting;
-
-    gchar* author_out = NULL;
-    gchar* title_out = NULL;
-
-    GMatchInfo *match_entry;
-
-    regex_entry = g_regex_new (
-        "(@article|@book|@booklet|@conference|@inbook|@incollection|"
-        "@inproceedings|@manual|@mastersthesis|@misc|@phdthesis|"
-        "@proceedings|@techreport|@unpublished)([^@]*)",
-        (G_REGEX_CASELESS | G_REGEX_DOTALL), 0, NULL);
-
-    subregex_ident = g_regex_new ("@.+{([^,]+),", 0, 0, NULL);
-    subregex_title = g_regex_new
-		("[^book]title[\\s]*=[\\s]*(.*)", G_REGEX_CASELESS, 0, NULL);
-    subregex_author = g_regex_new
-		("author[\\s]*=[\\s]*(.*)", G_REGEX_CASELESS, 0, NULL);
-    subregex_year = g_regex_new
-		("year[\\s]*=[\\s]*[{|\"]?([1|2][0-9]{3})", G_REGEX_CASELESS, 0, NULL);
-    regex_formatting = g_regex_new ("[{|}|\"|,|\\$]", 0, 0, NULL);
-
-
-    g_regex_match (regex_entry, bib_content, 0, &match_entry);
-
-    while (g_match_info_matches (match_entry)) {
-
-        gchar *entry = g_match_info_fetch (match_entry, 0);
-
-        gchar **ident_res = g_regex_split (subregex_ident, entry, 0);
-        gchar **title_res = g_regex_split (subregex_title, entry, 0);
-        gchar **author_res = g_regex_split (subregex_author, entry, 0);
-        gchar **year_res = g_regex_split (subregex_year, entry, 0);
-
-        if (author_res[1])
-            author_out = g_regex_replace (regex_formatting, author_res[1],
-                                         -1, 0, "", 0, 0);
-        else author_out = NULL;
-
-        if (title_res[1])
-            title_out = g_regex_replace (regex_formatting, title_res[1],
-                                         -1, 0, "", 0, 0);
-        else title_out = NULL;
-
-        gtk_list_store_append (bc->list_biblios, &iter);
-        gtk_list_store_set (bc->list_biblios, &iter, 0, ident_res[1],
-                                                    1, title_out,
-                                                    2, author_out,
-                                                    3, year_res[1], -1);
-        gu_completion_add_citation_choice (gu_completion_get_default (), ident_res[1]);
-        g_free (author_out);
-        g_free (title_out);
-        g_strfreev (ident_res);
-        g_strfreev (title_res);
-        g_strfreev (author_res);
-        g_strfreev (year_res);
-        g_free (entry);
-        ++entry_total;
-
-        g_match_info_next (match_entry, NULL);
-    }
-    g_match_info_free (match_entry);
-    g_regex_unref (regex_entry);
-    g_regex_unref (subregex_ident);
-    g_regex_unref (subregex_title);
-    g_regex_unref (subregex_author);
-    g_regex_unref (subregex_year);
-    g_regex_unref (regex_formatting);
-
-    return entry_total;
+/* Scans a value into s->value: parts concatenated with '#', each being a
+ * delimited string, a number or the name of a macro */
+static gboolean bib_scan_value (BibScanner* s) {
+    g_string_truncate (s->value, 0);
+
+    while (TRUE) {
+        bib_skip_space (s);
+        if (*s->pos == '{' || *s->pos == '"') {
+            if (!bib_scan_delimited (s, TRUE)) return FALSE;
+        } else {
+            const gchar* start = s->pos;
+            gsize len = bib_scan_name (s);
+            if (len == 0) return FALSE;
+            if (g_ascii_isdigit (*start)) {
+                g_string_append_len (s->value, start, len);
+            } else {
+                gchar* name = g_ascii_strdown (start, len);
+                const gchar* macro = g_hash_table_lookup (s->macros, name);
+                g_string_append (s->value, macro? macro: name);
+                g_free (name);
+            }
+        }
+        bib_skip_space (s);
+        if (*s->pos != '#') break;
+        ++s->pos;
+    }
+    while (s->value->len && s->value->str[s->value->len - 1] == ' ')
+        g_string_truncate (s->value, s->value->len - 1);
+    return TRUE;
+}
+
+/* Scans the fields of an entry up to and including the closing delimiter.
+ * With entry set, the fields displayed in the list are stored in it; else
+ * every field is defined as a macro. */
+static gboolean bib_scan_fields (BibScanner* s, gchar close,
+                                 GuBibEntry* entry) {
+    while (TRUE) {
+        bib_skip_space (s);
+        if (*s->pos == ',') {
+            ++s->pos;
+            continue;
+        }
+        if (*s->pos == close) {
+            ++s->pos;
+            return TRUE;
+        }
+
+        const gchar* start = s->pos;
+        gsize len = bib_scan_name (s);
+        if (len == 0) return FALSE;
+        bib_skip_space (s);
+        if (*s->pos != '=') return FALSE;
+        ++s->pos;
+        if (!bib_scan_value (s)) return FALSE;
+
+        if (!entry) {
+            g_hash_table_replace (s->macros, g_ascii_strdown (start, len),
+                                  g_strdup (s->value->str));
+        } else if (len == 5 && !g_ascii_strncasecmp (start, "title", 5)) {
+            g_free (entry->title);
+            entry->title = g_strdup (s->value->str);
+        } else if (len == 6 && !g_ascii_strncasecmp (start, "author", 6)) {
+            g_free (entry->author);
+            entry->author = g_strdup (s->value->str);
+        } else if (len == 4 && !g_ascii_strncasecmp (start, "year", 4)) {
+            g_free (entry->year);
+            entry->year = g_strdup (s->value->str);
+        }
+    }
+}
+
+/* Scans the entry whose '@' is at the current position. Returns FALSE if it
+ * is malformed, else sets entry unless it is not a reference. */
+static gboolean bib_scan_entry (BibScanner* s, GuBibEntry** entry) {
+    const gchar* type;
+    gsize type_len;
+    gchar close;
+
+    ++s->pos;
+    bib_skip_space (s);
+    type = s->pos;
+    type_len = bib_scan_name (s);
+    bib_skip_space (s);
+
+    if (type_len == 0 || (*s->pos != '{' && *s->pos != '(')) return FALSE;
+    close = (*s->pos == '{')? '}': ')';
+
+    if ((type_len == 7 && !g_ascii_strncasecmp (type, "comment", 7)) ||
+        (type_len == 8 && !g_ascii_strncasecmp (type, "preamble", 8))) {
+        return close == '}' && bib_scan_delimited (s, FALSE);
+    }
+    ++s->pos;
+
+    if (type_len == 6 && !g_ascii_strncasecmp (type, "string", 6))
+        return bib_scan_fields (s, close, NULL);
+
+    bib_skip_space (s);
+    const gchar* ident = s->pos;
+    while (*s->pos && *s->pos != ',' && *s->pos != close
+            && !g_ascii_isspace (*s->pos))
+        ++s->pos;
+    if (s->pos == ident) return FALSE;
+
+    *entry = g_new0 (GuBibEntry, 1);
+    (*entry)->ident = g_strndup (ident, s->pos - ident);
+    if (!bib_scan_fields (s, close, *entry)) {
+        biblio_entry_free (*entry);
+        *entry = NULL;
+        return FALSE;
+    }
+    return TRUE;
+}
+
+GPtrArray* biblio_parse_entries (const gchar* bib_content) {
+    GPtrArray* entries =
+        g_ptr_array_new_with_free_func ((GDestroyNotify)biblio_entry_free);
+    BibScanner s = { bib_content, NULL, NULL };
+
+    s.macros = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+    s.value = g_string_sized_new (256);
+
+    while ((s.pos = strchr (s.pos, '@'))) {
+        const gchar* at = s.pos;
+        GuBibEntry* entry = NULL;
+
+        if (!bib_scan_entry (&s, &entry)) {
+            /* Resynchronize on the next '@' after a malformed entry */
+            s.pos = at + 1;
+        } else if (entry) {
+            g_ptr_array_add (entries, entry);
+        }
+    }
+
+    g_string_free (s.value, TRUE);
+    g_hash_table_destroy (s.macros);
+    return entries;
+}
+
+/* Filter index
+ *
+ * An inverted index from the case folded words of the key, title, author
+ * and year of the entries to the rows they appear in. The words are kept
+ * sorted, so that each word of a filter text is looked up as a prefix. The
+ * rows visible for a filter text are those matching all of its words. */
+
+struct _GuBibIndex {
+    guint n_rows;
+    guint n_words;
+    gchar** words;      /* sorted */
+    GArray** postings;  /* ascending rows of each word */
+    guint8* visible;
+};
+
+/* Splits a string into its case folded alphanumeric words */
+static void biblio_index_tokenize (const gchar* text, GPtrArray* words) {
+    gchar* folded;
+    const gchar* start = NULL;
+    const gchar* p;
+
+    if (!text) return;
+    folded = g_utf8_casefold (text, -1);
+    for (p = folded; ; p = g_utf8_next_char (p)) {
+        gboolean alnum = *p && g_unichar_isalnum (g_utf8_get_char (p));
+        if (alnum && !start) {
+            start = p;
+        } else if (!alnum && start) {
+            g_ptr_array_add (words, g_strndup (start, p - start));
+            start = NULL;
+        }
+        if (!*p) break;
+    }
+    g_free (folded);
+}
+
+static gint biblio_index_word_cmp (gconstpointer a, gconstpointer b) {
+    return strcmp (*(const gchar**)a, *(const gchar**)b);
+}
+
+GuBibIndex* biblio_index_new (GPtrArray* entries) {
+    GuBibIndex* index = g_new0 (GuBibIndex, 1);
+    GHashTable* table = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                               g_free, NULL);
+    GPtrArray* words = g_ptr_array_new ();
+    GPtrArray* keys = g_ptr_array_new ();
+    GHashTableIter iter;
+    gpointer word;
+    guint i, j;
+
+    for (i = 0; i < entries->len; ++i) {
+        GuBibEntry* entry = g_ptr_array_index (entries, i);
+
+        g_ptr_array_set_size (words, 0);
+        biblio_index_tokenize (entry->ident, words);
+        biblio_index_tokenize (entry->title, words);
+        biblio_index_tokenize (entry->author, words);
+        biblio_index_tokenize (entry->year, words);
+
+        for (j = 0; j < words->len; ++j) {
+            gchar* word = g_ptr_array_index (words, j);
+            GArray* rows = g_hash_table_lookup (table, word);
+
+            if (!rows) {
+                rows = g_array_new (FALSE, FALSE, sizeof (guint));
+                g_hash_table_insert (table, word, rows);
+            } else {
+                g_free (word);
+            }
+            if (!rows->len || g_array_index (rows, guint, rows->len - 1) != i)
+                g_array_append_val (rows, i);
+        }
+    }
+    g_ptr_array_free (words, TRUE);
+
+    g_hash_table_iter_init (&iter, table);
+    while (g_hash_table_iter_next (&iter, &word, NULL))
+        g_ptr_array_add (keys, word);
+    g_ptr_array_sort (keys, biblio_index_word_cmp);
+
+    index->n_rows = entries->len;
+    index->n_words = keys->len;
+    index->words = g_new (gchar*, keys->len + 1);
+    index->postings = g_new (GArray*, keys->len);
+    for (i = 0; i < keys->len; ++i) {
+        index->words[i] = g_ptr_array_index (keys, i);
+        index->postings[i] = g_hash_table_lookup (table, index->words[i]);
+    }
+    index->words[keys->len] = NULL;
+    index->visible = g_malloc (MAX (entries->len, 1));
+    memset (index->visible, 1, entries->len);
+
+    /* The words and postings now belong to the index */
+    g_hash_table_steal_all (table);
+    g_hash_table_destroy (table);
+    g_ptr_array_free (keys, TRUE);
+    return index;
+}
+
+void biblio_index_free (GuBibIndex* index) {
+    guint i;
+
+    for (i = 0; i < index->n_words; ++i)
+        g_array_free (index->postings[i], TRUE);
+    g_free (index->postings);
+    g_strfreev (index->words);
+    g_free (index->visible);
+    g_free (index);
+}
+
+void biblio_index_filter (GuBibIndex* index, const gchar* text) {
+    GPtrArray* query;
+    guint i, j, k, n;
+
+    if (!index) return;
+    query = g_ptr_array_new_with_free_func (g_free);
+    biblio_index_tokenize (text, query);
+    if (query->len == 0) {
+        memset (index->visible, 1, index->n_rows);
+        g_ptr_array_free (query, TRUE);
+        return;
+    }
+
+    /* visible[row] counts the words matched so far, a row is only counted
+     * for a word if it matched all of the previous ones */
+    memset (index->visible, 0, index->n_rows);
+    n = MIN (query->len, G_MAXUINT8);
+    for (k = 0; k < n; ++k) {
+        const gchar* word = g_ptr_array_index (query, k);
+        guint lo = 0, hi = index->n_words;
+
+        while (lo < hi) {
+            guint mid = lo + (hi - lo) / 2;
+            if (strcmp (index->words[mid], word) < 0) lo = mid + 1;
+            else hi = mid;
+        }
+        for (i = lo; i < index->n_words
+                && g_str_has_prefix (index->words[i], word); ++i) {
+            GArray* rows = index->postings[i];
+            for (j = 0; j < rows->len; ++j) {
+                guint row = g_array_index (rows, guint, j);
+                if (index->visible[row] == k) index->visible[row] = k + 1;
+            }
+        }
+    }
+    for (i = 0; i < index->n_rows; ++i)
+        index->visible[i] = (index->visible[i] == n);
+
+    g_ptr_array_free (query, TRUE);
+}
+
+gboolean biblio_index_row_visible (GuBibIndex* index, guint row) {
+    return row < index->n_rows && index->visible[row];
+}
+
+/* Bibliography cache
+ *
+ * The entries parsed from a database are cached in C_TMPDIR, in a file
+ * named after the checksum of its path, and are used for as long as the
+ * mtime, to the microsecond, and size of the database do not change. Every
+ * distinct string is stored once; the entries refer to it by index, with 0
+ * meaning unset. */
+
+#define BIB_CACHE_VERSION 2
+#define BIB_CACHE_TYPE "(uttasa(uuuu))"
+
+/* What a database is checked against to reuse its cache */
+typedef struct {
+    guint64 mtime;          /* in microseconds */
+    guint64 size;
+} BibStamp;
+
+/* A rewrite within the same second is only told apart by the microseconds
+ * of the mtime */
+static gboolean biblio_cache_get_stamp (const gchar* bibfile, BibStamp* stamp) {
+    GFile* file = g_file_new_for_path (bibfile);
+    GFileInfo* info = g_file_query_info (file,
+            G_FILE_ATTRIBUTE_STANDARD_SIZE ","
+            G_FILE_ATTRIBUTE_TIME_MODIFIED ","
+            G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC,
+            G_FILE_QUERY_INFO_NONE, NULL, NULL);
+
+    g_object_unref (file);
+    if (!info) return FALSE;
+    stamp->mtime = g_file_info_get_attribute_uint64 (info,
+                        G_FILE_ATTRIBUTE_TIME_MODIFIED) * G_USEC_PER_SEC
+                 + g_file_info_get_attribute_uint32 (info,
+                        G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC);
+    stamp->size = g_file_info_get_size (info);
+    g_object_unref (info);
+    return TRUE;
+}
+
+static gchar* biblio_cache_get_filename (const gchar* bibfile) {
+    gchar* tmpdir = C_TMPDIR;
+    gchar* checksum = g_compute_checksum_for_string (G_CHECKSUM_MD5,
+                                                     bibfile, -1);
+    gchar* basename = g_strdup_printf ("bib-%s.cache", checksum);
+    gchar* filename = g_build_filename (tmpdir, basename, NULL);
+
+    g_free (basename);
+    g_free (checksum);
+    g_free (tmpdir);
+    return filename;
+}
+
+static GPtrArray* biblio_cache_load (const gchar* bibfile, BibStamp* stamp) {
+    gchar* filename = biblio_cache_get_filename (bibfile);
+    GMappedFile* mapped = g_mapped_file_new (filename, FALSE, NULL);
+    GPtrArray* entries = NULL;
+    GBytes* bytes;
+    GVariant* cache;
+    GVariant* list;
+    const gchar** strings = NULL;
+    guint32 version = 0;
+    guint64 mtime = 0, size = 0;
+
+    g_free (filename);
+    if (!mapped) return NULL;
+
+    bytes = g_mapped_file_get_bytes (mapped);
+    cache = g_variant_ref_sink (g_variant_new_from_bytes (
+                G_VARIANT_TYPE (BIB_CACHE_TYPE), bytes, FALSE));
+    g_variant_get (cache, "(utt^a&s@a(uuuu))", &version, &mtime, &size,
+                   &strings, &list);
+
+    if (version == BIB_CACHE_VERSION && mtime == stamp->mtime
+            && size == stamp->size) {
+        guint n_strings = g_strv_length ((gchar**)strings);
+        guint32 ident, title, author, year;
+        GVariantIter iter;
+
+        entries = g_ptr_array_new_full (g_variant_n_children (list),
+                                        (GDestroyNotify)biblio_entry_free);
+        g_variant_iter_init (&iter, list);
+        while (g_variant_iter_next (&iter, "(uuuu)",
+                                    &ident, &title, &author, &year)) {
+            GuBibEntry* entry;
+
+            if (ident == 0 || ident >= n_strings || title >= n_strings
+                    || author >= n_strings || year >= n_strings)
+                continue;
+            entry = g_new0 (GuBibEntry, 1);
+            entry->ident = g_strdup (strings[ident]);
+            entry->title = title? g_strdup (strings[title]): NULL;
+            entry->author = author? g_strdup (strings[author]): NULL;
+            entry->year = year? g_strdup (strings[year]): NULL;
+            g_ptr_array_add (entries, entry);
+        }
+    }
+
+    g_free (strings);
+    g_variant_unref (list);
+    g_variant_unref (cache);
+    g_bytes_unref (bytes);
+    g_mapped_file_unref (mapped);
+    return entries;
+}
+
+static guint32 biblio_cache_intern (GHashTable* table, GPtrArray* strings,
+                                    const gchar* str) {
+    gpointer index;
+
+    if (!str) return 0;
+    if (!g_hash_table_lookup_extended (table, str, NULL, &index)) {
+        index = GUINT_TO_POINTER (strings->len);
+        g_hash_table_insert (table, (gpointer)str, index);
+        g_ptr_array_add (strings, (gpointer)str);
+    }
+    return GPOINTER_TO_UINT (index);
+}
+
+static void biblio_cache_save (const gchar* bibfile, BibStamp* stamp,
+                               GPtrArray* entries) {
+    GHashTable* table = g_hash_table_new (g_str_hash, g_str_equal);
+    GPtrArray* strings = g_ptr_array_new ();
+    GVariantBuilder list;
+    GVariant* cache;
+    gchar* tmpdir = C_TMPDIR;
+    gchar* filename = biblio_cache_get_filename (bibfile);
+    guint i;
+
+    g_ptr_array_add (strings, "");
+    g_variant_builder_init (&list, G_VARIANT_TYPE ("a(uuuu)"));
+    for (i = 0; i < entries->len; ++i) {
+        GuBibEntry* entry = g_ptr_array_index (entries, i);
+        g_variant_builder_add (&list, "(uuuu)",
+                biblio_cache_intern (table, strings, entry->ident),
+                biblio_cache_intern (table, strings, entry->title),
+                biblio_cache_intern (table, strings, entry->author),
+                biblio_cache_intern (table, strings, entry->year));
+    }
+
+    cache = g_variant_ref_sink (g_variant_new ("(utt@as@a(uuuu))",
+                BIB_CACHE_VERSION, stamp->mtime, stamp->size,
+                g_variant_new_strv ((const gchar* const*)strings->pdata,
+                                    strings->len),
+                g_variant_builder_end (&list)));
+
+    /* Runs on a worker thread, a failure only costs a reparse */
+    g_mkdir_with_parents (tmpdir, DIR_PERMS);
+    g_file_set_contents (filename, g_variant_get_data (cache),
+                         g_variant_get_size (cache), NULL);
+
+    g_variant_unref (cache);
+    g_free (filename);
+    g_free (tmpdir);
+    g_ptr_array_free (strings, TRUE);
+    g_hash_table_destroy (table);
+}
+
+GuBibList* biblio_list_new (GPtrArray* entries, gboolean indexed) {
+    GuBibList* list = g_new0 (GuBibList, 1);
+    list->entries = entries;
+    if (indexed) list->index = biblio_index_new (entries);
+    return list;
+}
+
+void biblio_list_free (GuBibList* list) {
+    g_ptr_array_unref (list->entries);
+    if (list->index) biblio_index_free (list->index);
+    g_free (list);
+}
+
+static GPtrArray* biblio_parse_file (const gchar* filename, GError** err) {
+    GPtrArray* entries = NULL;
+    gchar* content = NULL;
+    BibStamp stamp;
+    gboolean cacheable = biblio_cache_get_stamp (filename, &stamp);
+
+    if (cacheable && (entries = biblio_cache_load (filename, &stamp)))
+        return entries;
+    if (!g_file_get_contents (filename, &content, NULL, err))
+        return NULL;
+
+    entries = biblio_parse_entries (content);
+    if (cacheable) biblio_cache_save (filename, &stamp, entries);
+    g_free (content);
+    return entries;
+}
+
+typedef struct _BibParseJob {
+    gchar** filenames;
+    gboolean indexed;
+    GPtrArray** results;    /* entries of each file, in order */
+    GError** errors;
+} BibParseJob;
+
+static void biblio_parse_job_free (BibParseJob* job) {
+    g_strfreev (job->filenames);
+    g_free (job->results);
+    g_free (job->errors);
+    g_free (job);
+}
+
+static void biblio_parse_file_worker (gpointer data, gpointer user) {
+    BibParseJob* job = user;
+    guint i = GPOINTER_TO_UINT (data) - 1;
+
+    job->results[i] = biblio_parse_file (job->filenames[i], &job->errors[i]);
+}
+
+/* Parses the files of a job in parallel and merges their entries, keeping
+ * only the first entry of each key */
+static void biblio_parse_files_thread (GTask* task, gpointer source,
+                                       gpointer data,
+                                       GCancellable* cancellable) {
+    BibParseJob* job = data;
+    guint n = g_strv_length (job->filenames);
+    GPtrArray* entries = NULL;
+    GHashTable* idents = NULL;
+    GThreadPool* pool = NULL;
+    GError* err = NULL;
+    gint64 start = stats_start ();
+    guint i, j;
+
+    job->results = g_new0 (GPtrArray*, n);
+    job->errors = g_new0 (GError*, n);
+    if (n > 1) {
+        pool = g_thread_pool_new (biblio_parse_file_worker, job,
+                                  MIN (n, g_get_num_processors ()), FALSE,
+                                  NULL);
+        for (i = 0; i < n; ++i)
+            g_thread_pool_push (pool, GUINT_TO_POINTER (i + 1), NULL);
+        g_thread_pool_free (pool, FALSE, TRUE);
+    } else if (n == 1) {
+        biblio_parse_file_worker (GUINT_TO_POINTER (1), job);
+    }
+
+    entries =
+        g_ptr_array_new_with_free_func ((GDestroyNotify)biblio_entry_free);
+    idents = g_hash_table_new (g_str_hash, g_str_equal);
+    for (i = 0; i < n; ++i) {
+        GPtrArray* result = job->results[i];
+
+        if (!result) {
+            if (!err) err = job->errors[i];
+            else g_error_free (job->errors[i]);
+            continue;
+        }
+        for (j = 0; j < result->len; ++j) {
+            GuBibEntry* entry = g_ptr_array_index (result, j);
+            if (g_hash_table_contains (idents, entry->ident)) continue;
+            g_hash_table_add (idents, entry->ident);
+            g_ptr_array_add (entries, entry);
+            result->pdata[j] = NULL;
+        }
+    }
+
+    /* Failing to read some of the files only loses their entries */
+    if (entries->len == 0 && err) {
+        g_task_return_error (task, err);
+        g_ptr_array_unref (entries);
+        err = NULL;
+    } else if (g_task_return_error_if_cancelled (task)) {
+        g_ptr_array_unref (entries);
+    } else {
+        g_task_return_pointer (task, biblio_list_new (entries, job->indexed),
+                               (GDestroyNotify)biblio_list_free);
+    }
+
+    if (err) g_error_free (err);
+    g_hash_table_destroy (idents);
+    for (i = 0; i < n; ++i) {
+        if (job->results[i]) g_ptr_array_unref (job->results[i]);
+    }
+    stats_end (STATS_BIBLIO_PARSE, start);
+}
+
+static void biblio_run_parse (gchar** filenames, gboolean indexed,
+                              GCancellable* cancellable,
+                              GAsyncReadyCallback callback, gpointer user) {
+    GTask* task = g_task_new (NULL, cancellable, callback, user);
+    BibParseJob* job = g_new0 (BibParseJob, 1);
+
+    job->filenames = g_strdupv (filenames);
+    job->indexed = indexed;
+    g_task_set_task_data (task, job, (GDestroyNotify)biblio_parse_job_free);
+    g_task_run_in_thread (task, biblio_parse_files_thread);
+    g_object_unref (task);
+}
+
+void biblio_parse_files_async (GuBiblio* bc, gchar** filenames,
+                               GAsyncReadyCallback callback, gpointer user) {
+    if (bc->cancellable) {
+        g_cancellable_cancel (bc->cancellable);
+        g_object_unref (bc->cancellable);
+    }
+    bc->cancellable = g_cancellable_new ();
+    biblio_run_parse (filenames, TRUE, bc->cancellable, callback, user);
+}
+
+GuBibList* biblio_parse_files_finish (GAsyncResult* result, GError** err) {
+    return g_task_propagate_pointer (G_TASK (result), err);
+}
+
+static void biblio_add_citation_choices (GPtrArray* entries) {
+    const gchar** idents = g_new (const gchar*, entries->len + 1);
+    guint i;
+
+    for (i = 0; i < entries->len; ++i)
+        idents[i] = ((GuBibEntry*)g_ptr_array_index (entries, i))->ident;
+    idents[i] = NULL;
+
+    gu_completion_add_citation_choices (gu_completion_get_default (),
+        (gchar**)idents, entries->len);
+    g_free (idents);
+}
+
+static void on_citations_loaded (GObject* source, GAsyncResult* result,
+                                 gpointer user) {
+    GuBibList* list = biblio_parse_files_finish (result, NULL);
+
+    if (list) {
+        biblio_add_citation_choices (list->entries);
+        biblio_list_free (list);
+    }
+}
+
+void biblio_load_citations (gchar** bibfiles) {
+    biblio_run_parse (bibfiles, FALSE, NULL, on_citations_loaded, NULL);
+}
+
+static gboolean biblio_row_visible (GtkTreeModel* model, GtkTreeIter* iter,
+                                    gpointer data) {
+    GuBiblio* bc = data;
+    guint row = 0;
+
+    if (!bc->index) return TRUE;
+    gtk_tree_model_get (model, iter, BIBLIO_COLUMN_ROW, &row, -1);
+    return biblio_index_row_visible (bc->index, row);
+}
+
+void biblio_set_entries (GuBiblio* bc, GuBibList* list) {
+    GPtrArray* entries = list->entries;
+    GtkListStore* store = gtk_list_store_new (5, G_TYPE_STRING, G_TYPE_STRING,
+                                              G_TYPE_STRING, G_TYPE_STRING,
+                                              G_TYPE_UINT);
+    guint i;
+
+    /* Filled while detached, so the view is only updated once */
+    for (i = 0; i < entries->len; ++i) {
+        GuBibEntry* entry = g_ptr_array_index (entries, i);
+        gtk_list_store_insert_with_values (store, NULL, -1,
+                                           0, entry->ident,
+                                           1, entry->title,
+                                           2, entry->author,
+                                           3, entry->year,
+                                           BIBLIO_COLUMN_ROW, i, -1);
+    }
+
+    g_object_unref (bc->list_biblios);
+    bc->list_biblios = store;
+
+    /* The filter model is kept for as long as the entries, and refiltered
+     * from the index as the filter text changes */
+    if (bc->index) biblio_index_free (bc->index);
+    bc->index = list->index;
+    list->index = NULL;
+    if (bc->list_filtered) g_object_unref (bc->list_filtered);
+    bc->list_filtered = gtk_tree_model_filter_new (GTK_TREE_MODEL (store),
+                                                   NULL);
+    gtk_tree_model_filter_set_visible_func (
+            GTK_TREE_MODEL_FILTER (bc->list_filtered), biblio_row_visible,
+            bc, NULL);
+    biblio_filter (bc, gtk_entry_get_text (bc->list_filter));
+
+    biblio_add_citation_choices (entries);
+}
+
+void biblio_filter (GuBiblio* bc, const gchar* text) {
+    if (!bc->list_filtered) return;
+
+    biblio_index_filter (bc->index, text);
+    /* Detached while refiltering, the view would otherwise be updated for
+     * every row that is hidden or shown */
+    gtk_tree_view_set_model (bc->biblio_treeview, NULL);
+    gtk_tree_model_filter_refilter (GTK_TREE_MODEL_FILTER (bc->list_filtered));
+    gtk_tree_view_set_model (bc->biblio_treeview, bc->list_filtered);
 }
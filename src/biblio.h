@@ -36,22 +36,81 @@
 
 #define GU_BIBLIO(x) ((GuBiblio*)x)
 typedef struct _GuBiblio GuBiblio;
+typedef struct _GuBibEntry GuBibEntry;
+typedef struct _GuBibIndex GuBibIndex;
+typedef struct _GuBibList GuBibList;
+typedef struct _GuBibMessage GuBibMessage;
+typedef struct _GuBibResult GuBibResult;
+
+/* Column of list_biblios holding the position of the entry in the index */
+#define BIBLIO_COLUMN_ROW 4
 
 struct _GuBiblio {
     GtkProgressBar* progressbar;
     GtkListStore* list_biblios;
+    GtkTreeModel* list_filtered;
     GtkTreeView* biblio_treeview;
     GtkLabel* filenm_label;
     GtkLabel* refnr_label;
     GtkEntry* list_filter;
     gchar* basename;
     double progressval;
+    GCancellable* cancellable;
+    GuBibIndex* index;
+    GHashTable* digests;    /* auxname -> digest of the last backend run */
+};
+
+struct _GuBibEntry {
+    gchar* ident;
+    gchar* title;
+    gchar* author;
+    gchar* year;
+};
+
+typedef enum {
+    BIBLIO_COMPILE_FAILED = 0,
+    BIBLIO_COMPILE_SUCCESS,
+    BIBLIO_COMPILE_SKIPPED     /* nothing changed since the last run */
+} GuBibStatus;
+
+struct _GuBibMessage {
+    gboolean warning;
+    gchar* text;
+    gchar* file;
+    gint line;              /* 0 when unknown */
+};
+
+struct _GuBibResult {
+    GuBibStatus status;
+    const gchar* backend;
+    gchar* output;
+    GPtrArray* messages;
+};
+
+struct _GuBibList {
+    GPtrArray* entries;
+    GuBibIndex* index;
 };
 
 GuBiblio* biblio_init (GtkBuilder* builder);
 gboolean biblio_detect_bibliography (GuEditor* ec);
-gboolean biblio_compile_bibliography (GuBiblio* bc, GuEditor* ec);
-int biblio_parse_entries (GuBiblio* bc, gchar *bib_content);
+gchar* biblio_get_basenames (gchar** bibfiles);
+GuBibResult* biblio_compile_bibliography (GuBiblio* bc, GuEditor* ec);
+void biblio_result_free (GuBibResult* result);
+void biblio_entry_free (GuBibEntry* entry);
+GPtrArray* biblio_parse_entries (const gchar* bib_content);
+void biblio_parse_files_async (GuBiblio* bc, gchar** filenames,
+                               GAsyncReadyCallback callback, gpointer user);
+GuBibList* biblio_parse_files_finish (GAsyncResult* result, GError** err);
+GuBibList* biblio_list_new (GPtrArray* entries, gboolean indexed);
+void biblio_list_free (GuBibList* list);
+GuBibIndex* biblio_index_new (GPtrArray* entries);
+void biblio_index_free (GuBibIndex* index);
+void biblio_index_filter (GuBibIndex* index, const gchar* text);
+gboolean biblio_index_row_visible (GuBibIndex* index, guint row);
+void biblio_set_entries (GuBiblio* bc, GuBibList* list);
+void biblio_filter (GuBiblio* bc, const gchar* text);
+void biblio_load_citations (gchar** bibfiles);
 
 
 #endif /* __GUMMI_BIBLIO_H__ */
@@ -40,14 +40,15 @@ void latexmk_init (void) {
 
     if (external_exists (C_LATEXMK)) {
         // TODO: check if supported version
-        slog (L_INFO, "Typesetter detected: Latexmk %s\n",
-                       external_version (C_LATEXMK));
+        gchar* version = external_version (C_LATEXMK);
+        slog (L_INFO, "Typesetter detected: Latexmk %s\n", version);
+        g_free (version);
         lmk_detected = TRUE;
     }
 }
 
 gboolean latexmk_active (void) {
-    if (config_value_as_str_equals ("Compile", "typesetter", C_LATEXMK)) {
+    if (STR_EQU (config_cache.typesetter, C_LATEXMK)) {
         return TRUE;
     }
     return FALSE;
@@ -79,7 +80,7 @@ gchar* latexmk_get_flags (const gchar *method) {
     gchar* lmkwithoutput;
     gchar* lmkflags;
 
-    if (config_get_boolean ("Compile", "synctex")) {
+    if (config_cache.synctex) {
         if (STR_EQU (method, "texpdf")) {
             lmkflags = g_strdup_printf("-e \"\\$pdflatex = 'pdflatex -synctex=1'\" -silent");
         }
@@ -40,14 +40,15 @@ void rubber_init (void) {
 
     if (external_exists (C_RUBBER)) {
         // TODO: check if supported version
-        slog (L_INFO, "Typesetter detected: Rubber %s\n",
-                       external_version (C_RUBBER));
+        gchar* version = external_version (C_RUBBER);
+        slog (L_INFO, "Typesetter detected: Rubber %s\n", version);
+        g_free (version);
         rub_detected = TRUE;
     }
 }
 
 gboolean rubber_active (void) {
-    if (config_value_as_str_equals ("Compile", "typesetter", C_RUBBER)) {
+    if (STR_EQU (config_cache.typesetter, C_RUBBER)) {
         return TRUE;
     }
     return FALSE;
@@ -77,7 +78,7 @@ gchar* rubber_get_flags (const gchar *method) {
         rubflags = g_strdup_printf("-p -d -q");
     }
 
-    if (config_get_boolean ("Compile", "synctex")) {
+    if (config_cache.synctex) {
         rubflags = g_strconcat ("--synctex ", rubflags, NULL);
     }
 
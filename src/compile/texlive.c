@@ -52,20 +52,23 @@ int texlive_init (void) {
     }
 
     if (external_exists (C_PDFLATEX)) {
-        slog (L_INFO, "Typesetter detected: %s\n",
-              external_version (C_PDFLATEX));
+        gchar* version = external_version (C_PDFLATEX);
+        slog (L_INFO, "Typesetter detected: %s\n", version);
+        g_free (version);
         pdf_detected = TRUE;
     }
 
     if (external_exists (C_XELATEX)) {
-        slog (L_INFO, "Typesetter detected: %s\n",
-              external_version (C_XELATEX));
+        gchar* version = external_version (C_XELATEX);
+        slog (L_INFO, "Typesetter detected: %s\n", version);
+        g_free (version);
         xel_detected = TRUE;
     }
 
     if (external_exists (C_LUALATEX)) {
-        slog (L_INFO, "Typesetter detected: %s\n",
-              external_version (C_LUALATEX));
+        gchar* version = external_version (C_LUALATEX);
+        slog (L_INFO, "Typesetter detected: %s\n", version);
+        g_free (version);
         lua_detected = TRUE;
     }
     return texversion;
@@ -79,21 +82,21 @@ gboolean texlive_active (void) {
 }
 
 gboolean pdflatex_active (void) {
-    if (config_value_as_str_equals ("Compile", "typesetter", "pdflatex")) {
+    if (STR_EQU (config_cache.typesetter, "pdflatex")) {
         return TRUE;
     }
     return FALSE;
 }
 
 gboolean xelatex_active (void) {
-    if (config_value_as_str_equals ("Compile", "typesetter", "xelatex")) {
+    if (STR_EQU (config_cache.typesetter, "xelatex")) {
         return TRUE;
     }
     return FALSE;
 }
 
 gboolean lualatex_active (void) {
-    if (config_value_as_str_equals ("Compile", "typesetter", "lualatex")) {
+    if (STR_EQU (config_cache.typesetter, "lualatex")) {
         return TRUE;
     }
     return FALSE;
@@ -173,7 +176,7 @@ gchar* texlive_get_flags (const gchar* method) {
         flags = tmp;
     }
 
-    if (config_get_boolean ("Compile", "synctex")) {
+    if (config_cache.synctex) {
         gchar* tmp = g_strconcat(flags, " -synctex=1", NULL);
         g_free(flags);
         flags = tmp;
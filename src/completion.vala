@@ -38,7 +38,9 @@ public class GuCompletion : GLib.Object, SourceCompletionProvider {
 	struct CompletionArgument {
 		string label;
 		bool optional;
-		CompletionChoice[] choices;
+		ChoiceSet choices;
+		// Key of the shared set of dynamic choices, from <placeholder>.
+		string? placeholder;
 	}
 
 	struct CompletionChoice {
@@ -57,17 +59,110 @@ public class GuCompletion : GLib.Object, SourceCompletionProvider {
 		// The value is 'true' for an optional argument.
 		Gee.ArrayList<bool> args_types;
 	}
+
+	// Choices in insertion order, with a hash set of their names so that
+	// duplicates are rejected in constant time.
+	class ChoiceSet {
+		public Gee.ArrayList<CompletionChoice?> items = new Gee.ArrayList<CompletionChoice?>();
+		// Bumped on every change, to invalidate the proposals built from it.
+		public uint stamp = 0;
+		private Gee.HashSet<string> _names = new Gee.HashSet<string>();
+
+		public bool contains(string name) {
+			return name in _names;
+		}
+
+		public bool add(CompletionChoice choice) {
+			if (!_names.add(choice.name)) return false;
+			items.add(choice);
+			stamp++;
+			return true;
+		}
+	}
+
+	// A completion proposal, with the mask of the characters of its text
+	// kept at hand for matching. The SourceCompletionItem is only created
+	// once the proposal is shown. Public for the benchmarks of the filter.
+	public class Proposal {
+		public string label;
+		public string text;
+		public string? info;
+		public Gdk.Pixbuf? icon;
+		public uint64 mask;
+		private SourceCompletionItem? _item = null;
+
+		public SourceCompletionItem item {
+			get {
+				if (_item == null) _item = new SourceCompletionItem(label, text, icon, info);
+				return _item;
+			}
+		}
+
+		public Proposal(string label, string text, Gdk.Pixbuf? icon, string? info) {
+			this.label = label;
+			this.text = text;
+			this.icon = icon;
+			this.info = info;
+			mask = char_mask(text);
+		}
+	}
+
+	// A proposal matching the text typed so far, and how well it does.
+	struct RankedProposal {
+		unowned Proposal proposal;
+		bool prefix;
+		int score;
+	}
+
+	// Sorted proposals of a command argument, and the stamp of the
+	// placeholder set they were built from.
+	class ArgumentProposals {
+		public Gee.ArrayList<Proposal> items;
+		public uint stamp;
+	}
 	
 	private Gee.HashMap<string, CompletionCommand?> _commands;
 	// contains only environments that have extra info
 	private Gee.HashMap<string, CompletionChoice?> _environments;
-	private List<SourceCompletionItem> _proposals;
+	// Dynamic choices shared by all the arguments with the same placeholder key,
+	// e.g. "Labels" for \ref, \eqref and \pageref.
+	private Gee.HashMap<string, ChoiceSet> _placeholders;
+	private Gee.HashMap<string, ArgumentProposals> _argument_proposals;
+	// Commands and environments of the mapped database, decoded into
+	// _commands and _environments the first time they are looked up.
+	private Variant? _db_commands = null;
+	private Variant? _db_environments = null;
+	// Kept sorted by byte order of the inserted text, so that all the proposals
+	// sharing a prefix form a contiguous range that can be found by bisection.
+	private Gee.ArrayList<Proposal> _proposals;
+	// Number of times each proposal text was activated in this session.
+	private Gee.HashMap<string, int> _usage;
+	// Cached GLib.List of all the proposals, rebuilt lazily after a change.
+	private List<SourceCompletionItem>? _all_proposals = null;
+	private bool _all_proposals_valid = false;
 	private static GuCompletion _instance = null;
 	
 	// While parsing the XML file, keep track of current command/argument/choice.
 	private CompletionCommand _current_command;
 	private CompletionArgument _current_arg;
 	private CompletionChoice _current_choice;
+
+	// Ranking bonus per past activation of a proposal, and the number of
+	// activations it saturates at.
+	private const int USAGE_BONUS = 8;
+	private const int MAX_USAGE = 10;
+
+	// Most proposals shown for a filter.
+	private const int MAX_FILTERED = 100;
+
+	// The compiled completion database: format version, modification time
+	// and size of the completion.xml it was compiled from, proposals sorted
+	// by text (label, text, info, package required), then the commands that
+	// have arguments (name, package, arguments (label, optional, placeholder,
+	// choices (name, package, insert, insert_after))) sorted by name, and the
+	// choices that insert text, i.e. the environments, sorted by name.
+	private const uint32 DATABASE_VERSION = 2;
+	private const string DATABASE_TYPE = "(utta(sssb)a(smsa(sbmsa(smsmsms)))a(smsmsms))";
 	
 	private Gdk.Pixbuf? _icon_cmd;
 	private Gdk.Pixbuf? _icon_choice;
@@ -81,8 +176,27 @@ public class GuCompletion : GLib.Object, SourceCompletionProvider {
 		
 		_commands = new Gee.HashMap<string, CompletionCommand?>();
 		_environments = new Gee.HashMap<string, CompletionChoice?>();
+		_placeholders = new Gee.HashMap<string, ChoiceSet>();
+		_argument_proposals = new Gee.HashMap<string, ArgumentProposals>();
+		_proposals = new Gee.ArrayList<Proposal>();
+		_usage = new Gee.HashMap<string, int>();
 
 		File file = File.new_for_path(Path.build_filename(GUMMI_DATA, "misc", "completion.xml"));
+		string database = Path.build_filename(Environment.get_user_cache_dir(), "gummi", "completion.db");
+
+		// The XML file is only parsed when the database compiled from it is
+		// missing or out of date.
+		uint64 mtime = 0;
+		int64 size = -1;
+		try {
+			FileInfo info = file.query_info(FileAttribute.TIME_MODIFIED + "," + FileAttribute.STANDARD_SIZE, 0);
+			mtime = info.get_attribute_uint64(FileAttribute.TIME_MODIFIED);
+			size = info.get_size();
+		} catch (GLib.Error e) {
+			warning("Impossible to stat completion data: %s", e.message);
+		}
+
+		if (size >= 0 && load_database(database, mtime, size)) return;
 
 		string? contents = load_file(file);
 		if (contents == null) return;
@@ -91,14 +205,187 @@ public class GuCompletion : GLib.Object, SourceCompletionProvider {
 			MarkupParser parser = { parser_start, parser_end, parser_text, null, null };
 			MarkupParseContext context = new MarkupParseContext(parser, 0, this, null);
 			context.parse(contents, -1);
-			_proposals.sort((CompareFunc)compare_proposals);
+			_proposals.sort(compare_proposals);
 		} catch (GLib.Error e) {
 			warning("Impossible to load completion data: %s", e.message);
+			return;
+		}
+
+		if (size >= 0) save_database(database, mtime, size);
+	}
+	
+	// Load the proposals from the compiled database, provided it was compiled
+	// from a completion.xml of the given mtime and size. The commands and the
+	// environments stay in the mapped file until they are looked up.
+	private bool load_database(string path, uint64 mtime, int64 size) {
+		MappedFile mapped;
+		try {
+			mapped = new MappedFile(path, false);
+		} catch (FileError e) {
+			return false;
+		}
+
+		Variant db = new Variant.from_bytes(new VariantType(DATABASE_TYPE), mapped.get_bytes(), false);
+		if (db.get_child_value(0).get_uint32() != DATABASE_VERSION
+				|| db.get_child_value(1).get_uint64() != mtime
+				|| db.get_child_value(2).get_uint64() != (uint64)size)
+			return false;
+
+		// Stored already sorted.
+		foreach (Variant proposal in db.get_child_value(3)) {
+			string label, text, info;
+			bool package;
+			proposal.get("(sssb)", out label, out text, out info, out package);
+			_proposals.add(new Proposal(label, text, package ? _icon_package_required : _icon_cmd, info));
+		}
+
+		_db_commands = db.get_child_value(4);
+		_db_environments = db.get_child_value(5);
+		return true;
+	}
+
+	// Child of 'array', sorted by its first field, whose first field is 'key'.
+	private static Variant? lookup_sorted(Variant array, string key) {
+		size_t low = 0;
+		size_t high = array.n_children();
+		while (low < high) {
+			size_t mid = (low + high) / 2;
+			Variant child = array.get_child_value(mid);
+			int cmp = strcmp(child.get_child_value(0).get_string(), key);
+			if (cmp == 0) return child;
+			if (cmp < 0) low = mid + 1;
+			else high = mid;
+		}
+		return null;
+	}
+
+	private CompletionCommand? get_command(string name) {
+		CompletionCommand? cached = _commands[name];
+		if (cached != null || _db_commands == null) return cached;
+
+		Variant? command = lookup_sorted(_db_commands, name);
+		if (command == null) return null;
+
+		string? package;
+		Variant args;
+		command.get("(sms@a(sbmsa(smsmsms)))", null, out package, out args);
+
+		CompletionCommand cmd = CompletionCommand();
+		cmd.name = name;
+		cmd.package = package;
+
+		foreach (Variant argument in args) {
+			string label;
+			bool optional;
+			string? placeholder;
+			Variant choices;
+			argument.get("(sbms@a(smsmsms))", out label, out optional, out placeholder, out choices);
+
+			CompletionArgument arg = CompletionArgument();
+			arg.label = label;
+			arg.optional = optional;
+			arg.placeholder = placeholder;
+			arg.choices = new ChoiceSet();
+			if (placeholder != null) get_placeholder(placeholder);
+
+			foreach (Variant choice in choices) arg.choices.add(decode_choice(choice));
+			cmd.args += arg;
 		}
+		_commands[name] = cmd;
+		return cmd;
+	}
+
+	private CompletionChoice? get_environment(string name) {
+		CompletionChoice? cached = _environments[name];
+		if (cached != null || _db_environments == null) return cached;
+
+		Variant? choice = lookup_sorted(_db_environments, name);
+		if (choice == null) return null;
+
+		CompletionChoice env = decode_choice(choice);
+		_environments[name] = env;
+		return env;
+	}
+
+	private static CompletionChoice decode_choice(Variant choice_variant) {
+		string name;
+		string? package, insert, insert_after;
+		choice_variant.get("(smsmsms)", out name, out package, out insert, out insert_after);
+
+		CompletionChoice choice = CompletionChoice();
+		choice.name = name;
+		choice.package = package;
+		choice.insert = insert;
+		choice.insert_after = insert_after;
+		return choice;
 	}
 	
-	private static int compare_proposals(SourceCompletionItem a, SourceCompletionItem b) {
-		return a.text.collate (b.text);
+	// Compile what was parsed from completion.xml into the database read by
+	// load_database(). The commands and environments are sorted by name for
+	// the lookups.
+	private void save_database(string path, uint64 mtime, int64 size) {
+		VariantBuilder proposals = new VariantBuilder(new VariantType("a(sssb)"));
+		foreach (Proposal proposal in _proposals)
+			proposals.add("(sssb)", proposal.label, proposal.text, proposal.info, proposal.icon == _icon_package_required);
+
+		Gee.ArrayList<string> names = new Gee.ArrayList<string>();
+		names.add_all(_commands.keys);
+		names.sort((a, b) => strcmp(a, b));
+
+		VariantBuilder commands = new VariantBuilder(new VariantType("a(smsa(sbmsa(smsmsms)))"));
+		foreach (string name in names) {
+			CompletionCommand? cmd = _commands[name];
+			VariantBuilder args = new VariantBuilder(new VariantType("a(sbmsa(smsmsms))"));
+			foreach (CompletionArgument arg in cmd.args) {
+				VariantBuilder choices = new VariantBuilder(new VariantType("a(smsmsms)"));
+				foreach (CompletionChoice? choice in arg.choices.items)
+					choices.add("(smsmsms)", choice.name, choice.package, choice.insert, choice.insert_after);
+				args.add("(sbms@a(smsmsms))", arg.label, arg.optional, arg.placeholder, choices.end());
+			}
+			commands.add("(sms@a(sbmsa(smsmsms)))", cmd.name, cmd.package, args.end());
+		}
+
+		names.clear();
+		names.add_all(_environments.keys);
+		names.sort((a, b) => strcmp(a, b));
+
+		VariantBuilder environments = new VariantBuilder(new VariantType("a(smsmsms)"));
+		foreach (string name in names) {
+			CompletionChoice? env = _environments[name];
+			environments.add("(smsmsms)", env.name, env.package, env.insert, env.insert_after);
+		}
+
+		Variant db = new Variant("(utt@a(sssb)@a(smsa(sbmsa(smsmsms)))@a(smsmsms))", DATABASE_VERSION, mtime, (uint64)size, proposals.end(), commands.end(), environments.end());
+
+		try {
+			DirUtils.create_with_parents(Path.get_dirname(path), 0755);
+			FileUtils.set_data(path, db.get_data_as_bytes().get_data());
+		} catch (FileError e) {
+			warning("Impossible to save the completion database: %s", e.message);
+		}
+	}
+	
+	// Byte order rather than collation: prefix ranges are only contiguous
+	// when the order is consistent with has_prefix().
+	private static int compare_proposals(Proposal a, Proposal b) {
+		return strcmp(a.text, b.text);
+	}
+
+	// Index of the first item whose text is not less than 'key'.
+	private static int lower_bound(Gee.List<Proposal> items, string key) {
+		int low = 0;
+		int high = items.size;
+		while (low < high) {
+			int mid = (low + high) / 2;
+			if (strcmp(items[mid].text, key) < 0) low = mid + 1;
+			else high = mid;
+		}
+		return low;
+	}
+
+	private void insert_proposal(Proposal proposal) {
+		_proposals.insert(lower_bound(_proposals, proposal.text), proposal);
+		_all_proposals_valid = false;
 	}
 	
 	private void parser_start(MarkupParseContext context, string name, string[] attr_names, string[] attr_values) throws MarkupError {
@@ -124,8 +411,11 @@ public class GuCompletion : GLib.Object, SourceCompletionProvider {
 			case "insert_after":
 				break;
 
-			// not yet supported
 			case "placeholder":
+				parser_add_placeholder(attr_names, attr_values);
+				break;
+
+			// not yet supported
 			case "component":
 				break;
 
@@ -160,6 +450,7 @@ public class GuCompletion : GLib.Object, SourceCompletionProvider {
 	private void parser_add_argument(string[] attr_names, string[] attr_values) throws MarkupError {
 		_current_arg = CompletionArgument();
 		_current_arg.optional = false;
+		_current_arg.choices = new ChoiceSet();
 
 		for (int attr_num = 0; attr_num < attr_names.length; attr_num++) {
 			switch (attr_names[attr_num]) {
@@ -196,13 +487,35 @@ public class GuCompletion : GLib.Object, SourceCompletionProvider {
 		}
 	}
 	
+	private void parser_add_placeholder(string[] attr_names, string[] attr_values) throws MarkupError {
+		for (int attr_num = 0; attr_num < attr_names.length; attr_num++) {
+			switch (attr_names[attr_num]) {
+				case "key":
+					_current_arg.placeholder = attr_values[attr_num];
+					get_placeholder(attr_values[attr_num]);
+					break;
+
+				default:
+					throw new MarkupError.UNKNOWN_ATTRIBUTE("unknown placeholder attribute \"" + attr_names[attr_num] + "\"");
+			}
+		}
+	}
+	
+	private ChoiceSet get_placeholder(string key) {
+		ChoiceSet? choices = _placeholders[key];
+		if (choices == null) {
+			choices = new ChoiceSet();
+			_placeholders[key] = choices;
+		}
+		return choices;
+	}
+	
 	private void parser_end(MarkupParseContext context, string name) throws MarkupError {
 		switch (name) {
 			case "command":
 				Gdk.Pixbuf pixbuf = _current_command.package != null ? _icon_package_required : _icon_cmd;
 
-				SourceCompletionItem item = new SourceCompletionItem(_current_command.name, get_command_text_to_insert(_current_command), pixbuf, get_command_info(_current_command));
-				_proposals.prepend (item);
+				_proposals.add(new Proposal(_current_command.name, get_command_text_to_insert(_current_command), pixbuf, get_command_info(_current_command)));
 
 				// We don't need to store commands that have no arguments,
 				// they are only in _proposals, it's sufficient.
@@ -214,7 +527,7 @@ public class GuCompletion : GLib.Object, SourceCompletionProvider {
 					break;
 
 				case "choice":
-					_current_arg.choices += _current_choice;
+					_current_arg.choices.add(_current_choice);
 					if (_current_choice.insert != null || _current_choice.insert_after != null) _environments[_current_choice.name] = _current_choice;
 					break;
 		}
@@ -246,40 +559,37 @@ public class GuCompletion : GLib.Object, SourceCompletionProvider {
 	}
 	
 	public void add_ref_choice(string choice) {
-		CompletionCommand cmd_ref = _commands["\\ref"];
-		CompletionCommand cmd_eqref = _commands["\\eqref"];
-		CompletionCommand cmd_pageref = _commands["\\pageref"];
-		foreach (CompletionChoice cc in cmd_ref.args[0].choices)
-			if (cc.name == choice) return;
-		CompletionChoice cchoice = CompletionChoice();
-		cchoice.name = choice;
-		cmd_ref.args[0].choices += cchoice;
-		cmd_eqref.args[0].choices = cmd_ref.args[0].choices;
-		cmd_pageref.args[0].choices = cmd_ref.args[0].choices;
-		_commands["\\ref"] = cmd_ref;
-		_commands["\\eqref"] = cmd_eqref;
-		_commands["\\pageref"] = cmd_pageref;
+		add_placeholder_choices("Labels", { choice }, null);
+	}
+	
+	public void add_ref_choices(string[] choices) {
+		add_placeholder_choices("Labels", choices, null);
 	}
 	
 	public void add_citation_choice(string choice) {
-		CompletionCommand cmd_cite = _commands["\\cite"];
-		foreach (CompletionChoice cc in cmd_cite.args[0].choices)
-			if (cc.name == choice) return;
-		CompletionChoice cchoice = CompletionChoice();
-		cchoice.name = choice;
-		cmd_cite.args[0].choices += cchoice;
-		_commands["\\cite"] = cmd_cite;
+		add_placeholder_choices("Bibitems", { choice }, null);
+	}
+	
+	public void add_citation_choices(string[] choices) {
+		add_placeholder_choices("Bibitems", choices, null);
 	}
 	
 	public void add_environment(string env, string? package) {
-		CompletionCommand cmd_begin = _commands["\\begin"];
-		foreach (CompletionChoice cc in cmd_begin.args[0].choices)
-			if (cc.name == env) return;
-		CompletionChoice choice = CompletionChoice();
-		choice.name = env;
-		choice.package = package;
-		cmd_begin.args[0].choices += choice;
-		_commands["\\begin"] = cmd_begin;
+		add_placeholder_choices("Newenvironments", { env }, package);
+	}
+	
+	public void add_environments(string[] envs, string? package) {
+		add_placeholder_choices("Newenvironments", envs, package);
+	}
+	
+	private void add_placeholder_choices(string key, string[] names, string? package) {
+		ChoiceSet choices = get_placeholder(key);
+		foreach (string name in names) {
+			CompletionChoice choice = CompletionChoice();
+			choice.name = name;
+			choice.package = package;
+			choices.add(choice);
+		}
 	}
 	
 	public void add_command(string name, string[] arg_names, bool first_arg_opt, string? package) {
@@ -290,16 +600,27 @@ public class GuCompletion : GLib.Object, SourceCompletionProvider {
 		foreach (string arg in arg_names) {
 			CompletionArgument ca = CompletionArgument();
 			ca.label = arg;
+			ca.choices = new ChoiceSet();
 			args += ca;
 		}
 		if (first_arg_opt && arg_names.length != 0) args[0].optional = true;
 		cmd.args = args;
 		
-		for (int i = 0; i < _proposals.length(); i++)
-			if (_proposals.nth_data(i).label == name) _proposals.remove_link(_proposals.nth(i));
+		// The text to insert starts with the command name, so any previous
+		// definition lies in the prefix range of 'name'.
+		for (int i = lower_bound(_proposals, name); i < _proposals.size && _proposals[i].text.has_prefix(name); ) {
+			if (_proposals[i].label == name) _proposals.remove_at(i);
+			else i++;
+		}
 		Gdk.Pixbuf pixbuf = package != null ? _icon_package_required : _icon_cmd;
-		SourceCompletionItem item = new SourceCompletionItem(cmd.name, get_command_text_to_insert(cmd), pixbuf, get_command_info(cmd));
-		_proposals.prepend(item);
+		insert_proposal(new Proposal(cmd.name, get_command_text_to_insert(cmd), pixbuf, get_command_info(cmd)));
+
+		// The argument proposals of a command are only cached once it is in
+		// _commands, drop the ones built from the definition replaced.
+		CompletionCommand? replaced = _commands[name];
+		if (replaced != null) {
+			for (int i = 1; i <= replaced.args.length; i++) _argument_proposals.unset(@"$name:$i");
+		}
 		if (arg_names.length != 0) _commands[name] = cmd;
 	}
 	
@@ -403,12 +724,12 @@ public class GuCompletion : GLib.Object, SourceCompletionProvider {
 	
 	private void populate_argument(SourceCompletionContext context, ArgumentContext info) {
 		// invalid argument's command
-		if (!_commands.has_key(info.cmd_name)) {
+		if (get_command(info.cmd_name) == null) {
 			show_no_proposals(context);
 			return;
 		}
 
-		unowned List<SourceCompletionItem> proposals_to_filter = get_argument_proposals(info);
+		Gee.List<Proposal>? proposals_to_filter = get_argument_proposals(info);
 
 		if (proposals_to_filter == null) {
 			show_no_proposals(context);
@@ -418,36 +739,60 @@ public class GuCompletion : GLib.Object, SourceCompletionProvider {
 		show_filtered_proposals(context, proposals_to_filter, info.arg_contents);
 	}
 	
-	private unowned List<SourceCompletionItem>? get_argument_proposals(ArgumentContext arg_context) {
-		return_val_if_fail(_commands.has_key(arg_context.cmd_name), null);
+	private Gee.List<Proposal>? get_argument_proposals(ArgumentContext arg_context) {
+		CompletionCommand? found = get_command(arg_context.cmd_name);
+		return_val_if_fail(found != null, null);
 
-		CompletionCommand cmd = _commands[arg_context.cmd_name];
-		string cmd_info = get_command_info(cmd);
+		CompletionCommand cmd = found;
 
 		int arg_num = get_argument_num(cmd.args, arg_context.args_types);
 		if (arg_num == -1) return null;
 
 		CompletionArgument arg = cmd.args[arg_num - 1];
-		unowned List<SourceCompletionItem> items = null;
+		ChoiceSet? dynamic_choices = arg.placeholder != null ? _placeholders[arg.placeholder] : null;
+		uint stamp = dynamic_choices != null ? dynamic_choices.stamp : 0;
+
+		// The static choices never change once parsed, so the proposals only
+		// have to be rebuilt when the placeholder's choices did.
+		string key = @"$(cmd.name):$arg_num";
+		ArgumentProposals? cached = _argument_proposals[key];
+		if (cached == null || cached.stamp != stamp) {
+			cached = new ArgumentProposals();
+			cached.items = build_argument_proposals(cmd, arg, dynamic_choices);
+			cached.stamp = stamp;
+			_argument_proposals[key] = cached;
+		}
 
-		foreach (CompletionChoice choice in arg.choices) {
-			Gdk.Pixbuf pixbuf;
-			string? arg_info = null;
-			if (choice.package != null) {
-				pixbuf = _icon_package_required;
-				arg_info = cmd_info + "\nPackage: " + choice.package;
-			} else pixbuf = _icon_choice;
+		return cached.items.size > 0 ? cached.items : null;
+	}
+	
+	private Gee.ArrayList<Proposal> build_argument_proposals(CompletionCommand cmd, CompletionArgument arg, ChoiceSet? dynamic_choices) {
+		string cmd_info = get_command_info(cmd);
+		Gee.ArrayList<Proposal> items = new Gee.ArrayList<Proposal>();
 
-			SourceCompletionItem item = new SourceCompletionItem(choice.name, choice.name, pixbuf, arg_info ?? cmd_info);
-			items.prepend(item);
-		}
+		foreach (CompletionChoice? choice in arg.choices.items)
+			items.add(get_choice_proposal(choice, cmd_info));
 
-		if (items == null) return null;
+		if (dynamic_choices != null) {
+			foreach (CompletionChoice? choice in dynamic_choices.items)
+				if (!arg.choices.contains(choice.name)) items.add(get_choice_proposal(choice, cmd_info));
+		}
 
-		items.sort((CompareFunc)compare_proposals);
+		items.sort(compare_proposals);
 		return items;
 	}
 	
+	private Proposal get_choice_proposal(CompletionChoice choice, string cmd_info) {
+		Gdk.Pixbuf pixbuf;
+		string? arg_info = null;
+		if (choice.package != null) {
+			pixbuf = _icon_package_required;
+			arg_info = cmd_info + "\nPackage: " + choice.package;
+		} else pixbuf = _icon_choice;
+
+		return new Proposal(choice.name, choice.name, pixbuf, arg_info ?? cmd_info);
+	}
+	
 	// Get the command information: the prototype, and the package required if a package
 	// is required. In the prototype, the current argument ('cur_arg') is in bold.
 	// By default, no argument is in bold.
@@ -572,35 +917,103 @@ public class GuCompletion : GLib.Object, SourceCompletionProvider {
 	}
 
 	private void show_all_proposals(SourceCompletionContext context) {
-		context.add_proposals((SourceCompletionProvider)this, _proposals, true);
+		if (!_all_proposals_valid) {
+			_all_proposals = proposals_in_range(_proposals, 0, _proposals.size);
+			_all_proposals_valid = true;
+		}
+		context.add_proposals((SourceCompletionProvider)this, _all_proposals, true);
+	}
+
+	// Build a GLib.List of items[start:end], keeping the ascending order.
+	private static List<SourceCompletionItem> proposals_in_range(Gee.List<Proposal> items, int start, int end) {
+		List<SourceCompletionItem> list = null;
+		for (int i = end - 1; i >= start; i--) list.prepend(items[i].item);
+		return list;
 	}
 	
-	private void show_filtered_proposals(SourceCompletionContext context, List<SourceCompletionItem> proposals_to_filter, string? prefix) {
+	private void show_filtered_proposals(SourceCompletionContext context, Gee.List<Proposal> proposals_to_filter, string? prefix) {
 		// No filtering needed.
 		if (prefix == null || prefix == "")	{
-			context.add_proposals((SourceCompletionProvider)this, proposals_to_filter, true);
+			context.add_proposals((SourceCompletionProvider)this, proposals_in_range(proposals_to_filter, 0, proposals_to_filter.size), true);
 			return;
 		}
 
-		// TODO this is a O(n) time complexity. This could be reduced to a O(log n) by
-		// using a GSequence for example, like it is done by the words completion provider
-		// in GtkSourceView.
-		List<SourceCompletionItem> filtered_proposals = null;
-		foreach (SourceCompletionItem item in proposals_to_filter)
-			if (item.text.has_prefix(prefix)) filtered_proposals.prepend(item);
-
-		// Since we have prepend items we must reverse the list to keep the proposals
-		// in ascending order.
-		if (filtered_proposals != null) filtered_proposals.reverse();
+		List<SourceCompletionItem> filtered_proposals = filter_proposals(proposals_to_filter, prefix, _usage);
 
 		// No match, show a message so the completion widget doesn't disappear.
-		else {
+		if (filtered_proposals == null) {
 			SourceCompletionItem dummy_proposal = new SourceCompletionItem("No matching proposal", "", null, null);
 			filtered_proposals.prepend(dummy_proposal);
 		}
 
 		context.add_proposals((SourceCompletionProvider)this, filtered_proposals, true);
 	}
+
+	// The best MAX_FILTERED proposals of 'items', sorted by text, matching
+	// 'pattern': the ones starting with it come first, then the ones that only
+	// contain it as a subsequence, e.g. \sbsec for \subsection. 'usage' gives
+	// the number of times each proposal text was activated.
+	public static List<SourceCompletionItem> filter_proposals(Gee.List<Proposal> items, string pattern, Gee.Map<string, int>? usage) {
+		RankedProposal[] matches = new RankedProposal[MAX_FILTERED];
+		int count = 0;
+		bool case_sensitive = pattern.down() != pattern;
+
+		// The proposals starting with the pattern form a contiguous range.
+		int start = lower_bound(items, pattern);
+		int end = start;
+		for (; end < items.size; end++) {
+			Proposal proposal = items[end];
+			if (!proposal.text.has_prefix(pattern)) break;
+			rank_proposal(matches, ref count, proposal, true, fuzzy_score(pattern, proposal.text, case_sensitive), usage);
+		}
+
+		// Any other match ranks below them, so the rest is only scanned when
+		// the range is short of the cap. The character masks discard most of
+		// the candidates before scoring.
+		if (end - start < MAX_FILTERED) {
+			uint64 mask = char_mask(pattern);
+			for (int i = 0; i < items.size; i++) {
+				if (i == start) i = end;
+				if (i == items.size) break;
+
+				Proposal proposal = items[i];
+				if ((proposal.mask & mask) != mask) continue;
+
+				int score = fuzzy_score(pattern, proposal.text, case_sensitive);
+				if (score >= 0) rank_proposal(matches, ref count, proposal, false, score, usage);
+			}
+		}
+
+		List<SourceCompletionItem> filtered = null;
+		for (int i = count - 1; i >= 0; i--) filtered.prepend(matches[i].proposal.item);
+		return filtered;
+	}
+
+	// Insert a match into the first 'count' items of 'matches', kept best
+	// first, dropping the worst one when it is full.
+	private static void rank_proposal(RankedProposal[] matches, ref int count, Proposal proposal, bool prefix, int score, Gee.Map<string, int>? usage) {
+		RankedProposal ranked = RankedProposal();
+		ranked.proposal = proposal;
+		ranked.prefix = prefix;
+		ranked.score = score;
+		if (usage != null) ranked.score += USAGE_BONUS * int.min(usage[proposal.text], MAX_USAGE);
+
+		if (count == matches.length) {
+			if (compare_ranked_proposals(ranked, matches[count - 1]) >= 0) return;
+			count--;
+		}
+
+		int i = count++;
+		for (; i > 0 && compare_ranked_proposals(ranked, matches[i - 1]) < 0; i--)
+			matches[i] = matches[i - 1];
+		matches[i] = ranked;
+	}
+
+	private static int compare_ranked_proposals(RankedProposal a, RankedProposal b) {
+		if (a.prefix != b.prefix) return a.prefix ? -1 : 1;
+		if (a.score != b.score) return b.score - a.score;
+		return strcmp(a.proposal.text, b.proposal.text);
+	}
 	
 	private string? get_latex_command_at_iter(TextIter iter) {
 		string text = get_text_line_to_iter(iter);
@@ -646,6 +1059,8 @@ public class GuCompletion : GLib.Object, SourceCompletionProvider {
 		string text = proposal.get_text();
 		if (text == null || text == "") return true;
 
+		_usage[text] = _usage[text] + 1;
+
 		string? cmd = get_latex_command_at_iter(iter);
 
 		/* Command name */
@@ -663,14 +1078,12 @@ public class GuCompletion : GLib.Object, SourceCompletionProvider {
 	private void activate_proposal_command_name (SourceCompletionProposal proposal, TextIter iter, string? cmd) {
 		string text = proposal.get_text();
 
-		long index_start = cmd != null ? cmd.length : 0;
-		string text_to_insert = text[index_start:text.length];
-
 		/* Insert the text */
 		TextBuffer doc = iter.get_buffer();
-		TextMark old_pos_mark = doc.create_mark(null, iter, true);
 
 		doc.begin_user_action();
+		string text_to_insert = get_text_to_insert(doc, ref iter, text, cmd);
+		TextMark old_pos_mark = doc.create_mark(null, iter, true);
 		doc.insert(ref iter, text_to_insert, -1);
 		doc.end_user_action();
 
@@ -686,11 +1099,9 @@ public class GuCompletion : GLib.Object, SourceCompletionProvider {
 	private void activate_proposal_argument_choice(SourceCompletionProposal proposal, TextIter iter, string arg_cmd, string? arg_contents) {
 		string text = proposal.get_text();
 
-		long index_start = arg_contents != null ? arg_contents.length : 0;
-		string text_to_insert = text[index_start : text.length];
-
 		TextBuffer doc = iter.get_buffer();
 		doc.begin_user_action();
+		string text_to_insert = get_text_to_insert(doc, ref iter, text, arg_contents);
 		doc.insert(ref iter, text_to_insert, -1);
 
 		// close environment: \begin{env} => \end{env}
@@ -712,6 +1123,19 @@ public class GuCompletion : GLib.Object, SourceCompletionProvider {
 		doc.end_user_action();
 	}
 	
+	// Get the part of the proposal 'text' left to insert after 'typed', the text
+	// just before 'iter'. A fuzzy match doesn't start with what was typed, so
+	// it is removed from the buffer and the whole proposal is inserted.
+	private string get_text_to_insert(TextBuffer doc, ref TextIter iter, string text, string? typed) {
+		if (typed == null) return text;
+		if (text.has_prefix(typed)) return text[typed.length:text.length];
+
+		TextIter start = iter;
+		start.backward_chars(typed.char_count());
+		doc.delete(ref start, ref iter);
+		return text;
+	}
+	
 	private void close_environment(string env_name, TextIter iter) {
 		TextBuffer doc = iter.get_buffer();
 		
@@ -728,7 +1152,7 @@ public class GuCompletion : GLib.Object, SourceCompletionProvider {
 			for (int i = 0; i < width; i++) indent += " ";
 		}
 
-		CompletionChoice? env = _environments[env_name];
+		CompletionChoice? env = get_environment(env_name);
 
 		doc.begin_user_action();
 
@@ -763,6 +1187,84 @@ string? load_file(File file) {
 	}
 }
 
+// Set of the characters of 'text', case folded. A proposal can only match
+// a pattern if its mask contains the mask of the pattern.
+public uint64 char_mask(string text) {
+	uint64 mask = 0;
+	for (int i = 0; i < text.length; i++) {
+		char c = text[i].tolower();
+		int bit;
+		if (c >= 'a' && c <= 'z') bit = c - 'a';
+		else if (c >= '0' && c <= '9') bit = 26 + (c - '0');
+		else bit = 36 + (int)((uchar)c % 28);
+		mask |= (uint64)1 << bit;
+	}
+	return mask;
+}
+
+bool same_char(char a, char b, bool case_sensitive) {
+	return case_sensitive ? a == b : a.tolower() == b.tolower();
+}
+
+// Score 'text' against 'pattern' taken as a subsequence, the way fzf does:
+// every matched character scores, more at the start of a word or in a run,
+// and gaps between matched characters cost.
+// Returns -1 if 'pattern' is not a subsequence of 'text'.
+public int fuzzy_score(string pattern, string text, bool case_sensitive) {
+	const int SCORE_MATCH = 16;
+	const int BONUS_BOUNDARY = 8;
+	const int BONUS_CONSECUTIVE = 4;
+	const int PENALTY_GAP_START = 3;
+	const int PENALTY_GAP_EXTENSION = 1;
+
+	int pattern_len = pattern.length;
+	int text_len = text.length;
+	if (pattern_len == 0 || text_len < pattern_len) return -1;
+
+	// Find where the first occurrence ends, then walk back from there to
+	// narrow it down to the shortest window.
+	int p = 0;
+	int end = -1;
+	for (int t = 0; t < text_len; t++) {
+		if (same_char(text[t], pattern[p], case_sensitive) && ++p == pattern_len) {
+			end = t + 1;
+			break;
+		}
+	}
+	if (end == -1) return -1;
+
+	int start = 0;
+	p = pattern_len - 1;
+	for (int t = end - 1; t >= 0; t--) {
+		if (same_char(text[t], pattern[p], case_sensitive) && --p < 0) {
+			start = t;
+			break;
+		}
+	}
+
+	int score = 0;
+	bool prev_match = false;
+	bool in_gap = false;
+	p = 0;
+	for (int t = start; t < end; t++) {
+		if (p < pattern_len && same_char(text[t], pattern[p], case_sensitive)) {
+			score += SCORE_MATCH;
+			if (t == 0 || !text[t - 1].isalnum()) score += BONUS_BOUNDARY;
+			else if (prev_match) score += BONUS_CONSECUTIVE;
+			prev_match = true;
+			in_gap = false;
+			p++;
+		} else {
+			score -= in_gap ? PENALTY_GAP_EXTENSION : PENALTY_GAP_START;
+			prev_match = false;
+			in_gap = true;
+		}
+	}
+
+	// Prefer the matches close to the start of the text.
+	return int.max(score - start, 0);
+}
+
 bool char_is_escaped(string text, long char_index) {
 	return_val_if_fail(char_index < text.length, false);
 
@@ -98,8 +98,80 @@ const gchar default_config[] =
 GKeyFile *key_file = NULL;
 gchar *conf_filepath = 0;
 
+GuConfig config_cache;
+
+typedef enum {
+    CONFIG_BOOLEAN,
+    CONFIG_INTEGER,
+    CONFIG_STRING
+} GuConfigType;
+
+/* The settings copied into config_cache */
+static const struct {
+    const gchar* group;
+    const gchar* key;
+    GuConfigType type;
+    glong offset;
+} cached_keys[] = {
+    { "Interface", "snippets", CONFIG_BOOLEAN,
+        G_STRUCT_OFFSET (GuConfig, snippets) },
+    { "Editor", "spelling", CONFIG_BOOLEAN,
+        G_STRUCT_OFFSET (GuConfig, spelling) },
+    { "Preview", "autosync", CONFIG_BOOLEAN,
+        G_STRUCT_OFFSET (GuConfig, autosync) },
+    { "Preview", "cache_size", CONFIG_INTEGER,
+        G_STRUCT_OFFSET (GuConfig, cache_size) },
+    { "Preview", "animated_scroll", CONFIG_STRING,
+        G_STRUCT_OFFSET (GuConfig, animated_scroll) },
+    { "File", "autosaving", CONFIG_BOOLEAN,
+        G_STRUCT_OFFSET (GuConfig, autosaving) },
+    { "File", "autosave_timer", CONFIG_INTEGER,
+        G_STRUCT_OFFSET (GuConfig, autosave_timer) },
+    { "Compile", "typesetter", CONFIG_STRING,
+        G_STRUCT_OFFSET (GuConfig, typesetter) },
+    { "Compile", "synctex", CONFIG_BOOLEAN,
+        G_STRUCT_OFFSET (GuConfig, synctex) },
+};
+
+typedef struct {
+    guint id;
+    gchar* group;
+    gchar* key;
+    GuConfigNotify func;
+    gpointer user;
+} GuConfigListener;
+
+static GSList* listeners = NULL;
+static guint last_listener_id = 0;
+
+/* The values returned by config_get_string, "group.key" -> value. The
+ * values are interned so they stay valid after the setting is changed, the
+ * compile thread reads them while the main thread sets them. */
+static GHashTable* strings = NULL;
+G_LOCK_DEFINE_STATIC (strings);
+
+/* Guards key_file, which is only written on the main thread */
+G_LOCK_DEFINE_STATIC (key_file);
+
+/* The thread that loaded the config, the config_set functions called from
+ * other threads are deferred to it */
+static GThread* config_thread = NULL;
+
+/* A config_set call made off the main thread */
+typedef struct {
+    gchar* group;
+    gchar* key;
+    GuConfigType type;
+    gchar* string;
+    gint number;
+} GuConfigSet;
+
+static GKeyFile* config_get_defaults (void);
+static void config_cache_load (void);
+static void config_changed (const gchar* group, const gchar* key, gchar* old);
 
 void config_init () {
+    config_thread = g_thread_self ();
     conf_filepath = g_build_filename (C_GUMMI_CONFDIR, "gummi.ini", NULL);
 
     // create config & template dirs if not exists:
@@ -135,18 +207,44 @@ void config_init () {
     }
     g_free (text);
 
+    config_cache_load ();
+
     slog (L_INFO, "Configuration file: %s\n", conf_filepath);
 }
 
+/**
+ * Returns the value of group.key, an interned string that is never freed.
+ */
 const gchar* config_get_string (const gchar* group, const gchar* key) {
     g_autoptr(GError) error = NULL;
-    gchar* value;
-    
-    value = g_key_file_get_string (key_file, group, key, &error);
+    gchar* name = g_strdup_printf ("%s.%s", group, key);
+    const gchar* value;
+    gchar* text;
+
+    G_LOCK (strings);
+    if (!strings)
+        strings = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                         g_free, NULL);
+    value = g_hash_table_lookup (strings, name);
+    G_UNLOCK (strings);
+    if (value) {
+        g_free (name);
+        return value;
+    }
+
+    G_LOCK (key_file);
+    text = g_key_file_get_string (key_file, group, key, &error);
+    G_UNLOCK (key_file);
 
     if (error) {
+        g_free (name);
         return config_get_default_string (group, key);
     }
+    value = g_intern_string (text);
+    g_free (text);
+    G_LOCK (strings);
+    g_hash_table_replace (strings, name, (gpointer)value);
+    G_UNLOCK (strings);
     return value;
 }
 
@@ -154,7 +252,9 @@ const gboolean config_get_boolean (const gchar* group, const gchar* key) {
     g_autoptr(GError) error = NULL;
     gboolean value = FALSE;
 
+    G_LOCK (key_file);
     value = g_key_file_get_boolean (key_file, group, key, &error);
+    G_UNLOCK (key_file);
 
     if (error) {
         return config_get_default_boolean (group, key);
@@ -166,7 +266,9 @@ const gint config_get_integer (const gchar* group, const gchar* key) {
     g_autoptr(GError) error = NULL;
     gint value = FALSE;
 
+    G_LOCK (key_file);
     value = g_key_file_get_integer (key_file, group, key, &error);
+    G_UNLOCK (key_file);
 
     if (error) {
         return config_get_default_integer (group, key);
@@ -175,51 +277,37 @@ const gint config_get_integer (const gchar* group, const gchar* key) {
 }
 
 const gchar* config_get_default_string (const gchar* group, const gchar* key) {
-    g_autoptr(GKeyFile) default_keys = g_key_file_new ();
     gchar *default_value;
-
-    g_key_file_load_from_data (default_keys, 
-                               default_config, 
-                               strlen (default_config), 
-                               G_KEY_FILE_NONE, NULL);
+    const gchar* value;
 
     slog (L_WARNING, "Config get default value for '%s.%s'\n", group, key);
 
-    default_value = g_key_file_get_string (default_keys, group, key, NULL);
+    default_value = g_key_file_get_string (config_get_defaults (), group, key, NULL);
+    if (!default_value) return NULL;
+    value = g_intern_string (default_value);
     config_set_string (group, key, default_value);
+    g_free (default_value);
 
-    return default_value;
+    return value;
 }
 
 const gboolean config_get_default_boolean (const gchar* group, const gchar* key) {
-    g_autoptr(GKeyFile) default_keys = g_key_file_new ();
     gboolean default_value;
-    
-    g_key_file_load_from_data (default_keys, 
-                               default_config, 
-                               strlen (default_config), 
-                               G_KEY_FILE_NONE, NULL);
 
     slog (L_WARNING, "Config get default value for '%s.%s'\n", group, key);
     
-    default_value = g_key_file_get_boolean (default_keys, group, key, NULL);
+    default_value = g_key_file_get_boolean (config_get_defaults (), group, key, NULL);
     config_set_boolean (group, key, default_value);
     
     return default_value;
 }
 
 const gint config_get_default_integer (const gchar* group, const gchar* key) {
-    g_autoptr(GKeyFile) default_keys = g_key_file_new ();
     gint default_value;
 
-    g_key_file_load_from_data (default_keys,
-                               default_config,
-                               strlen (default_config),
-                               G_KEY_FILE_NONE, NULL);
-
     slog (L_WARNING, "Config get default value for '%s.%s'\n", group, key);
 
-    default_value = g_key_file_get_integer (default_keys, group, key, NULL);
+    default_value = g_key_file_get_integer (config_get_defaults (), group, key, NULL);
     config_set_integer (group, key, default_value);
 
     return default_value;
@@ -235,34 +323,231 @@ gboolean config_value_as_str_equals (const gchar* group, const gchar* key, gchar
     return FALSE;
 }
 
+static gboolean config_set_idle (gpointer user) {
+    GuConfigSet* set = user;
+
+    switch (set->type) {
+        case CONFIG_BOOLEAN:
+            config_set_boolean (set->group, set->key, set->number);
+            break;
+        case CONFIG_INTEGER:
+            config_set_integer (set->group, set->key, set->number);
+            break;
+        case CONFIG_STRING:
+            config_set_string (set->group, set->key, set->string);
+            break;
+    }
+    g_free (set->group);
+    g_free (set->key);
+    g_free (set->string);
+    g_free (set);
+    return FALSE;
+}
+
+/* Settings are only changed on the main thread, so that the listeners run
+ * there and no cached value is replaced under a reader. Returns TRUE if the
+ * call was queued to run there. */
+static gboolean config_set_deferred (GuConfigType type, const gchar* group,
+                                     const gchar* key, const gchar* string,
+                                     gint number) {
+    GuConfigSet* set;
+
+    if (g_thread_self () == config_thread) return FALSE;
+
+    set = g_new (GuConfigSet, 1);
+    set->group = g_strdup (group);
+    set->key = g_strdup (key);
+    set->type = type;
+    set->string = g_strdup (string);
+    set->number = number;
+    g_idle_add (config_set_idle, set);
+    return TRUE;
+}
+
 void config_set_string (const gchar *group, const gchar *key, gchar* value) {
+    gchar* old;
+
+    if (config_set_deferred (CONFIG_STRING, group, key, value, 0)) return;
+    G_LOCK (key_file);
+    old = g_key_file_get_value (key_file, group, key, NULL);
     g_key_file_set_string (key_file, group, key, value);
+    G_UNLOCK (key_file);
+    config_changed (group, key, old);
 }
 
 void config_set_boolean (const gchar *group, const gchar *key, gboolean value) {
+    gchar* old;
+
+    if (config_set_deferred (CONFIG_BOOLEAN, group, key, NULL, value)) return;
+    G_LOCK (key_file);
+    old = g_key_file_get_value (key_file, group, key, NULL);
     g_key_file_set_boolean (key_file, group, key, value);
+    G_UNLOCK (key_file);
+    config_changed (group, key, old);
 }
 
 void config_set_integer (const gchar *group, const gchar *key, gint value) {
+    gchar* old;
+
+    if (config_set_deferred (CONFIG_INTEGER, group, key, NULL, value)) return;
+    G_LOCK (key_file);
+    old = g_key_file_get_value (key_file, group, key, NULL);
     g_key_file_set_integer (key_file, group, key, value);
+    G_UNLOCK (key_file);
+    config_changed (group, key, old);
+}
+
+/**
+ * Calls func when group.key is changed, or every setting of group if key is
+ * NULL. Returns an id for config_disconnect.
+ */
+guint config_connect (const gchar* group, const gchar* key,
+                      GuConfigNotify func, gpointer user) {
+    GuConfigListener* listener = g_new0 (GuConfigListener, 1);
+
+    listener->id = ++last_listener_id;
+    listener->group = g_strdup (group);
+    listener->key = g_strdup (key);
+    listener->func = func;
+    listener->user = user;
+    listeners = g_slist_append (listeners, listener);
+    return listener->id;
+}
+
+void config_disconnect (guint id) {
+    GSList* node = NULL;
+
+    for (node = listeners; node; node = node->next) {
+        GuConfigListener* listener = node->data;
+        if (listener->id == id) {
+            listeners = g_slist_delete_link (listeners, node);
+            g_free (listener->group);
+            g_free (listener->key);
+            g_free (listener);
+            return;
+        }
+    }
+}
+
+/* Notifies the listeners of group.key, or all of them if group is NULL */
+static void config_notify (const gchar* group, const gchar* key) {
+    GSList* node = listeners;
+
+    while (node) {
+        GuConfigListener* listener = node->data;
+        node = node->next; /* the listener may disconnect itself */
+
+        if (group && listener->group &&
+            (!STR_EQU (listener->group, group) ||
+             (listener->key && !STR_EQU (listener->key, key))))
+            continue;
+        listener->func (group, key, listener->user);
+    }
+}
+
+static void config_cache_set (guint i) {
+    gpointer field = G_STRUCT_MEMBER_P (&config_cache, cached_keys[i].offset);
+    const gchar* group = cached_keys[i].group;
+    const gchar* key = cached_keys[i].key;
+
+    switch (cached_keys[i].type) {
+        case CONFIG_BOOLEAN:
+            *(gboolean*)field = config_get_boolean (group, key);
+            break;
+        case CONFIG_INTEGER:
+            *(gint*)field = config_get_integer (group, key);
+            break;
+        case CONFIG_STRING:
+            *(const gchar**)field = config_get_string (group, key);
+            break;
+    }
+}
+
+static void config_cache_load (void) {
+    guint i;
+
+    for (i = 0; i < G_N_ELEMENTS (cached_keys); ++i)
+        config_cache_set (i);
+}
+
+/* Updates the caches after group.key was set, old is its previous raw value
+ * and is freed */
+static void config_changed (const gchar* group, const gchar* key, gchar* old) {
+    gchar* value;
+    gboolean changed;
+    guint i;
+
+    G_LOCK (key_file);
+    value = g_key_file_get_value (key_file, group, key, NULL);
+    G_UNLOCK (key_file);
+    changed = !STR_EQU (old, value);
+
+    g_free (old);
+    g_free (value);
+    if (!changed) return;
+
+    if (strings) {
+        gchar* name = g_strdup_printf ("%s.%s", group, key);
+        G_LOCK (strings);
+        g_hash_table_remove (strings, name);
+        G_UNLOCK (strings);
+        g_free (name);
+    }
+    for (i = 0; i < G_N_ELEMENTS (cached_keys); ++i) {
+        if (STR_EQU (cached_keys[i].group, group) &&
+            STR_EQU (cached_keys[i].key, key)) {
+            config_cache_set (i);
+            break;
+        }
+    }
+    config_notify (group, key);
+}
+
+/* The built-in settings, parsed once by whichever thread first needs them */
+static GKeyFile* config_get_defaults (void) {
+    static GKeyFile* default_keys = NULL;
+
+    if (g_once_init_enter (&default_keys)) {
+        GKeyFile* keys = g_key_file_new ();
+        g_key_file_load_from_data (keys,
+                                   default_config,
+                                   strlen (default_config),
+                                   G_KEY_FILE_NONE, NULL);
+        g_once_init_leave (&default_keys, keys);
+    }
+    return default_keys;
 }
 
 void config_load_defaults () {
     g_autoptr(GError) error = NULL;
 
+    G_LOCK (key_file);
     g_key_file_load_from_data (key_file, default_config, strlen(default_config),
                                G_KEY_FILE_NONE, &error);
+    G_UNLOCK (key_file);
 
     if (error) {
         slog (L_ERROR, "Error loading default config: %s\n", error->message);
     }
+    if (strings) {
+        G_LOCK (strings);
+        g_hash_table_remove_all (strings);
+        G_UNLOCK (strings);
+    }
+    config_cache_load ();
+    config_notify (NULL, NULL);
     config_save ();
 }
 
 void config_save () {
     g_autoptr(GError) error = NULL;
 
-    if (!g_key_file_save_to_file (key_file, conf_filepath, &error)) {
+    gboolean saved;
+
+    G_LOCK (key_file);
+    saved = g_key_file_save_to_file (key_file, conf_filepath, &error);
+    G_UNLOCK (key_file);
+    if (!saved) {
         if (error) {
             slog (L_ERROR, "Error saving config: %s\n", error->message);
         }
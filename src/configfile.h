@@ -32,6 +32,28 @@
 
 #include <glib.h>
 
+/* Typed copies of the settings read on hot paths (key presses, scrolling,
+ * drawing). They are loaded by config_init and kept in sync by the
+ * config_set functions on the main thread, read them directly but never
+ * write them. The strings are interned and never freed. */
+typedef struct _GuConfig {
+    gboolean snippets;          /* Interface.snippets */
+    gboolean spelling;          /* Editor.spelling */
+    gboolean autosync;          /* Preview.autosync */
+    gint cache_size;            /* Preview.cache_size, in MB */
+    const gchar* animated_scroll; /* Preview.animated_scroll */
+    gboolean autosaving;        /* File.autosaving */
+    gint autosave_timer;        /* File.autosave_timer */
+    const gchar* typesetter;    /* Compile.typesetter */
+    gboolean synctex;           /* Compile.synctex */
+} GuConfig;
+
+extern GuConfig config_cache;
+
+/* Called after group.key was set to a different value, or after all of
+ * the settings were reset (group and key are NULL then). */
+typedef void (*GuConfigNotify) (const gchar* group, const gchar* key,
+                                gpointer user);
 
 void config_init ();
 void config_load_defaults ();
@@ -52,6 +74,11 @@ void config_set_string  (const gchar *group, const gchar *key, gchar* value);
 void config_set_boolean (const gchar *group, const gchar *key, gboolean value);
 void config_set_integer (const gchar *group, const gchar *key, gint value);
 
+// change notifications:
+guint config_connect (const gchar* group, const gchar* key,
+                      GuConfigNotify func, gpointer user);
+void config_disconnect (guint id);
+
 // comparison functions:
 gboolean config_value_as_str_equals (const gchar* group, const gchar* key, gchar* input);
 
@@ -49,6 +49,11 @@ static void on_inserted_text(GtkTextBuffer *textbuffer,GtkTextIter *location,
                              gchar *text,gint len, gpointer user_data);
 static void on_delete_range(GtkTextBuffer *textbuffer,GtkTextIter *start,
                              GtkTextIter *end, gpointer user_data);
+static void editor_searchtag_range (GuEditor* ec, GtkTextIter* start,
+                                    GtkTextIter* end);
+
+/* Number of lines highlighted by each idle call after a search */
+#define SEARCH_CHUNK_LINES 2000
 
 const gchar style[][3][20] = {
     { "tool_bold", "\\textbf{", "}" },
@@ -69,7 +74,7 @@ GuEditor* editor_new (GuMotion* mc) {
     ec->basename = NULL;   /* use this to form .dvi/.ps/.log etc. files */
     ec->pdffile = NULL;
     ec->workfile = NULL;
-    ec->bibfile = NULL;
+    ec->bibfiles = NULL;
     ec->projfile = NULL;
 
     GtkSourceLanguageManager* manager = gtk_source_language_manager_new ();
@@ -102,7 +107,7 @@ GuEditor* editor_new (GuMotion* mc) {
     gtk_source_view_set_auto_indent
         (ec->view, config_get_boolean ("Editor", "autoindentation"));
 
-    if (config_get_boolean ("Editor", "spelling"))
+    if (config_cache.spelling)
         editor_activate_spellchecking (ec, TRUE);
 
     editor_sourceview_config (ec);
@@ -138,6 +143,13 @@ void editor_destroy (GuEditor* ec) {
         }
     }
 
+    if (ec->searchidle) g_source_remove (ec->searchidle);
+    search_pattern_free (ec->searchpattern);
+    if (ec->loading) {
+        g_cancellable_cancel (ec->loading);
+        g_object_unref (ec->loading);
+    }
+
     editor_fileinfo_cleanup (ec);
     g_free(ec);
 }
@@ -152,6 +164,13 @@ static void on_inserted_text(GtkTextBuffer *textbuffer,GtkTextIter *location,
 
     e->last_edit = *location;
     e->sync_to_last_edit = TRUE;
+
+    /* Keep the search highlighting of the edited lines current */
+    if (e->searchpattern) {
+        GtkTextIter start = *location, end = *location;
+        gtk_text_iter_backward_chars (&start, g_utf8_strlen (text, len));
+        editor_searchtag_range (e, &start, &end);
+    }
 }
 
 static void on_delete_range(GtkTextBuffer *textbuffer,GtkTextIter *start,
@@ -164,6 +183,11 @@ static void on_delete_range(GtkTextBuffer *textbuffer,GtkTextIter *start,
 
     e->last_edit = *start;
     e->sync_to_last_edit = TRUE;
+
+    if (e->searchpattern) {
+        GtkTextIter rstart = *start, rend = *start;
+        editor_searchtag_range (e, &rstart, &rend);
+    }
 }
 
 /* FileInfo:
@@ -241,16 +265,36 @@ void editor_fileinfo_update (GuEditor* ec, const gchar* filename) {
     }
 }
 
-gboolean editor_fileinfo_update_biblio (GuEditor* ec,  const gchar* filename) {
-    g_free (ec->bibfile);
+gboolean editor_fileinfo_update_biblio (GuEditor* ec, gchar** filenames) {
+    GPtrArray* bibfiles = g_ptr_array_new ();
+    gchar* dirname = ec->filename? g_path_get_dirname (ec->filename): NULL;
+    gchar* bibfile = NULL;
+    gint i;
+
+    g_strfreev (ec->bibfiles);
+
+    /* Only the resources that exist are kept, each of them once */
+    for (i = 0; filenames[i]; ++i) {
+        gboolean duplicate = FALSE;
+        guint j;
+
+        if (dirname && !g_path_is_absolute (filenames[i]))
+            bibfile = g_build_filename (dirname, filenames[i], NULL);
+        else
+            bibfile = g_strdup (filenames[i]);
+
+        for (j = 0; j < bibfiles->len; ++j)
+            duplicate |= STR_EQU (bibfile, g_ptr_array_index (bibfiles, j));
+        if (duplicate || !utils_path_exists (bibfile))
+            g_free (bibfile);
+        else
+            g_ptr_array_add (bibfiles, bibfile);
+    }
+    g_ptr_array_add (bibfiles, NULL);
+    ec->bibfiles = (gchar**)g_ptr_array_free (bibfiles, FALSE);
 
-    if (ec->filename && !g_path_is_absolute (filename)) {
-        gchar* dirname = g_path_get_dirname (ec->filename);
-        ec->bibfile = g_build_filename (dirname, filename, NULL);
-        g_free (dirname);
-    } else
-        ec->bibfile = g_strdup (filename);
-    return utils_path_exists (ec->bibfile);
+    g_free (dirname);
+    return ec->bibfiles[0] != NULL;
 }
 
 void editor_fileinfo_cleanup (GuEditor* ec) {
@@ -300,12 +344,14 @@ void editor_fileinfo_cleanup (GuEditor* ec) {
     g_free (ec->workfile);
     g_free (ec->pdffile);
     g_free (ec->basename);
+    g_strfreev (ec->bibfiles);
 
     ec->fdname = NULL;
     ec->filename = NULL;
     ec->workfile = NULL;
     ec->pdffile = NULL;
     ec->basename = NULL;
+    ec->bibfiles = NULL;
 }
 
 void editor_sourceview_config (GuEditor* ec) {
@@ -373,6 +419,51 @@ void editor_fill_buffer (GuEditor* ec, const gchar* text) {
     ec->sync_to_last_edit = FALSE;
 }
 
+/* Filling the buffer in several steps, e.g. while a large file is loaded:
+ * the view is read-only, the handlers tracking edits are blocked and the
+ * syntax is highlighted once the whole text is in. Beginning again before
+ * the end starts over with an empty buffer. */
+void editor_fill_begin (GuEditor* ec) {
+    gint i;
+
+    if (ec->filling) {
+        gtk_text_buffer_set_text (ec_buffer, "", 0);
+        return;
+    }
+    ec->filling = TRUE;
+    for (i = 2; i < 5; ++i)
+        g_signal_handler_block (ec->buffer, ec->sigid[i]);
+    gtk_source_buffer_begin_not_undoable_action (ec->buffer);
+    gtk_source_buffer_set_highlight_syntax (ec->buffer, FALSE);
+    gtk_text_view_set_editable (ec_view, FALSE);
+    gtk_text_buffer_set_text (ec_buffer, "", 0);
+}
+
+void editor_fill_append (GuEditor* ec, const gchar* text, gint len) {
+    GtkTextIter end;
+
+    gtk_text_buffer_get_end_iter (ec_buffer, &end);
+    gtk_text_buffer_insert (ec_buffer, &end, text, len);
+}
+
+void editor_fill_end (GuEditor* ec) {
+    GtkTextIter start;
+    gint i;
+
+    if (!ec->filling) return;
+    ec->filling = FALSE;
+    gtk_text_view_set_editable (ec_view, TRUE);
+    gtk_source_buffer_set_highlight_syntax (ec->buffer, TRUE);
+    gtk_source_buffer_end_not_undoable_action (ec->buffer);
+    for (i = 2; i < 5; ++i)
+        g_signal_handler_unblock (ec->buffer, ec->sigid[i]);
+
+    gtk_text_buffer_get_start_iter (ec_buffer, &start);
+    gtk_text_buffer_place_cursor (ec_buffer, &start);
+    gtk_text_buffer_set_modified (ec_buffer, FALSE);
+    ec->sync_to_last_edit = FALSE;
+}
+
 gchar* editor_grab_buffer (GuEditor* ec) {
     GtkTextIter start, end;
     gtk_text_buffer_get_bounds (ec_buffer, &start, &end);
@@ -413,15 +504,19 @@ void editor_insert_package (GuEditor* ec, const gchar* package, const gchar* opt
     g_free (pkgstr);
 }
 
+/* Declares the bibliography before \end{document}, unless the document
+ * declares one already or has no \end{document}, e.g. a chapter file */
 void editor_insert_bib (GuEditor* ec, const gchar* package) {
     GtkTextIter start, end, mstart, mend, sstart, send;
     gchar* pkgstr = g_strdup_printf (
             "\\bibliography{%s}{}\n\\bibliographystyle{plain}\n", package);
     gtk_text_buffer_get_start_iter (ec_buffer, &start);
     gtk_text_buffer_get_end_iter (ec_buffer, &end);
-    gtk_text_iter_backward_search (&end, (gchar*)"\\end{document}", 0,
-            &mstart, &mend, NULL);
-    if (!gtk_text_iter_forward_search (&start, "\\bibliography{", 0,
+    if (gtk_text_iter_backward_search (&end, (gchar*)"\\end{document}", 0,
+                &mstart, &mend, NULL) &&
+        !gtk_text_iter_forward_search (&start, "\\bibliography{", 0,
+                &sstart, &send, NULL) &&
+        !gtk_text_iter_forward_search (&start, "\\addbibresource", 0,
                 &sstart, &send, NULL)) {
         gtk_source_buffer_begin_not_undoable_action (ec->buffer);
         gtk_text_buffer_begin_user_action (ec_buffer);
@@ -528,7 +623,8 @@ void editor_jumpto_search_result (GuEditor* ec, gint direction) {
 }
 
 void editor_start_search (GuEditor* ec, const gchar* term,
-        gboolean backwards, gboolean wholeword, gboolean matchcase) {
+        gboolean backwards, gboolean wholeword, gboolean matchcase,
+        gboolean regex) {
     /* save options */
     if (ec->term != term) {
         g_free (ec->term);
@@ -538,69 +634,196 @@ void editor_start_search (GuEditor* ec, const gchar* term,
     ec->backwards = backwards;
     ec->wholeword = wholeword;
     ec->matchcase = matchcase;
+    ec->regex = regex;
 
     editor_apply_searchtag (ec);
     editor_search_next (ec, FALSE);
 }
 
+/* Highlights the matches of the search on the lines from start to end,
+ * from the buffer's text with a single scan. The offsets of the matches are
+ * converted to characters as the scan goes. */
+static void editor_searchtag_range (GuEditor* ec, GtkTextIter* start,
+                                    GtkTextIter* end) {
+    GtkTextIter mstart, mend;
+    gchar* text = NULL;
+    gsize length = 0, offset = 0, bstart = 0, bend = 0;
+
+    gtk_text_iter_set_line_offset (start, 0);
+    if (!gtk_text_iter_ends_line (end))
+        gtk_text_iter_forward_to_line_end (end);
+    gtk_text_buffer_remove_tag (ec_buffer, ec->searchtag, start, end);
+
+    text = gtk_text_buffer_get_slice (ec_buffer, start, end, TRUE);
+    length = strlen (text);
+    mend = *start;
+
+    while (search_pattern_find (ec->searchpattern, text, length, offset,
+                                &bstart, &bend)) {
+        /* empty matches of a regular expression are not highlighted */
+        if (bstart == bend) {
+            mstart = mend;
+            gtk_text_iter_forward_chars (&mstart,
+                    g_utf8_pointer_to_offset (text + offset, text + bstart));
+            mend = mstart;
+            offset = bstart;
+            if (offset == length) break;
+            gtk_text_iter_forward_char (&mend);
+            offset = g_utf8_next_char (text + offset) - text;
+            continue;
+        }
+        mstart = mend;
+        gtk_text_iter_forward_chars (&mstart,
+                g_utf8_pointer_to_offset (text + offset, text + bstart));
+        mend = mstart;
+        gtk_text_iter_forward_chars (&mend,
+                g_utf8_pointer_to_offset (text + bstart, text + bend));
+        gtk_text_buffer_apply_tag (ec_buffer, ec->searchtag, &mstart, &mend);
+        offset = bend;
+    }
+    g_free (text);
+}
+
+static gboolean editor_searchtag_idle (gpointer user) {
+    GuEditor* ec = GU_EDITOR (user);
+    GtkTextIter start, end;
+
+    gtk_text_buffer_get_iter_at_mark (ec_buffer, &start, ec->searchmark);
+    end = start;
+    gtk_text_iter_forward_lines (&end, SEARCH_CHUNK_LINES);
+    editor_searchtag_range (ec, &start, &end);
+
+    if (gtk_text_iter_is_end (&end)) {
+        ec->searchidle = 0;
+        return FALSE;
+    }
+    gtk_text_buffer_move_mark (ec_buffer, ec->searchmark, &end);
+    return TRUE;
+}
+
 void editor_apply_searchtag (GuEditor* ec) {
-    GtkTextIter start, mstart, mend;
-    gboolean ret = FALSE;
+    GtkTextIter start, end;
+    GdkRectangle rect;
+    GError* err = NULL;
+
+    search_pattern_free (ec->searchpattern);
+    ec->searchpattern = search_pattern_new (ec->term, ec->matchcase,
+                                            ec->wholeword, ec->regex, &err);
+
+    if (!gtk_text_tag_table_lookup (ec->editortags, "search"))
+        gtk_text_tag_table_add (ec->editortags, ec->searchtag);
+    gtk_text_buffer_get_bounds (ec_buffer, &start, &end);
+    gtk_text_buffer_remove_tag (ec_buffer, ec->searchtag, &start, &end);
+
+    if (!ec->searchpattern) {
+        if (ec->searchidle) g_source_remove (ec->searchidle);
+        ec->searchidle = 0;
+        slog (L_G_ERROR, _("Invalid regular expression: %s\n"),
+              err->message);
+        g_error_free (err);
+        return;
+    }
+
+    /* The visible lines are highlighted right away, the whole buffer in
+     * chunks when idle. Edits keep the highlighting up to date. */
+    gtk_text_view_get_visible_rect (ec_view, &rect);
+    gtk_text_view_get_line_at_y (ec_view, &start, rect.y, NULL);
+    gtk_text_view_get_line_at_y (ec_view, &end, rect.y + rect.height, NULL);
+    gtk_text_iter_forward_line (&end);
+    editor_searchtag_range (ec, &start, &end);
 
     gtk_text_buffer_get_start_iter (ec_buffer, &start);
+    if (!ec->searchmark)
+        ec->searchmark = gtk_text_buffer_create_mark (ec_buffer, NULL,
+                                                      &start, TRUE);
+    else
+        gtk_text_buffer_move_mark (ec_buffer, ec->searchmark, &start);
+    if (!ec->searchidle)
+        ec->searchidle = g_idle_add_full (G_PRIORITY_LOW,
+                                          editor_searchtag_idle, ec, NULL);
+}
 
-    if (gtk_text_tag_table_lookup (ec->editortags, "search"))
-        gtk_text_tag_table_remove (ec->editortags, ec->searchtag);
-    gtk_text_tag_table_add (ec->editortags, ec->searchtag);
+/* Byte offset in text, the whole buffer, of the iter */
+static gsize editor_iter_to_byte (const gchar* text, GtkTextIter* iter) {
+    return g_utf8_offset_to_pointer (text, gtk_text_iter_get_offset (iter))
+           - text;
+}
 
-    while (TRUE) {
-		do {
-			ret = gtk_text_iter_forward_search (&start, ec->term,
-	                (ec->matchcase? 0: GTK_TEXT_SEARCH_CASE_INSENSITIVE),
-	                &mstart, &mend, NULL);
-			start = mend;
-		} while (ec->wholeword && ret && (!gtk_text_iter_starts_word(&mstart) ||
-				!gtk_text_iter_ends_word(&mend)));
+/* Selects the match in text, the whole buffer, from bstart to bend */
+static void editor_select_match (GuEditor* ec, const gchar* text,
+                                 gsize bstart, gsize bend) {
+    GtkTextIter mstart, mend;
+
+    gtk_text_buffer_get_iter_at_offset (ec_buffer, &mstart,
+            g_utf8_pointer_to_offset (text, text + bstart));
+    mend = mstart;
+    gtk_text_iter_forward_chars (&mend,
+            g_utf8_pointer_to_offset (text + bstart, text + bend));
+    gtk_text_buffer_select_range (ec_buffer, &mstart, &mend);
+}
 
-        if (ret) {
-            gtk_text_buffer_apply_tag (ec_buffer, ec->searchtag,
-                    &mstart, &mend);
-//            start =  mend;
-        } else break;
+/* Finds the first match of the search from the byte offset from, or the
+ * last one which starts before it */
+static gboolean editor_search_text (GuEditor* ec, const gchar* text,
+                                    gsize length, gsize from,
+                                    gboolean backwards,
+                                    gsize* mstart, gsize* mend) {
+    gsize offset = 0, start = 0, end = 0;
+    gboolean ret = FALSE;
+
+    if (!backwards)
+        return search_pattern_find (ec->searchpattern, text, length, from,
+                                    mstart, mend);
+
+    while (search_pattern_find (ec->searchpattern, text, length, offset,
+                                &start, &end) && start < from) {
+        *mstart = start;
+        *mend = end;
+        ret = TRUE;
+        offset = (end > start)? end: g_utf8_next_char (text + start) - text;
     }
+    return ret;
 }
 
 void editor_search_next (GuEditor* ec, gboolean inverse) {
-    GtkTextIter current, start, end, mstart, mend;
+    GtkTextIter start, end, sstart, send;
+    gboolean backwards = ec->backwards ^ inverse;
     gboolean ret = FALSE, response = FALSE;
+    gchar* text = NULL;
+    gsize length = 0, from = 0, bstart = 0, bend = 0;
 
-    editor_get_current_iter (ec, &current);
-	
-	do {
-	    if (ec->backwards ^ inverse) {
-	        ret = gtk_text_iter_backward_search (&current, ec->term,
-	                (ec->matchcase? 0: GTK_TEXT_SEARCH_CASE_INSENSITIVE),
-	                &mstart, &mend, NULL);
-	    } else {
-	        gtk_text_iter_forward_chars (&current, strlen (ec->term));
-	        ret = gtk_text_iter_forward_search (&current, ec->term,
-	                (ec->matchcase? 0: GTK_TEXT_SEARCH_CASE_INSENSITIVE),
-	                &mstart, &mend, NULL);
-		}
-		current = mend;
-	} while (ec->wholeword && ret && (!gtk_text_iter_starts_word(&mstart) ||
-			!gtk_text_iter_ends_word(&mend)));
+    if (!ec->searchpattern) return;
+
+    gtk_text_buffer_get_bounds (ec_buffer, &start, &end);
+    gtk_text_buffer_get_selection_bounds (ec_buffer, &sstart, &send);
+    text = gtk_text_buffer_get_slice (ec_buffer, &start, &end, TRUE);
+    length = strlen (text);
+
+    if (backwards) {
+        from = editor_iter_to_byte (text, &sstart);
+        ret = editor_search_text (ec, text, length, from, TRUE,
+                                  &bstart, &bend);
+    } else {
+        from = editor_iter_to_byte (text, &send);
+        ret = editor_search_text (ec, text, length, from, FALSE,
+                                  &bstart, &bend);
+        /* don't stay on an empty match at the cursor */
+        if (ret && bstart == from && bend == from && from < length) {
+            from = g_utf8_next_char (text + from) - text;
+            ret = editor_search_text (ec, text, length, from, FALSE,
+                                      &bstart, &bend);
+        }
+    }
 
     if (ret) {
-        gtk_text_buffer_select_range (ec_buffer, &mstart, &mend);
+        editor_select_match (ec, text, bstart, bend);
         editor_scroll_to_cursor (ec);
     }
-    /* check if the top/bottom is reached */
-    gtk_text_buffer_get_start_iter (ec_buffer, &start);
-    gtk_text_buffer_get_end_iter (ec_buffer, &end);
+    g_free (text);
 
+    /* check if the top/bottom is reached */
     if (!ret) {
-        if (ec->backwards ^ inverse) {
+        if (backwards) {
             response = utils_yes_no_dialog (
                     _("Top reached, search from bottom?"));
             if (GTK_RESPONSE_YES == response) {
@@ -618,71 +841,192 @@ void editor_search_next (GuEditor* ec, gboolean inverse) {
     }
 }
 
+/* Applies edits, with character offsets in order, as a single user action
+ * so that they are one undo step. The span from the first to the last edit
+ * is replaced at once by its text with the edits made, so the buffer emits
+ * one deletion and one insertion for all of them, which is what the undo
+ * manager, the spell checker and the highlighter see. The handlers of the
+ * buffer are blocked meanwhile and run once. */
+static void editor_apply_edits (GuEditor* ec, GArray* edits) {
+    GuSearchEdit* first = NULL;
+    GuSearchEdit* last = NULL;
+    GtkTextIter start, end;
+    GString* replaced = NULL;
+    gchar* span = NULL;
+    const gchar* p = NULL;
+    gsize offset = 0;
+    guint i;
+
+    if (edits->len == 0) return;
+
+    first = &g_array_index (edits, GuSearchEdit, 0);
+    last = &g_array_index (edits, GuSearchEdit, edits->len - 1);
+    gtk_text_buffer_get_iter_at_offset (ec_buffer, &start, first->start);
+    gtk_text_buffer_get_iter_at_offset (ec_buffer, &end, last->end);
+
+    /* the text between the edits is copied over as is */
+    span = gtk_text_buffer_get_slice (ec_buffer, &start, &end, TRUE);
+    replaced = g_string_sized_new (strlen (span));
+    p = span;
+    offset = first->start;
+    for (i = 0; i < edits->len; ++i) {
+        GuSearchEdit* edit = &g_array_index (edits, GuSearchEdit, i);
+        const gchar* mstart = g_utf8_offset_to_pointer (p,
+                edit->start - offset);
+
+        g_string_append_len (replaced, p, mstart - p);
+        g_string_append (replaced, edit->text);
+        p = g_utf8_offset_to_pointer (mstart, edit->end - edit->start);
+        offset = edit->end;
+    }
+
+    for (i = 2; i < 5; ++i)
+        g_signal_handler_block (ec->buffer, ec->sigid[i]);
+
+    gtk_text_buffer_begin_user_action (ec_buffer);
+    if (last->end > first->start)
+        gtk_text_buffer_delete (ec_buffer, &start, &end);
+    gtk_text_buffer_insert (ec_buffer, &start, replaced->str, replaced->len);
+    gtk_text_buffer_end_user_action (ec_buffer);
+
+    for (i = 2; i < 5; ++i)
+        g_signal_handler_unblock (ec->buffer, ec->sigid[i]);
+
+    /* start is at the end of the last replacement now */
+    ec->last_edit = start;
+    ec->sync_to_last_edit = TRUE;
+    if (ec->searchpattern) {
+        gtk_text_buffer_get_iter_at_offset (ec_buffer, &end, first->start);
+        editor_searchtag_range (ec, &end, &start);
+    }
+    g_string_free (replaced, TRUE);
+    g_free (span);
+
+    /* one compile for all of them, of the document being previewed */
+    if (ec == g_active_editor) check_preview_timer ();
+}
+
+static gboolean editor_check_replacement (GuSearchPattern* pattern,
+                                          const gchar* rterm) {
+    GError* err = NULL;
+
+    if (!search_pattern_check_replacement (pattern, rterm, &err)) {
+        slog (L_G_ERROR, _("Invalid replacement: %s\n"), err->message);
+        g_error_free (err);
+        return FALSE;
+    }
+    return TRUE;
+}
+
 void editor_start_replace_next (GuEditor* ec, const gchar* term,
         const gchar* rterm, gboolean backwards, gboolean wholeword,
-        gboolean matchcase) {
-    GtkTextIter current, mstart, mend;
-    gboolean ret = FALSE;
+        gboolean matchcase, gboolean regex) {
+    GtkTextIter start, end, sstart, send;
+    gchar* text = NULL;
+    gsize length = 0, from = 0, bstart = 0, bend = 0;
 
     if (!ec->replace_activated) {
         ec->replace_activated = TRUE;
-        editor_start_search (ec, term, backwards, wholeword, matchcase);
+        editor_start_search (ec, term, backwards, wholeword, matchcase, regex);
         return;
     }
+    if (!ec->searchpattern || !editor_check_replacement (ec->searchpattern,
+                                                         rterm))
+        return;
 
-    /* place cursor to the next result */
-    editor_get_current_iter (ec, &current);
-
-    if (backwards)
-       ret = gtk_text_iter_backward_search (&current, term,
-                (matchcase? 0: GTK_TEXT_SEARCH_CASE_INSENSITIVE),
-                &mstart, &mend, NULL);
-    else
-       ret = gtk_text_iter_forward_search (&current, term,
-                (matchcase? 0: GTK_TEXT_SEARCH_CASE_INSENSITIVE),
-                &mstart, &mend, NULL);
-
-    if (ret && (!wholeword || (wholeword
-            && gtk_text_iter_starts_word (&mstart)
-            && gtk_text_iter_ends_word (&mend)))) {
-        gtk_text_buffer_begin_user_action (ec_buffer);
-        gtk_text_buffer_delete (ec_buffer, &mstart, &mend);
-        gtk_text_buffer_insert (ec_buffer, &mstart, rterm, -1);
-        gtk_text_buffer_end_user_action (ec_buffer);
-        editor_search_next (ec, FALSE);
+    /* replace the selected match, with the references to its groups
+     * expanded, then go to the next one */
+    gtk_text_buffer_get_bounds (ec_buffer, &start, &end);
+    gtk_text_buffer_get_selection_bounds (ec_buffer, &sstart, &send);
+    text = gtk_text_buffer_get_slice (ec_buffer, &start, &end, TRUE);
+    length = strlen (text);
+    from = editor_iter_to_byte (text, &sstart);
+
+    if (search_pattern_find (ec->searchpattern, text, length, from,
+                             &bstart, &bend) && bstart == from
+            && bend == editor_iter_to_byte (text, &send)) {
+        GuSearchEdit edit = { gtk_text_iter_get_offset (&sstart),
+                              gtk_text_iter_get_offset (&send), NULL };
+        GArray* edits = g_array_new (FALSE, FALSE, sizeof (GuSearchEdit));
+
+        edit.text = search_pattern_expand (ec->searchpattern, text, length,
+                                           bstart, rterm);
+        g_array_append_val (edits, edit);
+        editor_apply_edits (ec, edits);
+        g_free (edit.text);
+        g_array_unref (edits);
     }
-    return;
+    g_free (text);
+    editor_search_next (ec, FALSE);
 }
 
-void editor_start_replace_all (GuEditor* ec, const gchar* term,
+/**
+ * Replaces every match in the buffer and returns their number, or -1 if
+ * term or rterm are invalid. The replacements are computed from a single
+ * scan of the text, then applied to the buffer as one transaction.
+ */
+gint editor_start_replace_all (GuEditor* ec, const gchar* term,
         const gchar* rterm, gboolean backwards, gboolean wholeword,
-        gboolean matchcase) {
-    GtkTextIter start, mstart, mend;
-    gboolean ret = FALSE;
-    gboolean action_started = FALSE;
+        gboolean matchcase, gboolean regex) {
+    GuSearchPattern* pattern = NULL;
+    GtkTextIter start, end, current;
+    GArray* edits = NULL;
+    GError* err = NULL;
+    gchar* text = NULL;
+    gsize byte = 0, chars = 0, mstart = 0;
+    gint cursor = 0, moved = 0, count = 0;
+    guint i;
+
+    if (!(pattern = search_pattern_new (term, matchcase, wholeword, regex,
+                                        &err))) {
+        slog (L_G_ERROR, _("Invalid regular expression: %s\n"),
+              err->message);
+        g_error_free (err);
+        return -1;
+    }
+    if (!editor_check_replacement (pattern, rterm)) {
+        search_pattern_free (pattern);
+        return -1;
+    }
 
-    gtk_text_buffer_get_start_iter (ec_buffer, &start);
+    gtk_text_buffer_get_bounds (ec_buffer, &start, &end);
+    text = gtk_text_buffer_get_slice (ec_buffer, &start, &end, TRUE);
+    edits = search_pattern_replace_edits (pattern, text, strlen (text),
+                                          rterm);
+    search_pattern_free (pattern);
 
-    while (TRUE) {
-        ret = gtk_text_iter_forward_search (&start, term,
-                (matchcase? 0: GTK_TEXT_SEARCH_CASE_INSENSITIVE),
-                &mstart, &mend, NULL);
-
-        if (ret && (!wholeword || (wholeword
-                && gtk_text_iter_starts_word (&mstart)
-                && gtk_text_iter_ends_word (&mend)))) {
-            if (!action_started) {
-                gtk_text_buffer_begin_user_action (ec_buffer);
-                action_started = TRUE;
-            }
-            gtk_text_buffer_delete (ec_buffer, &mstart, &mend);
-            gtk_text_buffer_insert (ec_buffer, &mstart, rterm, -1);
-            start =  mstart;
-        } else break;
+    editor_get_current_iter (ec, &current);
+    moved = cursor = gtk_text_iter_get_offset (&current);
+
+    /* The edits are converted to characters in a single pass, and the
+     * cursor is kept where it was in the text */
+    for (i = 0; i < edits->len; ++i) {
+        GuSearchEdit* edit = &g_array_index (edits, GuSearchEdit, i);
+
+        mstart = chars + g_utf8_pointer_to_offset (text + byte,
+                                                   text + edit->start);
+        chars = mstart + g_utf8_pointer_to_offset (text + edit->start,
+                                                   text + edit->end);
+        byte = edit->end;
+        edit->start = mstart;
+        edit->end = chars;
+
+        if ((gint)edit->end <= cursor)
+            moved += g_utf8_strlen (edit->text, -1)
+                     - (gint)(edit->end - edit->start);
+        else if ((gint)edit->start < cursor)
+            moved = edit->start + (moved - cursor);
     }
-    if (action_started) {
-        gtk_text_buffer_end_user_action (ec_buffer);
+
+    editor_apply_edits (ec, edits);
+    if (edits->len > 0) {
+        gtk_text_buffer_get_iter_at_offset (ec_buffer, &current, moved);
+        gtk_text_buffer_place_cursor (ec_buffer, &current);
     }
+    count = edits->len;
+    g_array_unref (edits);
+    g_free (text);
+    return count;
 }
 
 void editor_get_current_iter (GuEditor* ec, GtkTextIter* current) {
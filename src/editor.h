@@ -33,6 +33,7 @@
 
 #include "motion.h"
 #include "completion.h"
+#include "search.h"
 
 #include <glib.h>
 #include <gtk/gtk.h>
@@ -52,9 +53,11 @@ struct _GuEditor {
     gchar* basename;
     gchar* pdffile;
     gchar* workfile;
-    gchar* bibfile;
+    gchar** bibfiles;      /* bibliography resources, NULL terminated */
     gchar* projfile;
     time_t last_modtime;
+    GCancellable* loading;  /* set while the file is read into the buffer */
+    gboolean filling;       /* between editor_fill_begin and editor_fill_end */
 
     /* GUI related members */
     GtkSourceView* view;
@@ -71,6 +74,10 @@ struct _GuEditor {
     gboolean backwards;
     gboolean wholeword;
     gboolean matchcase;
+    gboolean regex;
+    GuSearchPattern* searchpattern;
+    GtkTextMark* searchmark;    /* where the idle search highlighting is */
+    guint searchidle;
     gint sigid[5];
 
     GtkTextIter last_edit;
@@ -80,11 +87,14 @@ struct _GuEditor {
 GuEditor* editor_new (GuMotion* mc);
 void editor_fileinfo_update (GuEditor* ec, const gchar* filename);
 void editor_fileinfo_cleanup (GuEditor* ec);
-gboolean editor_fileinfo_update_biblio (GuEditor* ec,  const gchar* filename);
+gboolean editor_fileinfo_update_biblio (GuEditor* ec, gchar** filenames);
 void editor_destroy (GuEditor* ec);
 void editor_sourceview_config (GuEditor* ec);
 void editor_activate_spellchecking (GuEditor* ec, gboolean status);
 void editor_fill_buffer (GuEditor* ec, const gchar* text);
+void editor_fill_begin (GuEditor* ec);
+void editor_fill_append (GuEditor* ec, const gchar* text, gint len);
+void editor_fill_end (GuEditor* ec);
 
 /* editor_grab_buffer will return a newly allocated string */
 gchar* editor_grab_buffer (GuEditor* ec);
@@ -94,15 +104,15 @@ void editor_set_selection_textstyle (GuEditor* ec, const gchar* type);
 void editor_apply_errortags (GuEditor* ec, gint* lines);
 void editor_jumpto_search_result (GuEditor* ec, gint direction);
 void editor_start_search (GuEditor* ec, const gchar* term, gboolean backwards,
-        gboolean wholeword, gboolean matchcase);
+        gboolean wholeword, gboolean matchcase, gboolean regex);
 void editor_apply_searchtag (GuEditor* ec);
 void editor_search_next (GuEditor* ec, gboolean inverse);
 void editor_start_replace_next (GuEditor* ec, const gchar* term,
         const gchar* rterm, gboolean backwards, gboolean wholeword,
-        gboolean matchcase);
-void editor_start_replace_all (GuEditor* ec, const gchar* term,
+        gboolean matchcase, gboolean regex);
+gint editor_start_replace_all (GuEditor* ec, const gchar* term,
         const gchar* rterm, gboolean backwards, gboolean wholeword,
-        gboolean matchcase);
+        gboolean matchcase, gboolean regex);
 void editor_get_current_iter (GuEditor* ec, GtkTextIter* current);
 void editor_scroll_to_cursor (GuEditor* ec);
 void editor_scroll_to_line (GuEditor* ec, gint line);
@@ -29,19 +29,68 @@
 
 #include "external.h"
 
+#include <string.h>
+#include <glib/gstdio.h>
+
 #include "constants.h"
 #include "utils.h"
 
+/* A detected program, the version output is cached on disk by path and
+ * modification time of the binary */
+typedef struct {
+    gchar* program;
+    gchar* path;        /* NULL if not found in PATH */
+    gint64 mtime;
+    gchar* output;      /* output of `program --version`, or NULL */
+} ExternalTool;
+
+typedef struct {
+    ExternalTool** tools;
+    guint n;
+    GKeyFile* cache;
+    gboolean dirty;     /* the cache needs to be written back */
+    GMutex lock;
+} ExternalDetectJob;
+
 /* local functions */
-static gchar* get_version_output (const gchar* command, int linenr);
+static gchar* external_get_output (const gchar* program);
 static gchar* version_latexmk (gchar* output);
 static gchar* version_rubber (gchar* output);
 
 
 static gdouble get_texlive_version (void);
 
+/* The detection results, program -> ExternalTool */
+static GHashTable* tools = NULL;
+G_LOCK_DEFINE_STATIC (tools);
+
+
+static void external_tool_free (ExternalTool* tool) {
+    if (!tool) return;
+    g_free (tool->program);
+    g_free (tool->path);
+    g_free (tool->output);
+    g_free (tool);
+}
+
+/* Returns TRUE and sets found if program was detected already */
+static gboolean external_lookup (const gchar* program, ExternalTool** found) {
+    gboolean detected = FALSE;
+
+    G_LOCK (tools);
+    if (tools)
+        detected = g_hash_table_lookup_extended (tools, program, NULL,
+                                                 (gpointer*)found);
+    G_UNLOCK (tools);
+    return detected;
+}
 
 gboolean external_exists (const gchar* program) {
+    ExternalTool* tool = NULL;
+
+    if (external_lookup (program, &tool))
+        return tool->path != NULL;
+
     gchar *fullpath = g_find_program_in_path (program);
     if (fullpath == NULL) return FALSE;
 
@@ -54,21 +103,153 @@ gboolean external_hasflag (const gchar* program, const gchar* flag) {
     return TRUE;
 }
 
-static gchar* get_version_output (const gchar* command, int linenr) {
-    const gchar* getversion = g_strdup_printf("%s --version", command);
-    Tuple2 cmdgetv = utils_popen_r (getversion, NULL);
-    gchar* output = (gchar*)cmdgetv.second;
-    gchar* result = g_strdup ("Unknown");
+static gchar* external_run_version (const gchar* path) {
+    gchar* argv[] = { (gchar*)path, "--version", NULL };
+    gchar* output = NULL;
 
-    if (output == NULL) {
-        slog (L_ERROR, "Error detecting version for %s. "
-                       "Please report a bug\n", command);
-        return result;
+    if (!g_spawn_sync (NULL, argv, NULL, G_SPAWN_STDERR_TO_DEV_NULL,
+                       NULL, NULL, &output, NULL, NULL, NULL))
+        return NULL;
+    return output;
+}
+
+static gchar* external_cache_filename (void) {
+    return g_build_filename (g_get_user_cache_dir (), "gummi",
+                             "externals.ini", NULL);
+}
+
+static void external_detect_worker (gpointer data, gpointer user) {
+    ExternalDetectJob* job = user;
+    ExternalTool* tool = job->tools[GPOINTER_TO_UINT (data) - 1];
+    GStatBuf attr;
+    gboolean cached = FALSE;
+
+    tool->path = g_find_program_in_path (tool->program);
+    if (!tool->path || g_stat (tool->path, &attr) != 0) {
+        g_free (tool->path);
+        tool->path = NULL;
+        return;
     }
+    tool->mtime = attr.st_mtime;
 
-    gchar** splitted = g_strsplit(output, "\n", BUFSIZ);
-    result = splitted[linenr];
-    return result;
+    g_mutex_lock (&job->lock);
+    if (g_key_file_get_int64 (job->cache, tool->path, "mtime", NULL)
+            == tool->mtime) {
+        tool->output = g_key_file_get_string (job->cache, tool->path,
+                                              "version", NULL);
+        cached = tool->output != NULL;
+    }
+    g_mutex_unlock (&job->lock);
+    if (cached) return;
+
+    tool->output = external_run_version (tool->path);
+    if (!tool->output) return;
+
+    g_mutex_lock (&job->lock);
+    g_key_file_set_int64 (job->cache, tool->path, "mtime", tool->mtime);
+    g_key_file_set_string (job->cache, tool->path, "version", tool->output);
+    job->dirty = TRUE;
+    g_mutex_unlock (&job->lock);
+}
+
+/* Runs the version checks of all programs at once, each one is a process
+ * spawn that can take a while for the TeX binaries */
+static void external_detect_thread (GTask* task, gpointer source,
+                                    gpointer data,
+                                    GCancellable* cancellable) {
+    ExternalDetectJob* job = data;
+    gchar* filename = external_cache_filename ();
+    GThreadPool* pool = NULL;
+    guint i;
+
+    job->cache = g_key_file_new ();
+    g_key_file_load_from_file (job->cache, filename, G_KEY_FILE_NONE, NULL);
+
+    pool = g_thread_pool_new (external_detect_worker, job, job->n, FALSE,
+                              NULL);
+    for (i = 0; i < job->n; ++i)
+        g_thread_pool_push (pool, GUINT_TO_POINTER (i + 1), NULL);
+    g_thread_pool_free (pool, FALSE, TRUE);
+
+    if (job->dirty) {
+        gchar* dirname = g_path_get_dirname (filename);
+        GError* err = NULL;
+
+        g_mkdir_with_parents (dirname, DIR_PERMS);
+        if (!g_key_file_save_to_file (job->cache, filename, &err)) {
+            slog (L_WARNING, "Can't save %s: %s\n", filename, err->message);
+            g_error_free (err);
+        }
+        g_free (dirname);
+    }
+    g_free (filename);
+    g_task_return_boolean (task, TRUE);
+}
+
+static void external_detect_job_free (ExternalDetectJob* job) {
+    guint i;
+
+    for (i = 0; i < job->n; ++i)
+        external_tool_free (job->tools[i]);
+    g_free (job->tools);
+    if (job->cache) g_key_file_free (job->cache);
+    g_mutex_clear (&job->lock);
+    g_free (job);
+}
+
+/**
+ * Looks up programs in PATH and gets their versions in the background.
+ * Once finished, external_exists and external_version answer from the
+ * results without spawning anything.
+ */
+void external_detect_async (const gchar* const* programs,
+                            GAsyncReadyCallback callback, gpointer user) {
+    GTask* task = g_task_new (NULL, NULL, callback, user);
+    ExternalDetectJob* job = g_new0 (ExternalDetectJob, 1);
+    guint i;
+
+    job->n = g_strv_length ((gchar**)programs);
+    job->tools = g_new0 (ExternalTool*, job->n);
+    for (i = 0; i < job->n; ++i) {
+        job->tools[i] = g_new0 (ExternalTool, 1);
+        job->tools[i]->program = g_strdup (programs[i]);
+    }
+    g_mutex_init (&job->lock);
+    g_task_set_task_data (task, job, (GDestroyNotify)external_detect_job_free);
+    g_task_run_in_thread (task, external_detect_thread);
+    g_object_unref (task);
+}
+
+gboolean external_detect_finish (GAsyncResult* result, GError** err) {
+    ExternalDetectJob* job = g_task_get_task_data (G_TASK (result));
+    guint i;
+
+    G_LOCK (tools);
+    if (!tools)
+        tools = g_hash_table_new_full (g_str_hash, g_str_equal, NULL,
+                                       (GDestroyNotify)external_tool_free);
+    for (i = 0; i < job->n; ++i) {
+        g_hash_table_replace (tools, job->tools[i]->program, job->tools[i]);
+        job->tools[i] = NULL;
+    }
+    G_UNLOCK (tools);
+    return g_task_propagate_boolean (G_TASK (result), err);
+}
+
+/* Returns the output of `program --version`, from the detection results if
+ * there are some */
+static gchar* external_get_output (const gchar* program) {
+    ExternalTool* tool = NULL;
+    gchar* version_cmd = NULL;
+    Tuple2 cmdgetv;
+
+    if (external_lookup (program, &tool))
+        return g_strdup (tool->output);
+
+    version_cmd = g_strdup_printf ("%s --version", program);
+    cmdgetv = utils_popen_r (version_cmd, NULL);
+    g_free (version_cmd);
+    return (gchar*)cmdgetv.second;
 }
 
 gdouble external_version2 (ExternalProg program) {
@@ -83,11 +264,10 @@ gchar* external_version (const gchar* program) {
     gchar* version_output;
     gchar* result;
 
-    const gchar* version_cmd = g_strdup_printf("%s --version", program);
-    Tuple2 cmdgetv = utils_popen_r (version_cmd, NULL);
-    version_output = (gchar*)cmdgetv.second;
+    version_output = external_get_output (program);
 
     if (version_output == NULL || g_str_equal (version_output, "")) {
+        g_free (version_output);
         return g_strdup_printf("Unknown, please report a bug");
     }
     else {
@@ -101,10 +281,12 @@ gchar* external_version (const gchar* program) {
        This is LuaTeX, Version 1.10.0 (TeX Live 2019/Debian)
     */
     if (STR_EQU (program, C_RUBBER)) {
-        result = version_rubber (result);
+        result = version_rubber (version_output);
+        g_free (version_output);
     }
     else if (STR_EQU (program, C_LATEXMK)) {
-        result = version_latexmk (result);
+        result = version_latexmk (version_output);
+        g_free (version_output);
     }
 
     return result;
@@ -112,7 +294,16 @@ gchar* external_version (const gchar* program) {
 
 static gdouble get_texlive_version (void) {
     gdouble version = 0;
-    gchar* output = get_version_output (C_LATEX, 0);
+    gchar* output = external_get_output (C_LATEX);
+    gchar* segment = NULL;
+    GString* digits = NULL;
+
+    if (output == NULL) {
+        slog (L_ERROR, "Error detecting version for %s. "
+                       "Please report a bug\n", C_LATEX);
+        return version;
+    }
+    output[strcspn (output, "\n")] = 0;
 
     /* Keep in mind that some distros like themselves a lot:
      * pdfTeX 3.1415926-1.40.11-2.2 (TeX Live 2010)
@@ -125,29 +316,27 @@ static gdouble get_texlive_version (void) {
 
     if ((!utils_subinstr ("TeX Live", output, FALSE)) &&
         (!utils_subinstr ("Web2C", output, FALSE))) {
+        g_free (output);
         return version;
     }
 
-    gchar** splitted = g_strsplit (output, "(", BUFSIZ);
-    guint size = g_strv_length (splitted);
-
-    gchar* segment = g_strdup (splitted[size-1]);
-    segment = g_strjoinv("", g_strsplit(segment, "Web2C", -1));
-    gchar* resultstr = "";
+    segment = strrchr (output, '(');
+    segment = segment? segment + 1: output;
 
     // make sure to only allow numeric characters in the result:
-    int n;
-    for (n=0;n<g_utf8_strlen(segment, -1);n++) {
-        if (g_ascii_isdigit (segment[n])) {
-           gchar* addchar = g_strdup_printf("%c", segment[n]);
-           resultstr = g_strconcat (resultstr, addchar, NULL);
-        }
+    digits = g_string_new (NULL);
+    for (; *segment; ++segment) {
+        if (g_str_has_prefix (segment, "Web2C"))
+            segment += strlen ("Web2C") - 1;
+        else if (g_ascii_isdigit (*segment))
+            g_string_append_c (digits, *segment);
     }
 
-    version = g_ascii_strtod (resultstr, NULL);
+    version = g_ascii_strtod (digits->str, NULL);
+    g_string_free (digits, TRUE);
+    g_free (output);
     return version;
 }
-
 static gchar* version_rubber (gchar* output) {
     // format: Rubber version: 1.1
     gchar** outarr = g_strsplit (output, " ", BUFSIZ);
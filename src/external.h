@@ -31,6 +31,7 @@
 #define __GUMMI_EXTERNAL_H__
 
 #include <glib.h>
+#include <gio/gio.h>
 
 typedef struct {
     gboolean exists;
@@ -51,6 +52,10 @@ typedef enum _ExternalProg {
 gboolean external_exists (const gchar* program);
 gboolean external_hasflag (const gchar* program, const gchar* flag);
 
+void external_detect_async (const gchar* const* programs,
+                            GAsyncReadyCallback callback, gpointer user);
+gboolean external_detect_finish (GAsyncResult* result, GError** err);
+
 gchar* external_version (const gchar* program);
 gdouble external_version2 (ExternalProg program);
 
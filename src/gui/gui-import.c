@@ -219,7 +219,9 @@ void on_import_biblio_apply_clicked (GtkWidget* widget, void* user) {
         if (g_active_editor->filename)
             root_path = g_path_get_dirname (g_active_editor->filename);
         relative_path = utils_path_to_relative (root_path, filename);
-        editor_insert_bib (g_active_editor, relative_path);
+        /* Unless the project declares a bibliography in another file */
+        if (!biblio_detect_bibliography (g_active_editor))
+            editor_insert_bib (g_active_editor, relative_path);
         basename = g_path_get_basename (filename);
         gtk_label_set_text (gummi->biblio->filenm_label, basename);
         g_free (relative_path);
@@ -47,6 +47,7 @@
 #include "editor.h"
 #include "environment.h"
 #include "importer.h"
+#include "stats.h"
 #include "utils.h"
 #include "template.h"
 
@@ -203,10 +204,10 @@ GummiGui* gui_init (GtkBuilder* builder) {
     hpaned= GTK_WIDGET (gtk_builder_get_object (builder, "hpaned"));
     gtk_paned_set_position (GTK_PANED (hpaned), (width/2));
 
-    if (config_get_boolean ("Editor", "spelling"))
+    if (config_cache.spelling)
         gtk_check_menu_item_set_active (g->menu_spelling, TRUE);
 
-    if (config_get_boolean ("Interface", "snippets")) {
+    if (config_cache.snippets) {
         gtk_check_menu_item_set_active (g->menu_snippets, TRUE);
         gtk_widget_show (GTK_WIDGET (g->menu_snippets));
     }
@@ -239,12 +240,6 @@ GummiGui* gui_init (GtkBuilder* builder) {
     g->menu_autosync =
         GTK_CHECK_MENU_ITEM (gtk_builder_get_object (builder, "menu_autosync"));
 
-    if (latex_can_synctex() && config_get_boolean ("Compile", "synctex")) {
-        gtk_widget_set_sensitive (GTK_WIDGET (g->menu_autosync), TRUE);
-        gboolean async = latex_use_synctex();
-        gtk_check_menu_item_set_active (g->menu_autosync, (async? TRUE: FALSE));
-    }
-
     g->recent_list[0] = g_strdup (config_get_string ("Misc", "recent1"));
     g->recent_list[1] = g_strdup (config_get_string ("Misc", "recent2"));
     g->recent_list[2] = g_strdup (config_get_string ("Misc", "recent3"));
@@ -333,11 +328,18 @@ void gui_set_window_title (const gchar* filename, const gchar* text) {
     g_free (title);
 }
 
+/* The recovered text isn't in the file yet */
+static void on_recovery_loaded (GuEditor* ec, gpointer user) {
+    gtk_text_buffer_set_modified (GTK_TEXT_BUFFER (ec->buffer), TRUE);
+}
+
 void on_recovery_infobar_response (GtkInfoBar* bar, gint res, gpointer filename) {
     gchar* prev_workfile = iofunctions_get_swapfile (filename);
 
     if (res == GTK_RESPONSE_YES) {
         tabmanager_set_content (A_LOAD_OPT, filename, prev_workfile);
+        iofunctions_when_loaded (g_active_editor, on_recovery_loaded,
+                                 NULL, NULL);
     }
     else { // NO
         tabmanager_set_content (A_LOAD, filename, NULL);
@@ -391,6 +393,12 @@ void gui_save_file (GuTabContext* tab, gboolean saveas) {
     gchar* prev = NULL;
     gint ret = 0;
 
+    // a buffer still being filled would overwrite the file half loaded
+    if (tab->editor->loading) {
+        statusbar_set_message (_("The document is still being loaded"));
+        return;
+    }
+
     if (saveas || !(filename = tab->editor->filename)) {
         if ((filename = get_save_filename (TYPE_LATEX))) {
             new = TRUE;
@@ -410,18 +418,23 @@ void gui_save_file (GuTabContext* tab, gboolean saveas) {
     gchar *text;
     GtkWidget* focus = NULL;
 
-    // check whether the file has been changed by (some) external program
+    // check whether the file has been changed by (some) external program,
+    // the modtime is reset only once a previous save has been written
     double lastmod;
     struct stat attr;
     stat(filename, &attr);
     lastmod = difftime (tab->editor->last_modtime, attr.st_mtime);
 
-    if (lastmod != 0.0 && tab->editor->last_modtime != 0.0 ) {
+    if (lastmod != 0.0 && tab->editor->last_modtime != 0.0
+            && !iofunctions_is_saving (filename)) {
         // ask the user whether he want to save or reload
         ret = utils_save_reload_dialog (
                 _("The content of the file has been changed externally. "
                   "Saving will remove any external modifications."));
         if (ret == GTK_RESPONSE_YES) {
+            // the file is loaded into the active tab
+            tabmanagergui_set_current_page (
+                    g_list_index (gummi_get_all_tabs (), tab));
             tabmanager_set_content (A_LOAD, filename, NULL);
             // resets modtime
             stat(filename, &attr);
@@ -448,10 +461,6 @@ void gui_save_file (GuTabContext* tab, gboolean saveas) {
     gui_set_filename_display (tab, TRUE, TRUE);
     gtk_widget_grab_focus (GTK_WIDGET (tab->editor->view));
 
-    // Resets modtime
-    stat(filename, &attr);
-    tab->editor->last_modtime = attr.st_mtime;
-
 cleanup:
     if (new) g_free (filename);
     g_free (pdfname);
@@ -466,7 +475,8 @@ void gui_set_hastabs_sensitive (gboolean enable) {
 
 G_MODULE_EXPORT
 void on_menu_bibupdate_activate (GtkWidget *widget, void * user) {
-    biblio_compile_bibliography (gummi->biblio, g_active_editor);
+    biblio_result_free (biblio_compile_bibliography (gummi->biblio,
+                                                     g_active_editor));
 }
 
 G_MODULE_EXPORT
@@ -587,56 +597,90 @@ G_MODULE_EXPORT
 void on_button_biblio_compile_clicked (GtkWidget* widget, void* user) {
     gummi->biblio->progressval = 0.0;
 
+    GuBibResult* result = NULL;
+    GuBibMessage* error = NULL;
+    gchar* message = NULL;
+    guint i;
+
     gtk_widget_set_sensitive (widget, FALSE);
     g_timeout_add (10, on_bibprogressbar_update, widget);
 
-    if (biblio_compile_bibliography (gummi->biblio, g_active_editor)) {
-        statusbar_set_message (_("Compiling bibliography file.."));
-        // NOTE gtk3s bar doesn't place text inside the widget anymore :/
-        //gtk_progress_bar_set_text (gummi->biblio->progressbar,
-        //        _("Bibliography compiled without errors"));
-        motion_force_compile (gummi->motion);
-    } else {
-        statusbar_set_message
-        (_("Error compiling bibliography file or none detected.."));
-        // NOTE gtk3s bar doesn't place text inside the widget anymore :/
-        //gtk_progress_bar_set_text (gummi->biblio->progressbar,
-        //        _("Error compiling bibliography file"));
+    result = biblio_compile_bibliography (gummi->biblio, g_active_editor);
+    switch (result->status) {
+        case BIBLIO_COMPILE_SKIPPED:
+            statusbar_set_message (_("Bibliography is up to date.."));
+            break;
+        case BIBLIO_COMPILE_SUCCESS:
+            statusbar_set_message (_("Compiling bibliography file.."));
+            // NOTE gtk3s bar doesn't place text inside the widget anymore :/
+            //gtk_progress_bar_set_text (gummi->biblio->progressbar,
+            //        _("Bibliography compiled without errors"));
+            motion_force_compile (gummi->motion);
+            break;
+        case BIBLIO_COMPILE_FAILED:
+            for (i = 0; i < result->messages->len && !error; ++i) {
+                GuBibMessage* m = g_ptr_array_index (result->messages, i);
+                if (!m->warning) error = m;
+            }
+            if (error && error->file) {
+                message = g_strdup_printf ("%s: %s:%d: %s", result->backend,
+                                           error->file, error->line,
+                                           error->text);
+            } else if (error) {
+                message = g_strdup_printf ("%s: %s", result->backend,
+                                           error->text);
+            }
+            statusbar_set_message (message? message:
+                _("Error compiling bibliography file or none detected.."));
+            g_free (message);
+            break;
     }
+    biblio_result_free (result);
 }
 
-G_MODULE_EXPORT
-void on_button_biblio_detect_clicked (GtkWidget* widget, void* user) {
-    gchar* text = 0;
-    gchar* str = 0;
-    gchar* basename = 0;
+/* user is the basenames of the parsed files, the active tab may have
+ * changed or been closed by the time they are parsed */
+static void on_biblio_parsed (GObject* source, GAsyncResult* result,
+                              gpointer user) {
+    GuBibList* list = NULL;
     GError* err = NULL;
-    gint number = 0;
+    gchar* str = 0;
+    gchar* basename = user;
 
+    if (!(list = biblio_parse_files_finish (result, &err))) {
+        if (!g_error_matches (err, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+            slog (L_G_ERROR, "g_file_get_contents (): %s\n", err->message);
+        g_error_free (err);
+        g_free (basename);
+        return;
+    }
+
+    biblio_set_entries (gummi->biblio, list);
+    gtk_widget_set_sensitive (GTK_WIDGET(gummi->biblio->list_filter), TRUE);
+
+    gtk_label_set_text (gummi->biblio->filenm_label, basename);
+    str = g_strdup_printf ("%u", list->entries->len);
+    gtk_label_set_text (gummi->biblio->refnr_label, str);
+    g_free (str);
+    // NOTE gtk3s bar doesn't place text inside the widget anymore :/
+    //gtk_progress_bar_set_text (gummi->biblio->progressbar, str);
+    g_free (basename);
+    biblio_list_free (list);
+}
+
+G_MODULE_EXPORT
+void on_button_biblio_detect_clicked (GtkWidget* widget, void* user) {
     gummi->biblio->progressval = 0.0;
     g_timeout_add (2, on_bibprogressbar_update, widget);
     gtk_list_store_clear (gummi->biblio->list_biblios);
 
+    /* A resource found is declared in the document or another file of its
+     * project already, so nothing is inserted */
     if (biblio_detect_bibliography (g_active_editor)) {
-        editor_insert_bib (g_active_editor, g_active_editor->bibfile);
-        if (!g_file_get_contents(g_active_editor->bibfile, &text, NULL, &err)) {
-            slog (L_G_ERROR, "g_file_get_contents (): %s\n", err->message);
-            g_error_free (err);
-            return;
-        }
-
-        gtk_widget_set_sensitive
-                    (GTK_WIDGET(gummi->biblio->list_filter), TRUE);
-
-        number = biblio_parse_entries (gummi->biblio, text);
-        basename = g_path_get_basename (g_active_editor->bibfile);
-        gtk_label_set_text (gummi->biblio->filenm_label, basename);
-        str = g_strdup_printf ("%d", number);
-        gtk_label_set_text (gummi->biblio->refnr_label, str);
-        g_free (str);
-        // NOTE gtk3s bar doesn't place text inside the widget anymore :/
-        //gtk_progress_bar_set_text (gummi->biblio->progressbar, str);
-        g_free (basename);
+        /* Parsed on worker threads, the list is swapped in once done */
+        biblio_parse_files_async (gummi->biblio, g_active_editor->bibfiles,
+                on_biblio_parsed,
+                biblio_get_basenames (g_active_editor->bibfiles));
     }
     else {
         gtk_widget_set_sensitive
@@ -667,39 +711,19 @@ void on_bibreference_clicked (GtkTreeView* view, GtkTreePath* Path,
     g_free (out);
 }
 
-static gboolean visible_func (GtkTreeModel *model, GtkTreeIter  *iter, gpointer data) {
-    gboolean row_visible = FALSE;
-    gchar* title;
-    gchar* author;
-    gchar* year;
-
-    /* make all entries visible again when filter buffer is empty */
-    if (strlen(data) == 0) return TRUE;
-
-    gtk_tree_model_get (model, iter, 1, &title, 2, &author, 3, &year, -1);
-    if (utils_subinstr (data, title , TRUE)) row_visible = TRUE;
-    if (utils_subinstr (data, author , TRUE)) row_visible = TRUE;
-    if (utils_subinstr (data, year , TRUE)) row_visible = TRUE;
-
-    g_free(title);
-    g_free(author);
-    g_free(year);
-
-    return row_visible;
-}
-
 G_MODULE_EXPORT
 void on_biblio_filter_changed (GtkWidget* widget, void* user) {
-    GtkTreeModel *filter;
+    biblio_filter (gummi->biblio, gtk_entry_get_text (GTK_ENTRY (widget)));
+}
 
-    const gchar *entry = gtk_entry_get_text(GTK_ENTRY(widget));
-    filter = gtk_tree_model_filter_new (
-            GTK_TREE_MODEL(gummi->biblio->list_biblios),NULL);
-    gtk_tree_model_filter_set_visible_func(
-            GTK_TREE_MODEL_FILTER(filter), visible_func, (gpointer)entry, NULL);
-    gtk_tree_view_set_model (
-            GTK_TREE_VIEW( gummi->biblio->biblio_treeview ),filter);
-    g_object_unref (G_OBJECT(filter));
+/* Called once the installed typesetters are known */
+void gui_update_synctex (void) {
+    if (latex_can_synctex() && config_cache.synctex) {
+        gtk_widget_set_sensitive (GTK_WIDGET (gui->menu_autosync), TRUE);
+        gboolean async = latex_use_synctex();
+        gtk_check_menu_item_set_active (gui->menu_autosync,
+                                        (async? TRUE: FALSE));
+    }
 }
 
 void typesetter_setup (void) {
@@ -710,7 +734,7 @@ void typesetter_setup (void) {
     gtk_widget_set_sensitive (GTK_WIDGET (gui->prefsgui->opt_shellescape),
                               status);
 
-    if (config_get_boolean ("Compile", "synctex")) {
+    if (config_cache.synctex) {
         gtk_toggle_button_set_active (gui->prefsgui->opt_synctex, TRUE);
     }
     else {
@@ -719,7 +743,7 @@ void typesetter_setup (void) {
     gtk_widget_set_sensitive (GTK_WIDGET (gui->prefsgui->opt_synctex), TRUE);
 
     slog (L_INFO, "Typesetter %s configured\n",
-                   config_get_string ("Compile", "typesetter"));
+                   config_cache.typesetter);
 }
 
 gboolean on_bibprogressbar_update (void* data) {
@@ -999,6 +1023,7 @@ void check_preview_timer (void) {
 
     gtk_text_buffer_set_modified (g_e_buffer, TRUE);
     gummi->latex->modified_since_compile = TRUE;
+    stats_mark_edit ();
 
     gui_set_filename_display (g_active_tab, TRUE, TRUE);
 
@@ -164,6 +164,7 @@ void statusbar_set_message (const gchar* message);
 gboolean statusbar_del_message (void* user);
 
 void typesetter_setup (void);
+void gui_update_synctex (void);
 
 void check_preview_timer (void);
 
@@ -38,6 +38,7 @@
 
 #include "gui-main.h"
 #include "gui-preview.h"
+#include "gui-stats.h"
 
 
 extern Gummi* gummi;
@@ -147,18 +148,13 @@ void on_menu_recent_activate (GtkWidget *widget, void *user) {
     display_recent_files (gui);
 }
 
-G_MODULE_EXPORT
-void on_menu_close_activate (GtkWidget *widget, void* user) {
-    GuTabContext* tab = NULL;
-
-    tab = (user)? GU_TAB_CONTEXT (user): g_active_tab;
-
-    gint ret = check_for_save (tab->editor);
+/* Closes the tab once its file is written, unless the write failed */
+static void close_tab_when_saved (const gchar* filename, gboolean saved,
+                                  gpointer user) {
+    GuTabContext* tab = GU_TAB_CONTEXT (user);
 
-    if (GTK_RESPONSE_YES == ret)
-        gui_save_file (tab, FALSE);
-    else if (GTK_RESPONSE_CANCEL == ret || GTK_RESPONSE_DELETE_EVENT == ret)
-        return;
+    // the tab may have been closed in the meantime
+    if (!saved || !g_list_find (gummi_get_all_tabs (), tab)) return;
 
     // kill typesetter thread
     motion_kill_typesetter(gummi->motion);
@@ -174,6 +170,23 @@ void on_menu_close_activate (GtkWidget *widget, void* user) {
     }
 }
 
+G_MODULE_EXPORT
+void on_menu_close_activate (GtkWidget *widget, void* user) {
+    GuTabContext* tab = NULL;
+
+    tab = (user)? GU_TAB_CONTEXT (user): g_active_tab;
+
+    gint ret = check_for_save (tab->editor);
+
+    if (GTK_RESPONSE_YES == ret)
+        gui_save_file (tab, FALSE);
+    else if (GTK_RESPONSE_CANCEL == ret || GTK_RESPONSE_DELETE_EVENT == ret)
+        return;
+
+    iofunctions_wait_for_save (tab->editor->filename, close_tab_when_saved,
+                               tab);
+}
+
 G_MODULE_EXPORT
 gboolean on_menu_quit_activate (void) {
     gint length = g_list_length (gummi->tabmanager->tabs);
@@ -192,6 +205,12 @@ gboolean on_menu_quit_activate (void) {
             return TRUE;
     }
 
+    // don't quit if a file couldn't be written, its tab is modified again
+    if (!iofunctions_wait_for_saves ()) {
+        motion_resume_compile_thread (gummi->motion);
+        return TRUE;
+    }
+
     // stop compile thread
     if (length > 0) motion_stop_compile_thread (gummi->motion);
 
@@ -510,6 +529,11 @@ cleanup:
     g_free (output);
 }
 
+G_MODULE_EXPORT
+void on_menu_perfstats_activate (GtkWidget *widget, void *user) {
+    statsgui_show (gui->mainwindow);
+}
+
 G_MODULE_EXPORT
 void on_menu_spelling_toggled (GtkWidget *widget, void *user) {
     GList *editors;
@@ -242,14 +242,14 @@ static void set_tab_editor_settings (GuPrefsGui* prefs) {
     gtk_spin_button_set_value (prefs->tabwidth,
                                config_get_integer ("Editor", "tabwidth"));
     gtk_spin_button_set_value (prefs->autosave_timer,
-                               config_get_integer ("File", "autosave_timer"));
+                               config_cache.autosave_timer);
     gtk_toggle_button_set_active (GTK_TOGGLE_BUTTON (prefs->autosaving),
-                                  config_get_boolean ("File", "autosaving"));
+                                  config_cache.autosaving);
     gtk_toggle_button_set_active (GTK_TOGGLE_BUTTON (prefs->interactive_completion),
                                   config_get_boolean ("Editor", "interactive_completion"));
     gtk_spin_button_set_value (prefs->minchar,
                                config_get_integer ("Editor", "minchar"));
-    if (!config_get_boolean ("File", "autosaving"))
+    if (!config_cache.autosaving)
         gtk_widget_set_sensitive (GTK_WIDGET (prefs->autosave_timer), FALSE);
 }
 
@@ -338,7 +338,7 @@ static void set_tab_compilation_settings (GuPrefsGui* prefs) {
     }
 
     if (latex_can_synctex()) {
-        if (config_get_boolean ("Compile", "synctex")) {
+        if (config_cache.synctex) {
             gtk_toggle_button_set_active (prefs->opt_synctex, TRUE);
         }
         else {
@@ -386,16 +386,16 @@ static void set_tab_preview_settings (GuPrefsGui* prefs) {
     }
 
     // animated scroll:
-    if (config_value_as_str_equals ("Preview", "animated_scroll", "always")) {
+    if (STR_EQU (config_cache.animated_scroll, "always")) {
         gtk_combo_box_set_active (prefs->combo_animated_scroll, 0);
-    } else if (config_value_as_str_equals ("Preview", "animated_scroll", "never")) {
+    } else if (STR_EQU (config_cache.animated_scroll, "never")) {
         gtk_combo_box_set_active (prefs->combo_animated_scroll, 2);
     } else {
         gtk_combo_box_set_active (prefs->combo_animated_scroll, 1);
     }
 
     gtk_spin_button_set_value (prefs->spin_cache_size,
-                               config_get_integer ("Preview", "cache_size"));
+                               config_cache.cache_size);
 }
 
 static void set_tab_miscellaneous_settings (GuPrefsGui* prefs) {
@@ -585,7 +585,7 @@ void toggle_autosaving (GtkWidget* widget, void* user) {
         gtk_widget_set_sensitive (
                 GTK_WIDGET (gui->prefsgui->autosave_timer), TRUE);
         gtk_spin_button_set_value (gui->prefsgui->autosave_timer,
-                                   config_get_integer ("File", "autosave_timer"));
+                                   config_cache.autosave_timer);
         iofunctions_reset_autosave (g_active_editor->filename);
     } else {
         gtk_widget_set_sensitive (
@@ -677,8 +677,6 @@ G_MODULE_EXPORT
 void on_cache_size_value_changed (GtkWidget* widget, void* user) {
     gint newval = gtk_spin_button_get_value (GTK_SPIN_BUTTON (widget));
     config_set_integer ("Preview", "cache_size", newval);
-
-    g_idle_add((GSourceFunc) run_garbage_collector, gui->previewgui);
 }
 
 G_MODULE_EXPORT
@@ -790,7 +788,7 @@ void on_combo_language_changed (GtkComboBoxText* widget, void* user) {
     GList* tab = gummi->tabmanager->tabs;
     config_set_string ("Editor", "spelling_lang", selected);
 
-    if (config_get_boolean ("Editor", "spelling")) {
+    if (config_cache.spelling) {
         while (tab) {
             editor_activate_spellchecking (GU_TAB_CONTEXT (tab->data)->editor,
                                            FALSE);
@@ -50,6 +50,7 @@
 #include "constants.h"
 #include "environment.h"
 #include "motion.h"
+#include "stats.h"
 #include "gui/gui-main.h"
 
 #ifdef HAVE_CONFIG_H
@@ -155,6 +156,8 @@ static gboolean layered_rectangle_intersect (const LayeredRectangle *src1,
                                              LayeredRectangle *dest);
 
 static void previewgui_set_scale (GuPreviewGui* pc, gdouble scale, gdouble x, gdouble y);
+static void on_cache_size_changed (const gchar* group, const gchar* key,
+                                   gpointer user);
 
 ////////////////////////////////////////////////////////////////////////////////
 
@@ -272,6 +275,8 @@ GuPreviewGui* previewgui_init (GtkBuilder * builder) {
         gtk_toggle_tool_button_set_active (p->preview_pause, TRUE);
     }
 
+    config_connect ("Preview", "cache_size", on_cache_size_changed, p);
+
     slog (L_INFO, "Using libpoppler %s\n", poppler_get_version ());
     return p;
 }
@@ -561,6 +566,7 @@ gboolean on_document_compiled (gpointer data) {
                         editor->sync_to_last_edit ?
                         &(editor->last_edit) : NULL, editor->workfile);
             }
+            stats_mark_preview ();
             if (pc->errormode) previewgui_stop_errormode (pc);
         }
     }
@@ -905,6 +911,7 @@ static void previewgui_set_scale(GuPreviewGui* pc, gdouble scale, gdouble x,
 
 static void load_document(GuPreviewGui* pc, gboolean update) {
     //L_F_DEBUG;
+    gint64 start = stats_start ();
 
     previewgui_invalidate_renderings(pc);
     g_free(pc->pages);
@@ -927,6 +934,7 @@ static void load_document(GuPreviewGui* pc, gboolean update) {
 
     update_page_sizes(pc);
     update_prev_next_page(pc);
+    stats_end (STATS_LOAD_DOCUMENT, start);
 }
 
 void previewgui_set_pdffile (GuPreviewGui* pc, const gchar *uri) {
@@ -1024,6 +1032,8 @@ void previewgui_set_pdffile (GuPreviewGui* pc, const gchar *uri) {
 
 void previewgui_refresh (GuPreviewGui* pc, GtkTextIter *sync_to, gchar* tex_file) {
     //L_F_DEBUG;
+    gint64 start = stats_start ();
+
     // We lock the mutex to prevent previewing incomplete PDF file, i.e
     // compiling. Also prevent PDF from changing (compiling) when previewing */
     if (!g_mutex_trylock (&gummi->motion->compile_mutex)) return;
@@ -1047,8 +1057,8 @@ void previewgui_refresh (GuPreviewGui* pc, GtkTextIter *sync_to, gchar* tex_file
     load_document(pc, TRUE);
     update_page_positions(pc);
 
-    if (config_get_boolean ("Compile", "synctex") &&
-        config_get_boolean ("Preview", "autosync") &&
+    if (config_cache.synctex &&
+        config_cache.autosync &&
         synctex_run_parser(pc, sync_to, tex_file)) {
 
         SyncNode *node;
@@ -1086,6 +1096,7 @@ void previewgui_refresh (GuPreviewGui* pc, GtkTextIter *sync_to, gchar* tex_file
 
 unlock:
     g_mutex_unlock (&gummi->motion->compile_mutex);
+    stats_end (STATS_PREVIEW_REFRESH, start);
 }
 
 static gboolean synctex_run_parser(GuPreviewGui* pc, GtkTextIter *sync_to, gchar* tex_file) {
@@ -1358,8 +1369,8 @@ static void synctex_scroll_to_node (GuPreviewGui* pc, SyncNode* node) {
         previewgui_goto_xy(pc, to_x, to_y);
 
     } else {
-        if (config_value_as_str_equals ("Preview", "animated_scroll", "always") ||
-            config_value_as_str_equals ("Preview", "animated_scroll", "autosync")) {
+        if (STR_EQU (config_cache.animated_scroll, "always") ||
+            STR_EQU (config_cache.animated_scroll, "autosync")) {
             previewgui_scroll_to_xy(pc, to_x, to_y);
         } else {
             previewgui_goto_xy(pc, to_x, to_y);
@@ -1494,6 +1505,7 @@ void previewgui_restore_position (GuPreviewGui* pc) {
 
 static cairo_surface_t* do_render (PopplerPage* ppage, gdouble scale,
                                    gint width, gint height) {
+    gint64 start = stats_start ();
 
     cairo_surface_t* r = cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
                                                 width*scale,
@@ -1509,9 +1521,27 @@ static cairo_surface_t* do_render (PopplerPage* ppage, gdouble scale,
     cairo_paint (c);
     cairo_destroy (c);
 
+    stats_end (STATS_RENDER, start);
     return r;
 }
 
+/**
+ * Renders every page once, bypassing the page cache, and returns the number
+ * of pages rendered. Used to measure the render throughput.
+ */
+gint previewgui_render_all (GuPreviewGui* pc) {
+    gint i;
+
+    if (!pc->doc) return 0;
+    for (i = 0; i < pc->n_pages; ++i) {
+        PopplerPage* ppage = poppler_document_get_page (pc->doc, i);
+        cairo_surface_destroy (do_render (ppage, pc->scale, pc->pages[i].width,
+                                          pc->pages[i].height));
+        g_object_unref (ppage);
+    }
+    return pc->n_pages;
+}
+
 static cairo_surface_t* get_page_rendering (GuPreviewGui* pc, int page) {
 
     GuPreviewPage *p = pc->pages + page;
@@ -1581,7 +1611,7 @@ void on_page_input_changed (GtkEntry* entry, void* user) {
     newpage = MAX(newpage, 0);
     newpage = MIN(newpage, gui->previewgui->n_pages);
 
-    if (config_value_as_str_equals ("Preview", "animated_scroll", "always")) {
+    if (STR_EQU (config_cache.animated_scroll, "always")) {
         previewgui_scroll_to_page (gui->previewgui, newpage);
     } else {
         previewgui_goto_page (gui->previewgui, newpage);
@@ -1594,7 +1624,7 @@ void on_next_page_clicked (GtkWidget* widget, void* user) {
     //L_F_DEBUG;
     GuPreviewGui *pc = gui->previewgui;
 
-    if (config_value_as_str_equals ("Preview", "animated_scroll", "always")) {
+    if (STR_EQU (config_cache.animated_scroll, "always")) {
         previewgui_scroll_to_page (pc, pc->next_page);
     } else {
         previewgui_goto_page (pc, pc->next_page);
@@ -1606,7 +1636,7 @@ void on_prev_page_clicked (GtkWidget* widget, void* user) {
     //L_F_DEBUG;
     GuPreviewGui *pc = gui->previewgui;
 
-    if (config_value_as_str_equals ("Preview", "animated_scroll", "always")) {
+    if (STR_EQU (config_cache.animated_scroll, "always")) {
         previewgui_scroll_to_page (pc, pc->prev_page);
     } 
     else {
@@ -1779,9 +1809,14 @@ static gboolean layered_rectangle_intersect (const LayeredRectangle *src1,
     return FALSE;
 }
 
+static void on_cache_size_changed (const gchar* group, const gchar* key,
+                                   gpointer user) {
+    g_idle_add ((GSourceFunc) run_garbage_collector, user);
+}
+
 gboolean run_garbage_collector (GuPreviewGui* pc) {
 
-    gint max_cache_size = config_get_integer ("Preview", "cache_size") * 1024 * 1024;
+    gint max_cache_size = config_cache.cache_size * 1024 * 1024;
 
     if (pc->cache_size < max_cache_size) {
         return FALSE;
@@ -34,6 +34,8 @@
 
 #include "editor.h"
 #include "environment.h"
+#include "project.h"
+#include "search.h"
 #include "utils.h"
 #include "gui/gui-main.h"
 
@@ -53,6 +55,13 @@ GuSearchGui* searchgui_init (GtkBuilder* builder) {
     s->matchcase = FALSE;
     s->backwards = FALSE;
     s->wholeword = FALSE;
+    s->regex = FALSE;
+    s->project = FALSE;
+    s->resultswindow =
+        GTK_WIDGET (gtk_builder_get_object (builder, "searchresultswindow"));
+    s->list_results =
+        GTK_LIST_STORE (gtk_builder_get_object (builder, "list_searchresults"));
+    s->cancellable = NULL;
     s->prev_search = NULL;
     s->prev_replace = NULL;
     g_signal_connect (s->searchentry, "changed",
@@ -89,6 +98,22 @@ void on_toggle_backwards_toggled (GtkWidget *widget, void* user) {
     g_active_editor->replace_activated = FALSE;
 }
 
+G_MODULE_EXPORT
+void on_toggle_regex_toggled (GtkWidget *widget, void* user) {
+    gui->searchgui->regex =
+        gtk_toggle_button_get_active (GTK_TOGGLE_BUTTON (widget));
+    g_active_editor->replace_activated = FALSE;
+}
+
+G_MODULE_EXPORT
+void on_toggle_project_toggled (GtkWidget *widget, void* user) {
+    gui->searchgui->project =
+        gtk_toggle_button_get_active (GTK_TOGGLE_BUTTON (widget));
+    g_active_editor->replace_activated = FALSE;
+    if (!gui->searchgui->project)
+        gtk_widget_hide (gui->searchgui->resultswindow);
+}
+
 void on_searchgui_text_changed (GtkEditable *editable, void* user) {
     g_active_editor->replace_activated = FALSE;
 }
@@ -106,13 +131,158 @@ gboolean on_button_searchwindow_close_clicked (GtkWidget* widget, void* user) {
     return TRUE;
 }
 
+static void searchgui_add_results (GPtrArray* matches, gpointer user) {
+    GuSearchGui* gc = GU_SEARCH_GUI (user);
+    guint i;
+
+    for (i = 0; i < matches->len; ++i) {
+        GuSearchMatch* match = g_ptr_array_index (matches, i);
+        gchar* basename = g_path_get_basename (match->filename);
+        glong length = g_utf8_strlen (match->text, -1);
+        gchar* head = g_utf8_substring (match->text, 0, match->start);
+        gchar* body = g_utf8_substring (match->text, match->start,
+                                        match->end);
+        gchar* tail = g_utf8_substring (match->text, match->end, length);
+        gchar* markup = g_markup_printf_escaped ("%s<b>%s</b>%s",
+                                                 g_strchug (head), body, tail);
+
+        gtk_list_store_insert_with_values (gc->list_results, NULL, -1,
+                0, basename, 1, match->line + 1, 2, markup,
+                3, match->filename, 4, match->start, 5, match->end, -1);
+        g_free (basename);
+        g_free (head);
+        g_free (body);
+        g_free (tail);
+        g_free (markup);
+    }
+}
+
+/* user is the number of occurrences replaced in open documents, or -1 for
+ * a search */
+static void on_project_search_done (GObject* source, GAsyncResult* result,
+                                    gpointer user) {
+    gint replaced = GPOINTER_TO_INT (user);
+    GError* err = NULL;
+    gchar* status = NULL;
+    gint count = search_files_finish (result, &err);
+
+    if (count < 0) {
+        g_error_free (err);
+        return;
+    }
+    status = replaced >= 0
+        ? g_strdup_printf (_("Replaced %d occurrences"), replaced + count)
+        : g_strdup_printf (_("Found %d occurrences"), count);
+    statusbar_set_message (status);
+    g_free (status);
+}
+
+static GuEditor* searchgui_find_editor (const gchar* filename) {
+    GList* tabs = NULL;
+
+    for (tabs = gummi_get_all_tabs (); tabs; tabs = tabs->next) {
+        GuEditor* ec = GU_TAB_CONTEXT (tabs->data)->editor;
+        if (ec->filename && STR_EQU (ec->filename, filename)) return ec;
+    }
+    return NULL;
+}
+
+/* Adds a file to be searched. Open documents are searched from a snapshot
+ * of their buffer, or have their matches replaced in the buffer right away,
+ * which returns the number of replacements. */
+static gint searchgui_add_file (GuSearchGui* gc, GPtrArray* files,
+                                const gchar* filename, const gchar* term,
+                                const gchar* replacement) {
+    GuEditor* ec = searchgui_find_editor (filename);
+    guint i;
+
+    for (i = 0; i < files->len; ++i) {
+        if (STR_EQU (GU_SEARCH_FILE (g_ptr_array_index (files, i))->filename,
+                     filename))
+            return 0;
+    }
+    if (!ec) {
+        g_ptr_array_add (files, search_file_new (filename, NULL));
+        return 0;
+    }
+    if (replacement)
+        return MAX (0, editor_start_replace_all (ec, term, replacement, FALSE,
+                    gc->wholeword, gc->matchcase, gc->regex));
+    g_ptr_array_add (files, search_file_new (filename,
+                                             editor_grab_buffer (ec)));
+    return 0;
+}
+
+/* Searches the files of the project, or all open documents without one,
+ * on a thread pool and lists the matches as they are found */
+static void searchgui_search_project (GuSearchGui* gc, const gchar* term,
+                                      const gchar* replacement) {
+    GuSearchPattern* pattern = NULL;
+    GPtrArray* files = NULL;
+    gchar** filenames = NULL;
+    GList* tabs = NULL;
+    GError* err = NULL;
+    gint replaced = 0;
+    gint i;
+
+    if (!(pattern = search_pattern_new (term, gc->matchcase, gc->wholeword,
+                                        gc->regex, &err))) {
+        slog (L_G_ERROR, _("Invalid regular expression: %s\n"),
+              err->message);
+        g_error_free (err);
+        return;
+    }
+    if (replacement && !search_pattern_check_replacement (pattern,
+                                                          replacement, &err)) {
+        slog (L_G_ERROR, _("Invalid replacement: %s\n"), err->message);
+        g_error_free (err);
+        search_pattern_free (pattern);
+        return;
+    }
+
+    if (gc->cancellable) {
+        g_cancellable_cancel (gc->cancellable);
+        g_object_unref (gc->cancellable);
+    }
+    gc->cancellable = g_cancellable_new ();
+    gtk_list_store_clear (gc->list_results);
+    if (!replacement) gtk_widget_show (gc->resultswindow);
+
+    files = g_ptr_array_new_with_free_func ((GDestroyNotify)search_file_free);
+    if (gummi->project->projfile) {
+        filenames = project_get_files (gummi->project->projfile);
+        for (i = 0; filenames[i]; ++i)
+            replaced += searchgui_add_file (gc, files, filenames[i], term,
+                                            replacement);
+        g_strfreev (filenames);
+    } else {
+        for (tabs = gummi_get_all_tabs (); tabs; tabs = tabs->next) {
+            GuEditor* ec = GU_TAB_CONTEXT (tabs->data)->editor;
+            if (ec->filename)
+                replaced += searchgui_add_file (gc, files, ec->filename, term,
+                                                replacement);
+        }
+    }
+
+    /* Replaced matches are not listed, their offsets would be stale */
+    search_files_async (pattern, files, replacement, gc->cancellable,
+                        searchgui_add_results, gc, on_project_search_done,
+                        GINT_TO_POINTER (replacement? replaced: -1));
+}
+
 G_MODULE_EXPORT
 void on_button_searchwindow_find_clicked (GtkWidget* widget, void* user) {
+    if (gui->searchgui->project) {
+        searchgui_search_project (gui->searchgui,
+                gtk_entry_get_text (gui->searchgui->searchentry), NULL);
+        return;
+    }
     editor_start_search (g_active_editor,
             gtk_entry_get_text (gui->searchgui->searchentry),
             gui->searchgui->backwards,
             gui->searchgui->wholeword,
-            gui->searchgui->matchcase
+            gui->searchgui->matchcase,
+            gui->searchgui->regex
             );
 }
 
@@ -123,17 +293,95 @@ void on_button_searchwindow_replace_next_clicked (GtkWidget* widget, void* user)
             gtk_entry_get_text (gui->searchgui->replaceentry),
             gui->searchgui->backwards,
             gui->searchgui->wholeword,
-            gui->searchgui->matchcase
+            gui->searchgui->matchcase,
+            gui->searchgui->regex
             );
 }
 
 G_MODULE_EXPORT
 void on_button_searchwindow_replace_all_clicked (GtkWidget* widget, void* user) {
-    editor_start_replace_all (g_active_editor,
+    gchar* status = NULL;
+    gint count = 0;
+
+    if (gui->searchgui->project) {
+        searchgui_search_project (gui->searchgui,
+                gtk_entry_get_text (gui->searchgui->searchentry),
+                gtk_entry_get_text (gui->searchgui->replaceentry));
+        return;
+    }
+    count = editor_start_replace_all (g_active_editor,
             gtk_entry_get_text (gui->searchgui->searchentry),
             gtk_entry_get_text (gui->searchgui->replaceentry),
             gui->searchgui->backwards,
             gui->searchgui->wholeword,
-            gui->searchgui->matchcase
+            gui->searchgui->matchcase,
+            gui->searchgui->regex
             );
+
+    if (count >= 0) {
+        status = g_strdup_printf (_("Replaced %d occurrences"), count);
+        statusbar_set_message (status);
+        g_free (status);
+    }
+}
+
+/* A match of the results list, by line and character offsets in it */
+typedef struct {
+    gint line;
+    gint start;
+    gint end;
+} SearchResult;
+
+/* Selects the match once the document is loaded into ec */
+static void searchgui_select_result (GuEditor* ec, gpointer user) {
+    SearchResult* result = user;
+    GtkTextBuffer* buffer = GTK_TEXT_BUFFER (ec->buffer);
+    GtkTextIter mstart, mend;
+    gint length = 0;
+
+    if (result->line > gtk_text_buffer_get_line_count (buffer)) return;
+    gtk_text_buffer_get_iter_at_line (buffer, &mstart, result->line - 1);
+    length = gtk_text_iter_get_chars_in_line (&mstart);
+    mend = mstart;
+    gtk_text_iter_set_line_offset (&mstart, MIN (result->start, length));
+    gtk_text_iter_set_line_offset (&mend, MIN (result->end, length));
+    gtk_text_buffer_select_range (buffer, &mstart, &mend);
+    editor_scroll_to_cursor (ec);
+}
+
+G_MODULE_EXPORT
+void on_searchresults_row_activated (GtkTreeView* view, GtkTreePath* path,
+        GtkTreeViewColumn* column, void* user) {
+    GtkTreeModel* model = gtk_tree_view_get_model (view);
+    GtkTreeIter iter;
+    GList* tabs = NULL;
+    SearchResult* result = NULL;
+    gchar* filename = NULL;
+    gint line = 0, start = 0, end = 0;
+
+    if (!gtk_tree_model_get_iter (model, &iter, path)) return;
+    gtk_tree_model_get (model, &iter, 1, &line, 3, &filename,
+                        4, &start, 5, &end, -1);
+
+    /* go to the document of the match, opening it if needed */
+    for (tabs = gummi_get_all_tabs (); tabs; tabs = tabs->next) {
+        if (STR_EQU (GU_TAB_CONTEXT (tabs->data)->editor->filename,
+                     filename)) {
+            tabmanagergui_set_current_page (
+                    g_list_index (gummi_get_all_tabs (), tabs->data));
+            break;
+        }
+    }
+    if (!tabs) gui_open_file (filename);
+
+    /* the file just opened is still being loaded */
+    if (g_active_editor && STR_EQU (g_active_editor->filename, filename)) {
+        result = g_new (SearchResult, 1);
+        result->line = line;
+        result->start = start;
+        result->end = end;
+        iofunctions_when_loaded (g_active_editor, searchgui_select_result,
+                                 result, g_free);
+    }
+    g_free (filename);
 }
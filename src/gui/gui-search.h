@@ -43,6 +43,11 @@ struct _GuSearchGui {
     gboolean backwards;
     gboolean matchcase;
     gboolean wholeword;
+    gboolean regex;
+    gboolean project;
+    GtkWidget* resultswindow;
+    GtkListStore* list_results;
+    GCancellable* cancellable;
     gchar* prev_search;
     gchar* prev_replace;
 };
@@ -52,10 +57,14 @@ void searchgui_main (GuSearchGui* gc);
 void on_toggle_matchcase_toggled (GtkWidget* widget, void* user);
 void on_toggle_wholeword_toggled (GtkWidget* widget, void* user);
 void on_toggle_backwards_toggled (GtkWidget* widget, void* user);
+void on_toggle_regex_toggled (GtkWidget* widget, void* user);
+void on_toggle_project_toggled (GtkWidget* widget, void* user);
 void on_searchgui_text_changed (GtkEditable* editable, void* user);
 gboolean on_button_searchwindow_close_clicked (GtkWidget* widget, void* user);
 void on_button_searchwindow_find_clicked (GtkWidget* widget, void* user);
 void on_button_searchwindow_replace_next_clicked (GtkWidget* widget, void* user);
 void on_button_searchwindow_replace_all_clicked (GtkWidget* widget, void* user);
+void on_searchresults_row_activated (GtkTreeView* view, GtkTreePath* path,
+        GtkTreeViewColumn* column, void* user);
 
 #endif /* __GUMMI_GUI_SEARCH_H__ */
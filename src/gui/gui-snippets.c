@@ -160,6 +160,7 @@ void snippetsgui_update_snippet (GuSnippets* sc) {
     const gchar* new_accel = NULL;
     const gchar* new_key = NULL;
     gchar** configs = NULL;
+    gchar* config = NULL;
     GtkTreeIter iter;
     GtkTreeModel* model =NULL;
     GtkTreeSelection* selection = NULL;
@@ -172,8 +173,10 @@ void snippetsgui_update_snippet (GuSnippets* sc) {
     selection = gtk_tree_view_get_selection (s->snippets_tree_view);
     gtk_tree_selection_get_selected (selection, &model, &iter);
 
-    g_free (target->first);
-    target->first = g_strdup_printf("%s,%s,%s", new_key, new_accel, configs[2]);
+    config = g_strdup_printf ("%s,%s,%s", new_key, new_accel, configs[2]);
+    snippets_set_string (sc, &target->first, config);
+    snippets_index (sc);
+    g_free (config);
     gtk_list_store_set (s->list_snippets, &iter, 0, configs[2],
                                                  1, new_key,
                                                  2, new_accel, -1);
@@ -286,7 +289,9 @@ void on_button_remove_snippet_clicked (GtkWidget* widget, void* user) {
         if (widget) {
             config = g_strdup_printf ("%s,%s,%s", key, accel, name);
             target = slist_find (gummi->snippets->head, config, FALSE, FALSE);
-            slist_remove (gummi->snippets->head, target);
+            gummi->snippets->head = slist_remove (gummi->snippets->head,
+                                                  target);
+            snippets_index (gummi->snippets);
         }
         /* Disconnect accelerator */
         if (key) snippets_accel_disconnect (gummi->snippets, key);
@@ -313,12 +318,10 @@ G_MODULE_EXPORT
 gboolean on_tab_trigger_entry_key_release_event (GtkEntry* entry, void* user) {
     GuSnippetsGui* s = gui->snippetsgui;
     const gchar* new_key = gtk_entry_get_text (entry);
-    gchar* search_key = NULL;
     slist* index = NULL;
 
     /* Check dumplicate key */
-    search_key = g_strdup_printf ("%s,", new_key);
-    index = slist_find (gummi->snippets->head, search_key, TRUE, FALSE);
+    index = snippets_find (gummi->snippets, new_key);
 
     if (index && index != s->current) {
         gtk_entry_set_text (entry, "");
@@ -327,7 +330,6 @@ gboolean on_tab_trigger_entry_key_release_event (GtkEntry* entry, void* user) {
     } else {
         snippetsgui_update_snippet (gummi->snippets);
     }
-    g_free (search_key);
 
     return FALSE;
 }
@@ -435,9 +437,12 @@ void on_snippet_renderer_edited (GtkCellRendererText* renderer, gchar *path,
         gtk_list_store_set (s->list_snippets, &iter, 0, name, 1, "", 2, "", -1);
         if (strlen (name)) {
             slist* node = g_new0 (slist, 1);
-            node->first = g_strdup_printf (",,%s", name);
-            node->second = g_strdup ("");
+            gchar* config = g_strdup_printf (",,%s", name);
+            snippets_set_string (gummi->snippets, &node->first, config);
+            snippets_set_string (gummi->snippets, &node->second, "");
+            g_free (config);
             gummi->snippets->head = slist_append (gummi->snippets->head, node);
+            snippets_index (gummi->snippets);
             s->current = node;
             on_snippets_tree_view_cursor_changed (s->snippets_tree_view, NULL);
         } else {
@@ -460,8 +465,7 @@ gboolean on_snippet_source_buffer_key_release (GtkWidget* widget, void* user) {
     gtk_text_buffer_get_bounds (GTK_TEXT_BUFFER (gui->snippetsgui->buffer),
             &start, &end);
     gchar* text = gtk_text_iter_get_text (&start, &end);
-    g_free (s->current->second);
-    s->current->second = g_strdup (text);
+    snippets_set_string (gummi->snippets, &s->current->second, text);
     g_free (text);
     return FALSE;
 }
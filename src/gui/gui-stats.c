@@ -0,0 +1,143 @@
+/**
+ * @file    gui-stats.c
+ * @brief   debug panel with the timing spans
+ *
+ * Copyright (C) 2009 Gummi Developers
+ * All Rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "gui/gui-stats.h"
+
+#include <glib.h>
+#include <gtk/gtk.h>
+
+#include "environment.h"
+#include "stats.h"
+
+enum {
+    STATS_COL_NAME = 0,
+    STATS_COL_COUNT,
+    STATS_COL_MEAN,
+    STATS_COL_P50,
+    STATS_COL_P95,
+    STATS_COL_P99,
+    STATS_COL_MAX,
+    STATS_N_COLS
+};
+
+static GtkWidget* statswindow = NULL;
+
+static gboolean statsgui_update (gpointer store) {
+    GtkTreeIter iter;
+    GuStatsSummary s;
+    guint i;
+
+    if (!statswindow) return FALSE;
+
+    gtk_list_store_clear (GTK_LIST_STORE (store));
+    for (i = 0; i < STATS_N_SPANS; ++i) {
+        stats_get_summary (i, &s);
+        gtk_list_store_append (GTK_LIST_STORE (store), &iter);
+        gtk_list_store_set (GTK_LIST_STORE (store), &iter,
+                            STATS_COL_NAME, s.name, STATS_COL_COUNT, s.count,
+                            STATS_COL_MEAN, s.mean, STATS_COL_P50, s.p50,
+                            STATS_COL_P95, s.p95, STATS_COL_P99, s.p99,
+                            STATS_COL_MAX, s.max, -1);
+    }
+    return TRUE;
+}
+
+static void statsgui_render_ms (GtkTreeViewColumn* col, GtkCellRenderer* cell,
+                                GtkTreeModel* model, GtkTreeIter* iter,
+                                gpointer column) {
+    gdouble value = 0;
+    gchar* text = NULL;
+
+    gtk_tree_model_get (model, iter, GPOINTER_TO_INT (column), &value, -1);
+    text = g_strdup_printf ("%.1f", value);
+    g_object_set (cell, "text", text, NULL);
+    g_free (text);
+}
+
+static void on_statswindow_destroy (GtkWidget* widget, gpointer timer) {
+    g_source_remove (GPOINTER_TO_UINT (timer));
+    statswindow = NULL;
+}
+
+/**
+ * Shows the durations of the compile and preview spans, refreshed every
+ * second while the window is open.
+ */
+void statsgui_show (GtkWindow* parent) {
+    const gchar* titles[] = { _("Span"), _("Count"), _("Mean (ms)"),
+                              _("p50 (ms)"), _("p95 (ms)"), _("p99 (ms)"),
+                              _("Max (ms)") };
+    GtkListStore* store = NULL;
+    GtkWidget* view = NULL;
+    GtkWidget* scroll = NULL;
+    GtkCellRenderer* cell = NULL;
+    guint timer = 0;
+    gint i;
+
+    if (statswindow) {
+        gtk_window_present (GTK_WINDOW (statswindow));
+        return;
+    }
+
+    store = gtk_list_store_new (STATS_N_COLS, G_TYPE_STRING, G_TYPE_UINT,
+                                G_TYPE_DOUBLE, G_TYPE_DOUBLE, G_TYPE_DOUBLE,
+                                G_TYPE_DOUBLE, G_TYPE_DOUBLE);
+    view = gtk_tree_view_new_with_model (GTK_TREE_MODEL (store));
+    g_object_unref (store);
+
+    for (i = 0; i < STATS_N_COLS; ++i) {
+        cell = gtk_cell_renderer_text_new ();
+        if (i == STATS_COL_NAME || i == STATS_COL_COUNT) {
+            gtk_tree_view_insert_column_with_attributes (GTK_TREE_VIEW (view),
+                    -1, titles[i], cell, "text", i, NULL);
+        } else {
+            g_object_set (cell, "xalign", 1.0, NULL);
+            gtk_tree_view_insert_column_with_data_func (GTK_TREE_VIEW (view),
+                    -1, titles[i], cell, statsgui_render_ms,
+                    GINT_TO_POINTER (i), NULL);
+        }
+    }
+
+    scroll = gtk_scrolled_window_new (NULL, NULL);
+    gtk_container_add (GTK_CONTAINER (scroll), view);
+
+    statswindow = gtk_window_new (GTK_WINDOW_TOPLEVEL);
+    gtk_window_set_title (GTK_WINDOW (statswindow),
+                          _("Performance Timings"));
+    gtk_window_set_transient_for (GTK_WINDOW (statswindow), parent);
+    gtk_window_set_default_size (GTK_WINDOW (statswindow), 640, 240);
+    gtk_container_add (GTK_CONTAINER (statswindow), scroll);
+
+    statsgui_update (store);
+    timer = g_timeout_add_seconds (1, statsgui_update, store);
+    g_signal_connect (statswindow, "destroy",
+                      G_CALLBACK (on_statswindow_destroy),
+                      GUINT_TO_POINTER (timer));
+    gtk_widget_show_all (statswindow);
+}
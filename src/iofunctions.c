@@ -34,17 +34,42 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <glib/gstdio.h>
+
+#include "biblio.h"
 #include "constants.h"
 #include "configfile.h"
 #include "editor.h"
 #include "environment.h"
 #include "gui/gui-main.h"
+#include "stats.h"
 #include "utils.h"
 
 extern Gummi* gummi;
 
 static guint sid = 0;
 
+/* Local .sty packages are scanned on a thread pool. The definitions found
+ * in each of them are cached by path in C_TMPDIR, together with the mtime,
+ * to the microsecond, and size of the file, so only the packages changed
+ * since they were last seen are read again. The packages no longer found in
+ * a directory when it is scanned are dropped from the cache. */
+#define STY_CACHE_FILE "sty.cache"
+#define STY_CACHE_TYPE "a{s(tt" SCAN_DEFINITIONS_TYPE ")}"
+
+typedef struct _StyJob {
+    gchar* path;
+    gchar* package;         /* NULL when path is a directory to enumerate */
+    guint64 mtime;          /* in microseconds */
+    goffset size;
+    GVariant* definitions;  /* set once the package is scanned */
+} StyJob;
+
+static GThreadPool* sty_pool = NULL;
+static GHashTable* sty_cache = NULL;
+static GMutex sty_cache_lock;
+static gboolean sty_cache_save_pending = FALSE;
+
 /* private functions */
 void iofunctions_real_load_file (GObject* hook, const gchar* filename);
 void iofunctions_real_save_file (GObject* hook, GObject* savecontext);
@@ -98,41 +123,455 @@ void iofunctions_load_file (GuIOFunc* io, const gchar* filename) {
     g_signal_emit_by_name (io->sig_hook, "document-load", filename);
 }
 
-void iofunctions_real_load_file (GObject* hook, const gchar* filename) {
-    GError* err = NULL;
-    gchar* text = NULL;
-    gchar* decoded = NULL;
-    gchar* dirname = NULL;
-    gboolean result;
-    GuEditor* ec = NULL;
+/* Converts text from the locale encoding to UTF-8, or from ISO-8859-1 if
+ * it isn't valid in the locale encoding. Safe to call from any thread. */
+static gchar* decode_text (const gchar* text, gssize length, GError** err) {
+    gchar* result = NULL;
 
-    if (FALSE == (g_file_get_contents (filename, &text, NULL, &err))) {
-        slog (L_G_ERROR, "g_file_get_contents (): %s\n", err->message);
-        g_error_free (err);
-        iofunctions_load_default_text (FALSE);
-        return;
+    if ((result = g_locale_to_utf8 (text, length, NULL, NULL, NULL)))
+        return result;
+    slog (L_ERROR, "Failed to convert text from default locale, trying "
+            "ISO-8859-1\n");
+    return g_convert (text, length, "UTF-8", "ISO-8859-1", NULL, NULL, err);
+}
+
+static void scan_document_thread (GTask* task, gpointer source,
+                                  gpointer data, GCancellable* cancellable) {
+    g_task_return_pointer (task, g_variant_ref_sink (scan_document (data)),
+                           (GDestroyNotify)g_variant_unref);
+}
+
+static void on_document_scanned (GObject* source, GAsyncResult* result,
+                                 gpointer user) {
+    GVariant* scan = g_task_propagate_pointer (G_TASK (result), NULL);
+
+    scan_apply_document (scan);
+    g_variant_unref (scan);
+}
+
+/* Collects the labels, bibitems, new environments and new commands of text,
+ * which is taken over, on a worker thread for the completion */
+static void iofunctions_scan_async (gchar* text) {
+    GTask* task = g_task_new (NULL, NULL, on_document_scanned, NULL);
+
+    g_task_set_task_data (task, text, g_free);
+    g_task_run_in_thread (task, scan_document_thread);
+    g_object_unref (task);
+}
+
+/* Loading
+ *
+ * A file is read with the asynchronous GFile API and decoded on a worker
+ * thread. The text goes into the buffer in chunks from an idle callback so
+ * that the window is redrawn in between, then the document is scanned for
+ * the completion in the background. Closing the tab or loading another
+ * file into it cancels the load. Whatever needs the text in the buffer,
+ * e.g. selecting a line, waits for the load with iofunctions_when_loaded. */
+
+#define LOAD_CHUNK_SIZE (256 * 1024)
+
+typedef struct {
+    GCancellable* loading;  /* of the load waited for */
+    GuLoadedFunc func;
+    gpointer user;
+    GDestroyNotify destroy;
+} LoadWaiter;
+
+static GSList* load_waiters = NULL;
+
+typedef struct {
+    GuEditor* editor;
+    gchar* filename;
+    GCancellable* cancellable;
+    gchar* text;
+    gsize length;
+    gsize offset;           /* of the text not in the buffer yet */
+} LoadJob;
+
+/* Calls the functions waiting for the load of job if it completed, and
+ * drops them */
+static void load_job_notify (LoadJob* job, gboolean completed) {
+    GSList* waiters = NULL;
+    GSList* node = NULL;
+
+    for (node = load_waiters; node; ) {
+        LoadWaiter* waiter = node->data;
+        GSList* next = node->next;
+
+        if (waiter->loading == job->cancellable) {
+            load_waiters = g_slist_remove_link (load_waiters, node);
+            waiters = g_slist_concat (waiters, node);
+        }
+        node = next;
     }
+    for (node = waiters; node; node = node->next) {
+        LoadWaiter* waiter = node->data;
 
-    if (NULL == (decoded = iofunctions_decode_text (text)))
-        goto cleanup;
+        if (completed) waiter->func (job->editor, waiter->user);
+        if (waiter->destroy) waiter->destroy (waiter->user);
+        g_object_unref (waiter->loading);
+        g_free (waiter);
+    }
+    g_slist_free (waiters);
+}
+
+static void load_job_free (LoadJob* job) {
+    load_job_notify (job, FALSE);
+    g_free (job->filename);
+    g_object_unref (job->cancellable);
+    g_free (job->text);
+    g_free (job);
+}
+
+/* Releases the editor from a load that ended */
+static void load_job_done (LoadJob* job) {
+    GuEditor* ec = job->editor;
+
+    editor_fill_end (ec);
+    if (ec->loading == job->cancellable) g_clear_object (&ec->loading);
+    load_job_free (job);
+}
+
+static void load_job_complete (LoadJob* job) {
+    GuEditor* ec = job->editor;
+    gchar* dirname = NULL;
+
+    editor_fill_end (ec);
 
-    ec = gummi_get_active_editor();
-    editor_fill_buffer (gummi_get_active_editor(), decoded);
-    gtk_text_buffer_set_modified (GTK_TEXT_BUFFER(ec->buffer), FALSE);
-    
     // Check for custom packages in file directory
-    dirname = g_path_get_dirname (filename);
+    dirname = g_path_get_dirname (job->filename);
     scan_directory (dirname);
     g_free (dirname);
+    // Citations of the bibliography, from its cache when it is unchanged
+    if (biblio_detect_bibliography (ec))
+        biblio_load_citations (ec->bibfiles);
     // Scan the current file for bibitems, newenvironments and newcommands
-    scan_for_labels (decoded);
-    scan_for_bibitems (decoded);
-    scan_for_new_envs (decoded, NULL);
-    scan_for_new_cmds (decoded, NULL);
+    iofunctions_scan_async (job->text);
+    job->text = NULL;
+
+    if (ec == gummi_get_active_editor ())
+        motion_force_compile (gummi->motion);
+    if (ec->loading == job->cancellable) g_clear_object (&ec->loading);
+    load_job_notify (job, TRUE);
+    load_job_done (job);
+}
 
-cleanup:
-    g_free (decoded);
-    g_free (text);
+static gboolean load_fill_chunk (gpointer user) {
+    LoadJob* job = user;
+    const gchar* start = job->text + job->offset;
+    gsize left = job->length - job->offset;
+    gsize len = MIN (left, LOAD_CHUNK_SIZE);
+
+    if (g_cancellable_is_cancelled (job->cancellable)) {
+        load_job_free (job);
+        return FALSE;
+    }
+
+    /* End the chunk after a line, or at least on a character */
+    if (len < left) {
+        gsize cut = len;
+        while (cut > 0 && start[cut - 1] != '\n') --cut;
+        len = cut? cut: (gsize)(g_utf8_find_prev_char (start, start + len)
+                                - start);
+    }
+    editor_fill_append (job->editor, start, len);
+    job->offset += len;
+
+    if (job->offset < job->length) return TRUE;
+    load_job_complete (job);
+    return FALSE;
+}
+
+static void load_decode_thread (GTask* task, gpointer source, gpointer data,
+                                GCancellable* cancellable) {
+    LoadJob* job = data;
+    GError* err = NULL;
+    gchar* decoded = NULL;
+
+    if (!(decoded = decode_text (job->text, job->length, &err))) {
+        g_task_return_error (task, err);
+        return;
+    }
+    g_free (job->text);
+    job->text = decoded;
+    job->length = strlen (decoded);
+    g_task_return_boolean (task, TRUE);
+}
+
+static void on_file_decoded (GObject* source, GAsyncResult* result,
+                             gpointer user) {
+    LoadJob* job = user;
+    GError* err = NULL;
+
+    if (g_cancellable_is_cancelled (job->cancellable)) {
+        load_job_free (job);
+        return;
+    }
+    if (!g_task_propagate_boolean (G_TASK (result), &err)) {
+        slog (L_G_ERROR, _("Can not convert text to UTF-8!\n"));
+        g_error_free (err);
+        load_job_done (job);
+        return;
+    }
+
+    editor_fill_begin (job->editor);
+    g_idle_add (load_fill_chunk, job);
+}
+
+static void on_file_read (GObject* source, GAsyncResult* result,
+                          gpointer user) {
+    LoadJob* job = user;
+    GError* err = NULL;
+    GTask* task = NULL;
+
+    if (!g_file_load_contents_finish (G_FILE (source), result, &job->text,
+                                      &job->length, NULL, &err)) {
+        if (g_error_matches (err, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+            load_job_free (job);
+        } else {
+            slog (L_G_ERROR, "g_file_load_contents (): %s\n", err->message);
+            if (job->editor == gummi_get_active_editor ())
+                iofunctions_load_default_text (FALSE);
+            load_job_done (job);
+        }
+        g_error_free (err);
+        return;
+    }
+
+    task = g_task_new (NULL, job->cancellable, on_file_decoded, job);
+    g_task_set_task_data (task, job, NULL);
+    g_task_run_in_thread (task, load_decode_thread);
+    g_object_unref (task);
+}
+
+void iofunctions_real_load_file (GObject* hook, const gchar* filename) {
+    GuEditor* ec = gummi_get_active_editor ();
+    LoadJob* job = g_new0 (LoadJob, 1);
+    GFile* file = g_file_new_for_path (filename);
+
+    if (ec->loading) {
+        g_cancellable_cancel (ec->loading);
+        g_object_unref (ec->loading);
+    }
+    ec->loading = g_cancellable_new ();
+
+    job->editor = ec;
+    job->filename = g_strdup (filename);
+    job->cancellable = g_object_ref (ec->loading);
+    g_file_load_contents_async (file, job->cancellable, on_file_read, job);
+    g_object_unref (file);
+}
+
+/**
+ * Calls func with the editor once the file being loaded into it is in its
+ * buffer, or right away if it isn't loading. func isn't called if the load
+ * fails or is cancelled. destroy, if set, frees user in either case.
+ */
+void iofunctions_when_loaded (GuEditor* ec, GuLoadedFunc func, gpointer user,
+                              GDestroyNotify destroy) {
+    LoadWaiter* waiter = NULL;
+
+    if (!ec->loading) {
+        func (ec, user);
+        if (destroy) destroy (user);
+        return;
+    }
+    waiter = g_new0 (LoadWaiter, 1);
+    waiter->loading = g_object_ref (ec->loading);
+    waiter->func = func;
+    waiter->user = user;
+    waiter->destroy = destroy;
+    load_waiters = g_slist_append (load_waiters, waiter);
+}
+
+/* Saving
+ *
+ * A save hands a snapshot of the buffer to a writer thread, which encodes
+ * and writes it and scans it for the completion. Each file has at most one
+ * write in flight: snapshots saved in the meantime replace each other and
+ * only the latest is written once the current write has completed. */
+
+typedef struct {
+    gchar* filename;
+    gchar* text;
+    gchar* error;           /* set when the file could not be written */
+    GVariant* scan;
+} SaveJob;
+
+static GThreadPool* save_pool = NULL;
+/* Files being written, each mapped to the snapshot waiting for the write
+ * in flight to complete, or NULL. Only used on the main thread. */
+static GHashTable* save_files = NULL;
+/* Set when a write failed, see iofunctions_wait_for_saves */
+static gboolean save_failed = FALSE;
+
+typedef struct {
+    gchar* filename;
+    gboolean failed;        /* one of the writes waited for failed */
+    GuSavedFunc func;
+    gpointer user;
+} SaveWaiter;
+
+static GSList* save_waiters = NULL;
+
+static void save_start (const gchar* filename, gchar* text) {
+    SaveJob* job = g_new0 (SaveJob, 1);
+
+    job->filename = g_strdup (filename);
+    job->text = text;
+    g_hash_table_insert (save_files, g_strdup (filename), NULL);
+    g_thread_pool_push (save_pool, job, NULL);
+}
+
+/* Notes a failed write of filename for the functions waiting for it */
+static void save_waiters_failed (const gchar* filename) {
+    GSList* node = NULL;
+
+    for (node = save_waiters; node; node = node->next) {
+        SaveWaiter* waiter = node->data;
+        if (STR_EQU (waiter->filename, filename)) waiter->failed = TRUE;
+    }
+}
+
+/* Calls the functions waiting for the writes of filename, which are done */
+static void save_waiters_notify (const gchar* filename) {
+    GSList* node = save_waiters;
+
+    while (node) {
+        SaveWaiter* waiter = node->data;
+        GSList* next = node->next;
+
+        if (STR_EQU (waiter->filename, filename)) {
+            save_waiters = g_slist_delete_link (save_waiters, node);
+            waiter->func (filename, !waiter->failed, waiter->user);
+            g_free (waiter->filename);
+            g_free (waiter);
+        }
+        node = next;
+    }
+}
+
+static gboolean on_file_saved (gpointer user) {
+    SaveJob* job = user;
+    GList* editors = NULL;
+    GList* node = NULL;
+    GStatBuf attr;
+    gchar* pending = NULL;
+
+    if (job->error) {
+        /* The buffer was marked unmodified when the save started, mark it
+         * again so its changes aren't dropped on close or quit */
+        save_failed = TRUE;
+        save_waiters_failed (job->filename);
+        for (node = gummi_get_all_tabs (); node; node = node->next) {
+            GuTabContext* tab = node->data;
+            if (!STR_EQU (tab->editor->filename, job->filename)) continue;
+            gtk_text_buffer_set_modified (
+                    GTK_TEXT_BUFFER (tab->editor->buffer), TRUE);
+            gui_set_filename_display (tab, tab == g_active_tab, TRUE);
+        }
+        slog (L_G_ERROR, _("%s\nPlease try again later."), job->error);
+    } else if (g_stat (job->filename, &attr) == 0) {
+        /* Resets modtime, so the write is not taken for an external change */
+        editors = gummi_get_all_editors ();
+        for (node = editors; node; node = node->next) {
+            GuEditor* ec = node->data;
+            if (STR_EQU (ec->filename, job->filename))
+                ec->last_modtime = attr.st_mtime;
+        }
+        g_list_free (editors);
+    }
+    scan_apply_document (job->scan);
+
+    pending = g_hash_table_lookup (save_files, job->filename);
+    if (pending) {
+        save_start (job->filename, pending);
+    } else {
+        g_hash_table_remove (save_files, job->filename);
+        save_waiters_notify (job->filename);
+    }
+
+    g_variant_unref (job->scan);
+    g_free (job->error);
+    g_free (job->filename);
+    g_free (job);
+    return FALSE;
+}
+
+static void save_worker (gpointer data, gpointer user) {
+    SaveJob* job = data;
+    gchar* encoded = NULL;
+    GError* err = NULL;
+
+    encoded = iofunctions_encode_text (job->text);
+
+    // set the contents of the file to the text from the buffer
+    if (!g_file_set_contents (job->filename, encoded, -1, &err)) {
+        slog (L_ERROR, "g_file_set_contents (): %s\n", err->message);
+        job->error = g_strdup (err->message);
+        g_error_free (err);
+    }
+
+    // Update completion information for bibitems, newenvironments and newcommands
+    job->scan = g_variant_ref_sink (scan_document (job->text));
+
+    g_free (encoded);
+    g_free (job->text);
+    job->text = NULL;
+    g_idle_add (on_file_saved, job);
+}
+
+/* Writes text, which is taken over, to filename after the write of the
+ * file in flight, if any */
+static void save_enqueue (const gchar* filename, gchar* text) {
+    gpointer pending = NULL;
+
+    if (!save_pool) {
+        save_files = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                            g_free, NULL);
+        save_pool = g_thread_pool_new (save_worker, NULL, 2, FALSE, NULL);
+    }
+    if (g_hash_table_lookup_extended (save_files, filename, NULL, &pending)) {
+        g_free (pending);
+        g_hash_table_insert (save_files, g_strdup (filename), text);
+    } else {
+        save_start (filename, text);
+    }
+}
+
+gboolean iofunctions_is_saving (const gchar* filename) {
+    return save_files && g_hash_table_contains (save_files, filename);
+}
+
+/**
+ * Calls func once the writes of filename in flight are done, with whether
+ * they all succeeded, or right away if it isn't being written.
+ */
+void iofunctions_wait_for_save (const gchar* filename, GuSavedFunc func,
+                                gpointer user) {
+    SaveWaiter* waiter = NULL;
+
+    if (!filename || !iofunctions_is_saving (filename)) {
+        func (filename, TRUE, user);
+        return;
+    }
+    waiter = g_new0 (SaveWaiter, 1);
+    waiter->filename = g_strdup (filename);
+    waiter->func = func;
+    waiter->user = user;
+    save_waiters = g_slist_append (save_waiters, waiter);
+}
+
+/**
+ * Waits for all the writes in flight, e.g. before quitting, returns FALSE
+ * if one of them failed. The
+ * buffers of the files that couldn't be written are modified again then.
+ */
+gboolean iofunctions_wait_for_saves (void) {
+    save_failed = FALSE;
+    while (save_files && g_hash_table_size (save_files) > 0)
+        g_main_context_iteration (NULL, TRUE);
+    return !save_failed;
 }
 
 void iofunctions_save_file (GuIOFunc* io, gchar* filename, gchar *text) {
@@ -154,39 +593,17 @@ void iofunctions_save_file (GuIOFunc* io, gchar* filename, gchar *text) {
 }
 
 void iofunctions_real_save_file (GObject* hook, GObject* savecontext) {
-
-    gboolean result = FALSE;
     gchar* filename = NULL;
-    gchar* encoded = NULL;
     gchar* text = NULL;
-    GError* err = NULL;
 
     filename = g_object_get_data (savecontext, "filename");
     text = g_object_get_data (savecontext, "text");
 
-    encoded = iofunctions_encode_text (text);
+    if (filename != NULL)
+        save_enqueue (filename, text);
+    else
+        g_free (text);
 
-    // set the contents of the file to the text from the buffer
-    if (filename != NULL) {
-        if (! (result = g_file_set_contents (filename, encoded, -1, &err))) {
-            slog (L_ERROR, "g_file_set_contents (): %s\n", err->message);
-            g_error_free (err);
-        }
-    }
-
-    if (result == FALSE) {
-        slog (L_G_ERROR, _("%s\nPlease try again later."), err->message);
-        g_error_free (err);
-    }
-    
-    // Update completion information for bibitems, newenvironments and newcommands
-    scan_for_labels (text);
-    scan_for_bibitems (text);
-    scan_for_new_envs (text, NULL);
-    scan_for_new_cmds (text, NULL);
-
-    g_free (encoded);
-    g_free (text);
     g_object_unref (savecontext);
 }
 
@@ -216,7 +633,7 @@ gboolean iofunctions_has_swapfile (const gchar* filename) {
 }
 
 void iofunctions_start_autosave (void) {
-    sid = g_timeout_add_seconds (config_get_integer ("File", "autosave_timer") * 60,
+    sid = g_timeout_add_seconds (config_cache.autosave_timer * 60,
                                  iofunctions_autosave_cb,
                                  NULL);
     slog (L_DEBUG, "Autosaving function started..\n");
@@ -235,32 +652,18 @@ void iofunctions_stop_autosave (void) {
 
 void iofunctions_reset_autosave (const gchar* name) {
     iofunctions_stop_autosave ();
-    if (config_get_boolean ("File", "autosaving")) {
+    if (config_cache.autosaving) {
         iofunctions_start_autosave ();
     }
 }
 
 char* iofunctions_decode_text (gchar* text) {
     GError* err = NULL;
-    gchar* result = 0;
-    gsize read = 0, written = 0;
+    gchar* result = NULL;
 
-    if (! (result = g_locale_to_utf8 (text, -1, &read, &written, &err))) {
+    if (! (result = decode_text (text, -1, &err))) {
+        slog (L_G_ERROR, _("Can not convert text to UTF-8!\n"));
         g_error_free (err);
-        slog (L_ERROR, "Failed to convert text from default locale, trying "
-                "ISO-8859-1\n");
-        gsize in_size = strlen (text), out_size = in_size * 2;
-        gchar* out = (gchar*)g_malloc (out_size);
-        gchar* process = out;
-        /* TODO: replace these calls to the non-raw glib functions */
-        GIConv cd = g_iconv_open ("UTF-8//IGNORE", "ISO−8859-1");
-
-        if (-1 == g_iconv (cd, &text, &in_size, &process, &out_size)) {
-            slog (L_G_ERROR, _("Can not convert text to UTF-8!\n"));
-            g_free (out);
-            out = NULL;
-        }
-        result = out;
     }
     return result;
 }
@@ -296,7 +699,8 @@ gboolean iofunctions_autosave_cb (void *user) {
         tab = g_list_nth_data (tabs, i);
         ec = tab->editor;
 
-        if ((ec->filename) && editor_buffer_changed (ec)) {
+        /* a buffer still being filled would be saved half loaded */
+        if ((ec->filename) && !ec->loading && editor_buffer_changed (ec)) {
             focus = gtk_window_get_focus (gummi_get_gui ()->mainwindow);
             text = editor_grab_buffer (ec);
             gtk_widget_grab_focus (focus);
@@ -309,40 +713,266 @@ gboolean iofunctions_autosave_cb (void *user) {
     return TRUE;
 }
 
-void scan_directory (const gchar* dirname) {
+static StyJob* sty_job_new (const gchar* path, const gchar* package,
+                            guint64 mtime, goffset size) {
+    StyJob* job = g_new0 (StyJob, 1);
+    job->path = g_strdup (path);
+    job->package = g_strdup (package);
+    job->mtime = mtime;
+    job->size = size;
+    return job;
+}
+
+static void sty_job_free (StyJob* job) {
+    if (job->definitions) g_variant_unref (job->definitions);
+    g_free (job->path);
+    g_free (job->package);
+    g_free (job);
+}
+
+static gchar* sty_cache_get_filename (void) {
+    gchar* tmpdir = C_TMPDIR;
+    gchar* filename = g_build_filename (tmpdir, STY_CACHE_FILE, NULL);
+    g_free (tmpdir);
+    return filename;
+}
+
+static void sty_cache_load (void) {
+    gchar* filename = sty_cache_get_filename ();
+    GMappedFile* mapped = g_mapped_file_new (filename, FALSE, NULL);
+    g_free (filename);
+
+    sty_cache = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                       (GDestroyNotify)g_variant_unref);
+    if (!mapped) return;
+
+    GBytes* bytes = g_mapped_file_get_bytes (mapped);
+    GVariant* cache = g_variant_ref_sink (g_variant_new_from_bytes (
+                G_VARIANT_TYPE (STY_CACHE_TYPE), bytes, FALSE));
+    GVariantIter iter;
+    gchar* path = NULL;
+    GVariant* entry = NULL;
+
+    g_variant_iter_init (&iter, cache);
+    while (g_variant_iter_next (&iter, "{s@(tt" SCAN_DEFINITIONS_TYPE ")}",
+                                &path, &entry)) {
+        g_hash_table_insert (sty_cache, path, entry);
+    }
+
+    g_variant_unref (cache);
+    g_bytes_unref (bytes);
+    g_mapped_file_unref (mapped);
+}
+
+static gboolean sty_cache_save (gpointer user) {
+    GVariantBuilder builder;
+    GHashTableIter iter;
+    gpointer path, entry;
+
+    g_variant_builder_init (&builder, G_VARIANT_TYPE (STY_CACHE_TYPE));
+    g_mutex_lock (&sty_cache_lock);
+    g_hash_table_iter_init (&iter, sty_cache);
+    while (g_hash_table_iter_next (&iter, &path, &entry)) {
+        g_variant_builder_add (&builder, "{s@(tt" SCAN_DEFINITIONS_TYPE ")}",
+                               path, entry);
+    }
+    sty_cache_save_pending = FALSE;
+    g_mutex_unlock (&sty_cache_lock);
+
+    GVariant* cache = g_variant_ref_sink (g_variant_builder_end (&builder));
+    gchar* tmpdir = C_TMPDIR;
+    gchar* filename = sty_cache_get_filename ();
+
+    g_mkdir_with_parents (tmpdir, DIR_PERMS);
+    utils_set_file_contents (filename, g_variant_get_data (cache),
+                             g_variant_get_size (cache));
+
+    g_free (filename);
+    g_free (tmpdir);
+    g_variant_unref (cache);
+    return FALSE;
+}
+
+/* Called with sty_cache_lock held. */
+static void sty_cache_schedule_save (void) {
+    if (!sty_cache_save_pending) {
+        sty_cache_save_pending = TRUE;
+        g_timeout_add_seconds (2, sty_cache_save, NULL);
+    }
+}
+
+/* Main thread: hand the definitions of a package to the completion. */
+static gboolean sty_apply_definitions (gpointer user) {
+    StyJob* job = user;
+    scan_apply_definitions (job->definitions, job->package);
+    sty_job_free (job);
+    return FALSE;
+}
+
+/* Returns a new reference to the definitions cached for path, or NULL if
+ * the file changed since. */
+static GVariant* sty_cache_lookup (const gchar* path, guint64 mtime,
+                                   goffset size) {
+    GVariant* definitions = NULL;
+    GVariant* entry = NULL;
+    guint64 cached_mtime = 0, cached_size = 0;
+
+    g_mutex_lock (&sty_cache_lock);
+    if ((entry = g_hash_table_lookup (sty_cache, path))) {
+        g_variant_get (entry, "(tt@" SCAN_DEFINITIONS_TYPE ")",
+                       &cached_mtime, &cached_size, &definitions);
+        if (cached_mtime != mtime || cached_size != (guint64)size) {
+            g_variant_unref (definitions);
+            definitions = NULL;
+        }
+    }
+    g_mutex_unlock (&sty_cache_lock);
+    return definitions;
+}
+
+static void sty_cache_insert (const gchar* path, guint64 mtime, goffset size,
+                              GVariant* definitions) {
+    GVariant* entry = g_variant_ref_sink (g_variant_new (
+                "(tt@" SCAN_DEFINITIONS_TYPE ")",
+                mtime, (guint64)size, definitions));
+
+    g_mutex_lock (&sty_cache_lock);
+    g_hash_table_replace (sty_cache, g_strdup (path), entry);
+    sty_cache_schedule_save ();
+    g_mutex_unlock (&sty_cache_lock);
+}
+
+/* directory without trailing separators, the dirname of the paths of the
+ * packages in it */
+static gchar* sty_directory_key (const gchar* directory) {
+    gchar* key = g_strdup (directory);
+    const gchar* root = g_path_skip_root (key);
+    gsize min = MAX (root? (gsize)(root - key): 0, 1);
+    gsize len = strlen (key);
+
+    while (len > min && G_IS_DIR_SEPARATOR (key[len - 1]))
+        key[--len] = '\0';
+    return key;
+}
+
+/* Drops the packages cached for dirname, a sty_directory_key, that were not
+ * seen in it, i.e. that were deleted or moved. seen holds the paths of the
+ * packages found. */
+static void sty_cache_evict (const gchar* dirname, GHashTable* seen) {
+    GHashTableIter iter;
+    gpointer path = NULL;
+    gboolean evicted = FALSE;
+
+    g_mutex_lock (&sty_cache_lock);
+    g_hash_table_iter_init (&iter, sty_cache);
+    while (g_hash_table_iter_next (&iter, &path, NULL)) {
+        gchar* parent = g_path_get_dirname (path);
+        if (STR_EQU (parent, dirname) && !g_hash_table_contains (seen, path)) {
+            g_hash_table_iter_remove (&iter);
+            evicted = TRUE;
+        }
+        g_free (parent);
+    }
+    if (evicted) sty_cache_schedule_save ();
+    g_mutex_unlock (&sty_cache_lock);
+}
+
+static void sty_scan_package (StyJob* job) {
+    gchar* text = NULL;
+    gchar* decoded = NULL;
+    gsize length = 0;
+    gint64 start = stats_start ();
+
+    if (!g_file_get_contents (job->path, &text, &length, NULL)) {
+        sty_job_free (job);
+        return;
+    }
+
+    /* Not iofunctions_decode_text (), which may report errors in a dialog */
+    if (!g_utf8_validate (text, length, NULL)) {
+        decoded = g_convert (text, length, "UTF-8", "ISO-8859-1",
+                             NULL, NULL, NULL);
+    }
+
+    job->definitions = g_variant_ref_sink (
+            scan_for_definitions (decoded? decoded: text));
+    sty_cache_insert (job->path, job->mtime, job->size, job->definitions);
+    g_idle_add (sty_apply_definitions, job);
+
+    g_free (decoded);
+    g_free (text);
+    stats_end (STATS_PACKAGE_SCAN, start);
+}
+
+static void sty_scan_directory (StyJob* dir) {
+    GError* err = NULL;
+    gchar* dirname = sty_directory_key (dir->path);
     GFile* directory = g_file_new_for_path (dirname);
-    GFileEnumerator* enumerator = g_file_enumerate_children (directory, "standard::*", G_FILE_QUERY_INFO_NOFOLLOW_SYMLINKS, NULL, NULL);
+    GFileEnumerator* enumerator = g_file_enumerate_children (directory,
+            G_FILE_ATTRIBUTE_STANDARD_NAME ","
+            G_FILE_ATTRIBUTE_STANDARD_SIZE ","
+            G_FILE_ATTRIBUTE_TIME_MODIFIED ","
+            G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC,
+            G_FILE_QUERY_INFO_NONE, NULL, &err);
+    GHashTable* seen = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                              g_free, NULL);
     GFileInfo* info;
-    
-    while ((info = g_file_enumerator_next_file (enumerator, NULL, NULL)) != NULL) {
-        GFile* child = g_file_enumerator_get_child (enumerator, info);
-        gchar* path = g_file_get_path (child);
-        gchar* name = g_file_get_basename (child);
+
+    if (!enumerator) {
+        if (g_error_matches (err, G_IO_ERROR, G_IO_ERROR_NOT_FOUND))
+            sty_cache_evict (dirname, seen);
+        g_error_free (err);
+        goto cleanup;
+    }
+
+    while ((info = g_file_enumerator_next_file (enumerator, NULL, NULL))) {
+        const gchar* name = g_file_info_get_name (info);
+
         if (g_str_has_suffix (name, ".sty")) {
-            gchar* text;
-            gchar* decoded;
-            gchar* package = (gchar*)g_malloc ((strlen(name) - 3)*sizeof(gchar));
-            
-            if (!g_file_get_contents (path, &text, NULL, NULL)) continue;
-            if (NULL == (decoded = iofunctions_decode_text (text))) {
-                g_free (text);
-                continue;
+            gchar* path = g_build_filename (dirname, name, NULL);
+            gchar* package = g_strndup (name, strlen (name) - 4);
+            StyJob* job = sty_job_new (path, package,
+                    g_file_info_get_attribute_uint64 (info,
+                        G_FILE_ATTRIBUTE_TIME_MODIFIED) * G_USEC_PER_SEC
+                    + g_file_info_get_attribute_uint32 (info,
+                        G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC),
+                    g_file_info_get_size (info));
+
+            if ((job->definitions = sty_cache_lookup (path, job->mtime,
+                                                      job->size))) {
+                g_idle_add (sty_apply_definitions, job);
+            } else {
+                g_thread_pool_push (sty_pool, job, NULL);
             }
-            
-            g_strlcpy (package, name, strlen(name) - 3);
-            scan_for_new_envs (decoded, package);
-            scan_for_new_cmds (decoded, package);
-            
-            g_free (text);
-            g_free (decoded);
+            g_hash_table_add (seen, path);
             g_free (package);
         }
-        g_object_unref (child);
-        g_free (path);
-        g_free (name);
         g_object_unref (info);
     }
-    
-    g_object_unref (directory);
     g_object_unref (enumerator);
+    sty_cache_evict (dirname, seen);
+
+cleanup:
+    g_hash_table_unref (seen);
+    g_object_unref (directory);
+    g_free (dirname);
+    sty_job_free (dir);
+}
+
+static void sty_scan_worker (gpointer data, gpointer user) {
+    StyJob* job = data;
+
+    if (job->package)
+        sty_scan_package (job);
+    else
+        sty_scan_directory (job);
+}
+
+void scan_directory (const gchar* dirname) {
+    if (!sty_pool) {
+        sty_cache_load ();
+        sty_pool = g_thread_pool_new (sty_scan_worker, NULL,
+                                      g_get_num_processors (), FALSE, NULL);
+    }
+    g_thread_pool_push (sty_pool, sty_job_new (dirname, NULL, 0, 0), NULL);
 }
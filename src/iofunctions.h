@@ -42,12 +42,24 @@ struct _GuIOFunc {
   GObject* sig_hook;
 };
 
+/* Called once a file is loaded into the buffer of ec */
+typedef void (*GuLoadedFunc) (GuEditor* ec, gpointer user);
+/* Called once the writes of a file are done, saved is FALSE if one failed */
+typedef void (*GuSavedFunc) (const gchar* filename, gboolean saved,
+                             gpointer user);
+
 
 /* Public functions */
 GuIOFunc* iofunctions_init (void);
 void iofunctions_load_default_text (gboolean loopedonce);
 void iofunctions_load_file (GuIOFunc* io, const gchar* filename);
+void iofunctions_when_loaded (GuEditor* ec, GuLoadedFunc func, gpointer user,
+                              GDestroyNotify destroy);
 void iofunctions_save_file (GuIOFunc* io, gchar* filename, gchar *text);
+gboolean iofunctions_is_saving (const gchar* filename);
+void iofunctions_wait_for_save (const gchar* filename, GuSavedFunc func,
+                                gpointer user);
+gboolean iofunctions_wait_for_saves (void);
 gchar* iofunctions_get_swapfile (const gchar* filename);
 gboolean iofunctions_has_swapfile (const gchar* filename);
 void iofunctions_start_autosave (void);
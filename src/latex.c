@@ -43,7 +43,9 @@
 #include "editor.h"
 #include "environment.h"
 #include "external.h"
+#include "gui/gui-main.h"
 #include "gui/gui-preview.h"
+#include "stats.h"
 #include "utils.h"
 
 #include "compile/rubber.h"
@@ -51,18 +53,39 @@
 #include "compile/texlive.h"
 
 extern Gummi* gummi;
+extern GummiGui* gui;
 
-GuLatex* latex_init (void) {
-    GuLatex* l = g_new0 (GuLatex, 1);
-    l->compilelog = NULL;
-    l->modified_since_compile = FALSE;
+static void on_typesetters_detected (GObject* source, GAsyncResult* result,
+                                     gpointer user) {
+    GuLatex* l = user;
 
+    external_detect_finish (result, NULL);
     l->tex_version = texlive_init ();
     rubber_init ();
     latexmk_init ();
+
+    if (gui) gui_update_synctex ();
+}
+
+GuLatex* latex_init (void) {
+    GuLatex* l = g_new0 (GuLatex, 1);
+    l->compilelog = NULL;
+    l->modified_since_compile = FALSE;
     return l;
 }
 
+/**
+ * Detects the installed typesetters in the background. Spawning them for
+ * their versions is slow, so this is done once the window is shown.
+ */
+void latex_detect_typesetters (GuLatex* lc) {
+    static const gchar* const typesetters[] = {
+        C_LATEX, C_PDFLATEX, C_XELATEX, C_LUALATEX, C_RUBBER, C_LATEXMK, NULL
+    };
+
+    external_detect_async (typesetters, on_typesetters_detected, lc);
+}
+
 
 
 gboolean latex_method_active (gchar* method) {
@@ -70,6 +93,7 @@ gboolean latex_method_active (gchar* method) {
 }
 
 gchar* latex_update_workfile (GuEditor* ec) {
+    gint64 start = stats_start ();
     gchar *text;
 
     text = editor_grab_buffer (ec);
@@ -80,6 +104,7 @@ gchar* latex_update_workfile (GuEditor* ec) {
     if (!STR_EQU (text, "")) {
         utils_set_file_contents (ec->workfile, text, -1);
     }
+    stats_end (STATS_WORKFILE, start);
     return text;
 }
 
@@ -126,6 +151,7 @@ gchar* latex_analyse_log (gchar* log, gchar* filename, gchar* basename) {
 
 
 void latex_analyse_errors (GuLatex* lc) {
+    gint64 start = stats_start ();
     gchar* result = NULL;
     GError* err = NULL;
     GRegex* match_str = NULL;
@@ -153,6 +179,14 @@ void latex_analyse_errors (GuLatex* lc) {
         lc->errorlines[0] = -1;
     g_match_info_free (match_info);
     g_regex_unref (match_str);
+    stats_end (STATS_ANALYSE_ERRORS, start);
+}
+
+/* Sets the default typesetter on the main thread and compiles again */
+static gboolean latex_fallback_typesetter (gpointer user) {
+    config_set_string ("Compile", "typesetter", "pdflatex");
+    motion_force_compile (gummi_get_motion ());
+    return FALSE;
 }
 
 gboolean latex_update_pdffile (GuLatex* lc, GuEditor* ec) {
@@ -162,10 +196,12 @@ gboolean latex_update_pdffile (GuLatex* lc, GuEditor* ec) {
 
     if (!lc->modified_since_compile) return cerrors == 0;
 
-    const gchar* typesetter = config_get_string ("Compile", "typesetter");
-    if (!external_exists (typesetter)) {
-        // Set to default first detected typesetter
-        config_set_string ("Compile", "typesetter", "pdflatex");
+    const gchar* typesetter = config_cache.typesetter;
+    if (!external_exists (typesetter) && !STR_EQU (typesetter, "pdflatex")) {
+        // Set to default first detected typesetter, settings are only
+        // changed on the main thread
+        gdk_threads_add_idle (latex_fallback_typesetter, NULL);
+        return FALSE;
     }
 
     /* create compile command */
@@ -176,7 +212,9 @@ gboolean latex_update_pdffile (GuLatex* lc, GuEditor* ec) {
     memset (lc->errorlines, 0, BUFSIZ * sizeof(gint));
 
     /* run pdf compilation */
+    gint64 start = stats_start ();
     Tuple2 cresult = utils_popen_r (command, curdir);
+    stats_end (STATS_TYPESETTER, start);
     cerrors = (glong)cresult.first;
     gchar* coutput = (gchar*)cresult.second;
 
@@ -200,7 +238,7 @@ void latex_update_auxfile (GuEditor* ec) {
                                       "-interaction=nonstopmode "
                                       "--output-directory=\"%s\" \"%s\"",
                                       C_TEXSEC,
-                                      config_get_string ("Compile", "typesetter"),
+                                      config_cache.typesetter,
                                       C_TMPDIR,
                                       ec->workfile);
     Tuple2 res = utils_popen_r (command, dirname);
@@ -298,8 +336,8 @@ gboolean latex_can_synctex (void) {
 
 
 gboolean latex_use_synctex (void) {
-    return (config_get_boolean ("Compile", "synctex") &&
-            config_get_boolean ("Preview", "autosync"));
+    return (config_cache.synctex &&
+            config_cache.autosync);
 }
 
 gboolean latex_use_shellescaping (void) {
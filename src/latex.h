@@ -50,6 +50,7 @@ struct _GuLatex {
 };
 
 GuLatex* latex_init (void);
+void latex_detect_typesetters (GuLatex* lc);
 gboolean latex_precompile_check (gchar* editortext);
 gchar* latex_update_workfile (GuEditor* ec);
 gboolean latex_update_pdffile (GuLatex* lc, GuEditor* ec);
@@ -44,8 +44,10 @@
 #include "iofunctions.h"
 #include "motion.h"
 #include "project.h"
+#include "replay.h"
 #include "signals.h"
 #include "snippets.h"
+#include "stats.h"
 #include "tabmanager.h"
 #include "template.h"
 #include "utils.h"
@@ -54,16 +56,71 @@ extern Gummi* gummi;
 extern GummiGui* gui;
 static int debug = 0;
 static int showversion = 0;
+static int profile = 0;
+static gchar* crashlog = NULL;
+static int showstats = 0;
+static gchar* replayfile = NULL;
 
 static GOptionEntry entries[] = {
     { (const gchar*)"debug", (gchar)'d', 0, G_OPTION_ARG_NONE,
         &debug, (gchar*)"show debug info", NULL},
     { (const gchar*)"version", (gchar)'v', 0, G_OPTION_ARG_NONE,
         &showversion, (gchar*)"show version and exit", NULL},
+    { (const gchar*)"profile-startup", 0, 0, G_OPTION_ARG_NONE,
+        &profile, (gchar*)"show the time taken by each startup phase", NULL},
+    { (const gchar*)"crash-log", 0, 0, G_OPTION_ARG_FILENAME,
+        &crashlog, (gchar*)"write the last log messages to FILE on a crash",
+        (gchar*)"FILE"},
+    { (const gchar*)"stats", 0, 0, G_OPTION_ARG_NONE,
+        &showstats, (gchar*)"print timing statistics as JSON on exit", NULL},
+    { (const gchar*)"replay", 0, 0, G_OPTION_ARG_FILENAME,
+        &replayfile, (gchar*)"replay the edit trace in FILE once started",
+        (gchar*)"FILE"},
     { NULL, 0, 0, G_OPTION_ARG_NONE, NULL, NULL, NULL }
 };
 
+static GTimer* startup_timer = NULL;
+
+/* Logs the time since the start of the previous phase with --profile-startup
+ */
+static void startup_phase (const gchar* phase) {
+    static gdouble last = 0;
+    gdouble now;
+
+    if (!profile) return;
+    now = g_timer_elapsed (startup_timer, NULL) * 1000;
+    slog_fields (L_INFO, "startup", (gint64)((now - last) * 1000),
+                 "%s (total %.1f ms)\n", phase, now);
+    last = now;
+}
+
+/* Subsystems not needed for the first window, loaded when idle after it
+ * was drawn */
+static gboolean startup_deferred (gpointer user) {
+    snippets_load (gummi->snippets);
+    startup_phase ("snippets");
+
+    latex_detect_typesetters (gummi->latex);
+    startup_phase ("typesetter detection");
+
+    if (startup_timer) {
+        g_timer_destroy (startup_timer);
+        startup_timer = NULL;
+    }
+    if (replayfile) replay_start ();
+    return FALSE;
+}
+
+static gboolean on_first_draw (GtkWidget* widget, cairo_t* cr, gpointer user) {
+    g_signal_handlers_disconnect_by_func (widget, on_first_draw, user);
+    startup_phase ("first paint");
+    g_idle_add (startup_deferred, NULL);
+    return FALSE;
+}
+
 int main (int argc, char *argv[]) {
+    startup_timer = g_timer_new ();
+
     /* set up i18n */
     bindtextdomain (C_PACKAGE, GUMMI_LOCALES);
     setlocale (LC_ALL, "");
@@ -84,6 +141,15 @@ int main (int argc, char *argv[]) {
     gdk_threads_init ();
     gtk_init (&argc, &argv);
 
+    /* Initialize logging */
+    slog_init (debug);
+    if (crashlog) slog_set_crash_dump (crashlog);
+    if (replayfile && !replay_load (replayfile, &error))
+        slog (L_FATAL, "Can't read replay trace '%s': %s\n", replayfile,
+              error->message);
+    slog (L_INFO, C_PACKAGE_NAME" version: "C_PACKAGE_VERSION"\n");
+    startup_phase ("gtk");
+
     GError* ui_error = NULL;
     GtkBuilder* builder = gtk_builder_new ();
     gchar* ui = g_build_filename (GUMMI_DATA, "ui", "gummi.glade", NULL);
@@ -100,13 +166,11 @@ int main (int argc, char *argv[]) {
     }
     gtk_builder_set_translation_domain (builder, C_PACKAGE);
     g_free (ui);
-
-    /* Initialize logging */
-    slog_init (debug);
-    slog (L_INFO, C_PACKAGE_NAME" version: "C_PACKAGE_VERSION"\n");
+    startup_phase ("interface file");
 
     // Initialize configuration
     config_init ();
+    startup_phase ("configuration");
 
     /* Initialize signals */
     gummi_signals_register ();
@@ -124,15 +188,17 @@ int main (int argc, char *argv[]) {
 
     gummi = gummi_init (motion, io, latex, biblio, templ, snippets, tabm, proj);
     slog (L_DEBUG, "Gummi created!\n");
+    startup_phase ("subsystems");
 
     /* Initialize GUI */
     gui = gui_init (builder);
+    startup_phase ("main window");
 
     slog_set_gui_parent (gui->mainwindow);
     slog (L_DEBUG, "GummiGui created!\n");
 
     /* Start compile thread */
-    if (external_exists (config_get_string ("Compile", "typesetter"))) {
+    if (external_exists (config_cache.typesetter)) {
         typesetter_setup ();
         motion_start_compile_thread (motion);
     }
@@ -160,11 +226,21 @@ int main (int argc, char *argv[]) {
         }
     }
 
-    if (config_get_boolean ("File", "autosaving")) {
+    if (config_cache.autosaving) {
         iofunctions_start_autosave ();
     }
+    startup_phase ("tabs");
 
+    g_signal_connect_after (gui->mainwindow, "draw",
+                            G_CALLBACK (on_first_draw), NULL);
     gui_main (builder);
+    iofunctions_wait_for_saves ();
     config_save ();
+
+    if (showstats) {
+        gchar* json = stats_to_json ();
+        printf ("%s", json);
+        g_free (json);
+    }
     return 0;
 }
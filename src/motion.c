@@ -53,6 +53,7 @@
 #include "gui/gui-preview.h"
 #include "latex.h"
 #include "snippets.h"
+#include "stats.h"
 #include "utils.h"
 
 extern GummiGui* gui;
@@ -156,6 +157,7 @@ gpointer motion_compile_thread (gpointer data) {
     GuLatex* latex = NULL;
     gboolean precompile_ok = FALSE;
     gchar *editortext;
+    gint64 start = 0;
 
     latex = gummi_get_latex ();
 
@@ -165,7 +167,8 @@ gpointer motion_compile_thread (gpointer data) {
         g_cond_wait (&mc->compile_cv, &mc->compile_mutex);
         slog (L_DEBUG, "Compile thread awoke.\n");
 
-        if (!(editor = gummi_get_active_editor ())) {
+        /* An editor still loading its file is compiled once it's loaded */
+        if (!(editor = gummi_get_active_editor ()) || editor->loading) {
             g_mutex_unlock (&mc->compile_mutex);
             continue;
         }
@@ -181,6 +184,7 @@ gpointer motion_compile_thread (gpointer data) {
 
         gdk_threads_enter ();
         editortext = latex_update_workfile (editor);
+        stats_mark_compile ();
         precompile_ok = latex_precompile_check (editortext);
         g_free (editortext);
         gdk_threads_leave ();
@@ -191,7 +195,10 @@ gpointer motion_compile_thread (gpointer data) {
             continue;
         }
 
+        start = g_get_monotonic_time ();
         latex_update_pdffile (latex, editor);
+        slog_fields (L_DEBUG, "compile", g_get_monotonic_time () - start,
+                     "Typesetter finished\n");
 
         *mc->typesetter_pid = 0;
         g_mutex_unlock (&mc->compile_mutex);
@@ -212,9 +219,12 @@ void motion_force_compile (GuMotion *mc) {
 }
 
 gboolean motion_idle_cb (gpointer user) {
+    gint64 start = stats_start ();
+
     GU_MOTION(user)->key_press_timer = 0;
     if (gui->previewgui->preview_on_idle)
         motion_do_compile (GU_MOTION (user));
+    stats_end (STATS_IDLE_COMPILE, start);
     return FALSE;
 }
 
@@ -236,7 +246,7 @@ gboolean on_key_press_cb (GtkWidget* widget, GdkEventKey* event, void* user) {
     if (!event->is_modifier) {
         motion_stop_timer (GU_MOTION (user));
     }
-    if (config_get_boolean ("Interface", "snippets") &&
+    if (config_cache.snippets &&
         snippets_key_press_cb (gummi_get_snippets (),
                                gummi_get_active_editor (), event))
         return TRUE;
@@ -247,7 +257,7 @@ gboolean on_key_release_cb (GtkWidget* widget, GdkEventKey* event, void* user) {
     if (!event->is_modifier) {
         motion_start_timer (GU_MOTION (user));
     }
-    if (config_get_boolean ("Interface", "snippets") &&
+    if (config_cache.snippets &&
         snippets_key_release_cb (gummi_get_snippets (),
                                  gummi_get_active_editor (), event))
         return TRUE;
@@ -55,7 +55,7 @@ GuProject* project_init (void) {
 
 gboolean project_create_new (const gchar* filename) {
     const gchar* version = g_strdup ("0.6.0");
-    const gchar* csetter = config_get_string ("Compile", "typesetter");
+    const gchar* csetter = config_cache.typesetter;
     const gchar* csteps = config_get_string ("Compile", "steps");
     const gchar* rootfile = g_active_editor->filename;
     // TODO: do we need to encode this text?
@@ -239,3 +239,40 @@ gchar* project_get_value (const gchar* content, const gchar* item) {
     }
     return result;
 }
+
+/* Returns the files of a project, the root file first, as a NULL
+ * terminated array. Unlike project_list_files, this has no side effects
+ * on the open project. */
+gchar** project_get_files (const gchar* projfile) {
+    GPtrArray* files = g_ptr_array_new ();
+    gchar* content = NULL;
+    gchar* root = NULL;
+    gchar** lines = NULL;
+    GError* err = NULL;
+    gint i;
+
+    if (!g_file_get_contents (projfile, &content, NULL, &err)) {
+        slog (L_ERROR, "%s\n", err->message);
+        g_error_free (err);
+    } else {
+        lines = g_strsplit (content, "\n", 0);
+        for (i = 0; lines[i]; ++i) {
+            g_strchomp (lines[i]);
+            if (g_str_has_prefix (lines[i], "root=") && !root)
+                root = g_strdup (lines[i] + 5);
+            else if (g_str_has_prefix (lines[i], "file=") && lines[i][5])
+                g_ptr_array_add (files, g_strdup (lines[i] + 5));
+        }
+        g_strfreev (lines);
+        g_free (content);
+    }
+
+    if (root) {
+        g_ptr_array_add (files, NULL);
+        memmove (files->pdata + 1, files->pdata,
+                 (files->len - 1) * sizeof (gpointer));
+        files->pdata[0] = root;
+    }
+    g_ptr_array_add (files, NULL);
+    return (gchar**)g_ptr_array_free (files, FALSE);
+}
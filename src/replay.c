@@ -0,0 +1,278 @@
+/**
+ * @file   replay.c
+ * @brief  replays recorded edit traces for benchmarks
+ *
+ * Copyright (C) 2009 Gummi Developers
+ * All Rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "replay.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <gtk/gtk.h>
+
+#include "environment.h"
+#include "gui/gui-main.h"
+#include "motion.h"
+#include "stats.h"
+#include "utils.h"
+
+/* A trace is a text file with one step per line, empty lines and lines
+ * starting with '#' are ignored:
+ *
+ *   wait MS      pause for MS milliseconds
+ *   delay MS     type the following text with MS milliseconds per character
+ *   goto LINE    place the cursor at the start of LINE, counted from 1
+ *   type TEXT    insert TEXT at the cursor, C escapes like \n are expanded
+ *   delete N     delete N characters before the cursor
+ *   sync         wait until the preview shows every edit, for 60 s at most
+ *   render       render every page of the preview once
+ *   reset        forget the compile and preview timings recorded so far
+ *   quit         leave Gummi without asking to save
+ */
+typedef enum {
+    REPLAY_WAIT = 0,
+    REPLAY_DELAY,
+    REPLAY_GOTO,
+    REPLAY_TYPE,
+    REPLAY_DELETE,
+    REPLAY_SYNC,
+    REPLAY_RENDER,
+    REPLAY_RESET,
+    REPLAY_QUIT
+} ReplayAction;
+
+static const gchar* replay_actions[] = {
+    "wait", "delay", "goto", "type", "delete", "sync", "render", "reset",
+    "quit", NULL
+};
+
+typedef struct {
+    ReplayAction action;
+    gint count;         /* milliseconds, line or number of characters */
+    gchar* text;
+} ReplayStep;
+
+#define REPLAY_SYNC_TIMEOUT (60 * G_USEC_PER_SEC)
+
+extern Gummi* gummi;
+extern GummiGui* gui;
+
+static GPtrArray* steps = NULL;
+static guint current = 0;
+static gint delay = 0;          /* per character, 0 inserts text at once */
+static const gchar* typed = NULL;
+static gint64 sync_since = 0;
+
+static void replay_step_free (ReplayStep* step) {
+    g_free (step->text);
+    g_free (step);
+}
+
+static ReplayStep* replay_parse_step (const gchar* line, gint lineno,
+                                      GError** err) {
+    ReplayStep* step = NULL;
+    const gchar* arg = line;
+    gsize len = 0;
+    gint i;
+
+    while (*arg && !g_ascii_isspace (*arg)) ++arg;
+    len = arg - line;
+    if (*arg) ++arg;
+
+    for (i = 0; replay_actions[i]; ++i) {
+        if (strlen (replay_actions[i]) == len &&
+            strncmp (replay_actions[i], line, len) == 0)
+            break;
+    }
+    if (!replay_actions[i]) {
+        g_set_error (err, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                     "line %d: unknown step '%.*s'", lineno, (int)len, line);
+        return NULL;
+    }
+
+    step = g_new0 (ReplayStep, 1);
+    step->action = i;
+    switch (step->action) {
+        case REPLAY_WAIT:
+        case REPLAY_DELAY:
+        case REPLAY_GOTO:
+        case REPLAY_DELETE:
+            step->count = atoi (arg);
+            break;
+        case REPLAY_TYPE:
+            step->text = g_strcompress (arg);
+            break;
+        default:
+            break;
+    }
+    return step;
+}
+
+/**
+ * Reads the trace to be replayed by replay_start.
+ */
+gboolean replay_load (const gchar* filename, GError** err) {
+    gchar* contents = NULL;
+    gchar** lines = NULL;
+    gint i;
+
+    if (!g_file_get_contents (filename, &contents, NULL, err))
+        return FALSE;
+
+    steps = g_ptr_array_new_with_free_func ((GDestroyNotify)replay_step_free);
+    lines = g_strsplit (contents, "\n", -1);
+    for (i = 0; lines[i]; ++i) {
+        gchar* line = g_strchug (lines[i]);
+        gsize len = strlen (line);
+        ReplayStep* step = NULL;
+
+        /* Trailing spaces belong to the text of a type step */
+        if (len && line[len - 1] == '\r') line[len - 1] = 0;
+        if (!*line || *line == '#') continue;
+        if (!(step = replay_parse_step (line, i + 1, err))) {
+            g_ptr_array_unref (steps);
+            steps = NULL;
+            break;
+        }
+        g_ptr_array_add (steps, step);
+    }
+    g_strfreev (lines);
+    g_free (contents);
+    return steps != NULL;
+}
+
+static void replay_quit (void) {
+    if (gummi->motion->compile_thread)
+        motion_stop_compile_thread (gummi->motion);
+    gtk_main_quit ();
+}
+
+/* Inserts the text of a type step, one character per call when typing with
+ * a delay. Returns TRUE when the whole text was inserted. */
+static gboolean replay_type (GuEditor* ec, ReplayStep* step) {
+    const gchar* next = NULL;
+
+    if (!typed) typed = step->text;
+    if (!delay) {
+        gtk_text_buffer_insert_at_cursor (GTK_TEXT_BUFFER (ec->buffer),
+                                          typed, -1);
+        typed = NULL;
+        return TRUE;
+    }
+    next = g_utf8_next_char (typed);
+    gtk_text_buffer_insert_at_cursor (GTK_TEXT_BUFFER (ec->buffer),
+                                      typed, next - typed);
+    typed = *next? next: NULL;
+    return typed == NULL;
+}
+
+static void replay_delete (GuEditor* ec, gint count) {
+    GtkTextBuffer* buffer = GTK_TEXT_BUFFER (ec->buffer);
+    GtkTextIter start, end;
+
+    editor_get_current_iter (ec, &end);
+    start = end;
+    gtk_text_iter_backward_chars (&start, count);
+    gtk_text_buffer_delete (buffer, &start, &end);
+}
+
+static void replay_render (void) {
+    gint64 start = g_get_monotonic_time ();
+    gint pages = previewgui_render_all (gui->previewgui);
+    gdouble secs = (g_get_monotonic_time () - start) / (gdouble)G_USEC_PER_SEC;
+
+    slog (L_INFO, "Rendered %d pages in %.3f s (%.1f pages/s)\n", pages, secs,
+          (secs > 0)? pages / secs: 0);
+}
+
+/* Runs steps until one has to wait, then reschedules itself */
+static gboolean replay_run (gpointer user) {
+    GuEditor* ec = gummi_get_active_editor ();
+    guint wait = 0;
+
+    while (current < steps->len && !wait) {
+        ReplayStep* step = g_ptr_array_index (steps, current);
+
+        switch (step->action) {
+            case REPLAY_WAIT:
+                wait = MAX (step->count, 1);
+                break;
+            case REPLAY_DELAY:
+                delay = MAX (step->count, 0);
+                break;
+            case REPLAY_GOTO:
+                if (ec) editor_scroll_to_line (ec, MAX (step->count - 1, 0));
+                break;
+            case REPLAY_TYPE:
+                if (ec && !replay_type (ec, step)) {
+                    wait = delay;
+                    continue;
+                }
+                wait = delay;
+                break;
+            case REPLAY_DELETE:
+                if (ec) replay_delete (ec, step->count);
+                break;
+            case REPLAY_SYNC:
+                if (!sync_since) sync_since = g_get_monotonic_time ();
+                if (stats_edit_pending () && g_get_monotonic_time () -
+                        sync_since < REPLAY_SYNC_TIMEOUT) {
+                    wait = 10;
+                    continue;
+                }
+                if (stats_edit_pending ())
+                    slog (L_WARNING, "Replay: preview not updated in time\n");
+                sync_since = 0;
+                break;
+            case REPLAY_RENDER:
+                replay_render ();
+                break;
+            case REPLAY_RESET:
+                stats_reset ();
+                break;
+            case REPLAY_QUIT:
+                replay_quit ();
+                return FALSE;
+        }
+        ++current;
+    }
+
+    if (current < steps->len)
+        g_timeout_add (wait, replay_run, NULL);
+    else
+        slog (L_INFO, "Replay finished\n");
+    return FALSE;
+}
+
+/**
+ * Starts replaying the trace read by replay_load in the main loop.
+ */
+void replay_start (void) {
+    g_return_if_fail (steps != NULL);
+
+    current = 0;
+    g_idle_add (replay_run, NULL);
+}
@@ -0,0 +1,613 @@
+/**
+ * @file   search.c
+ * @brief  text search shared by the editor and the search window
+ *
+ * Copyright (C) 2009 Gummi Developers
+ * All Rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "search.h"
+
+#include <string.h>
+
+#include "utils.h"
+
+/* A pattern is searched for in UTF-8 text by byte offsets, so that the text
+ * of a whole buffer can be scanned once, and the offsets be converted to
+ * characters as the matches are found.
+ *
+ * Literal terms are located with memchr on their first byte, in both cases
+ * for a caseless search of a letter. Regular expressions, and caseless
+ * search for terms which are not ASCII, go through PCRE. Compiled patterns
+ * are cached, as the same search is usually started over and over. */
+
+#define REGEX_CACHE_SIZE 16
+
+struct _GuSearchPattern {
+    gchar* term;
+    gsize length;
+    gboolean matchcase;
+    gboolean wholeword;
+    gboolean expand;    /* the replacement may refer to groups */
+    GRegex* regex;
+};
+
+static GHashTable* regex_cache = NULL;
+static GMutex regex_cache_lock;
+
+static GRegex* search_regex_get (const gchar* source, GRegexCompileFlags flags,
+                                 GError** err) {
+    gchar* key = g_strdup_printf ("%x:%s", flags, source);
+    GRegex* regex = NULL;
+
+    g_mutex_lock (&regex_cache_lock);
+    if (!regex_cache) {
+        regex_cache = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                             (GDestroyNotify)g_regex_unref);
+    }
+    if ((regex = g_hash_table_lookup (regex_cache, key))) {
+        g_regex_ref (regex);
+        g_free (key);
+    } else if ((regex = g_regex_new (source, flags, 0, err))) {
+        if (g_hash_table_size (regex_cache) >= REGEX_CACHE_SIZE)
+            g_hash_table_remove_all (regex_cache);
+        g_hash_table_insert (regex_cache, key, g_regex_ref (regex));
+    } else {
+        g_free (key);
+    }
+    g_mutex_unlock (&regex_cache_lock);
+    return regex;
+}
+
+/**
+ * Returns the pattern for a search, or NULL and sets err if term is not a
+ * valid regular expression.
+ */
+GuSearchPattern* search_pattern_new (const gchar* term, gboolean matchcase,
+                                     gboolean wholeword, gboolean regex,
+                                     GError** err) {
+    GuSearchPattern* pattern = NULL;
+    GRegexCompileFlags flags = G_REGEX_MULTILINE | G_REGEX_OPTIMIZE;
+    gchar* source = NULL;
+    const gchar* p;
+
+    g_return_val_if_fail (term != NULL, NULL);
+
+    if (!matchcase) flags |= G_REGEX_CASELESS;
+    if (regex) {
+        source = g_strdup (term);
+    } else {
+        for (p = term; !matchcase && *p && !source; ++p) {
+            if ((guchar)*p >= 0x80)
+                source = g_regex_escape_string (term, -1);
+        }
+    }
+
+    pattern = g_new0 (GuSearchPattern, 1);
+    pattern->term = g_strdup (term);
+    pattern->length = strlen (term);
+    pattern->matchcase = matchcase;
+    pattern->wholeword = wholeword;
+    pattern->expand = regex;
+
+    if (source && !(pattern->regex = search_regex_get (source, flags, err))) {
+        search_pattern_free (pattern);
+        pattern = NULL;
+    }
+    g_free (source);
+    return pattern;
+}
+
+void search_pattern_free (GuSearchPattern* pattern) {
+    if (!pattern) return;
+    if (pattern->regex) g_regex_unref (pattern->regex);
+    g_free (pattern->term);
+    g_free (pattern);
+}
+
+/**
+ * Checks that the references to groups in a replacement are valid.
+ */
+gboolean search_pattern_check_replacement (GuSearchPattern* pattern,
+                                           const gchar* replacement,
+                                           GError** err) {
+    if (!pattern->expand) return TRUE;
+    return g_regex_check_replacement (replacement, NULL, err);
+}
+
+static gboolean search_is_word_char (gunichar c) {
+    return g_unichar_isalnum (c) || c == '_';
+}
+
+static gboolean search_is_whole_word (const gchar* text, gsize length,
+                                      gsize mstart, gsize mend) {
+    if (mstart > 0) {
+        const gchar* prev = g_utf8_find_prev_char (text, text + mstart);
+        if (prev && search_is_word_char (g_utf8_get_char (prev)))
+            return FALSE;
+    }
+    if (mend < length && search_is_word_char (g_utf8_get_char (text + mend)))
+        return FALSE;
+    return TRUE;
+}
+
+static gboolean search_find_literal (GuSearchPattern* pattern,
+                                     const gchar* text, gsize length,
+                                     gsize pos, gsize* found) {
+    gchar first = pattern->term[0];
+    gchar other = first;
+    gsize last, next_first = 0, next_other = G_MAXSIZE;
+    gboolean searched = FALSE;
+    const gchar* hit;
+
+    if (length < pattern->length) return FALSE;
+    last = length - pattern->length;
+
+    if (!pattern->matchcase && g_ascii_isalpha (first)) {
+        other = g_ascii_isupper (first)? g_ascii_tolower (first):
+                                         g_ascii_toupper (first);
+        next_other = 0;
+    }
+
+    /* The next occurrence of each case of the first byte is remembered,
+     * so that none of the text is scanned twice */
+    while (pos <= last) {
+        if (!searched || (next_first < pos)) {
+            hit = memchr (text + pos, first, last - pos + 1);
+            next_first = hit? (gsize)(hit - text): G_MAXSIZE;
+        }
+        if (other != first && (!searched || next_other < pos)) {
+            hit = memchr (text + pos, other, last - pos + 1);
+            next_other = hit? (gsize)(hit - text): G_MAXSIZE;
+        }
+        searched = TRUE;
+
+        pos = MIN (next_first, next_other);
+        if (pos == G_MAXSIZE) return FALSE;
+        if (pattern->matchcase?
+                !memcmp (text + pos, pattern->term, pattern->length):
+                !g_ascii_strncasecmp (text + pos, pattern->term,
+                                      pattern->length)) {
+            *found = pos;
+            return TRUE;
+        }
+        ++pos;
+    }
+    return FALSE;
+}
+
+/* Finds the next match, and returns its match info if match_info is set
+ * and the pattern is a regular expression */
+static gboolean search_find (GuSearchPattern* pattern, const gchar* text,
+                             gsize length, gsize offset, gsize* mstart,
+                             gsize* mend, GMatchInfo** match_info) {
+    GMatchInfo* info = NULL;
+    gsize start = 0, end = 0;
+    gint rstart = 0, rend = 0;
+
+    if (!pattern || pattern->length == 0) return FALSE;
+
+    /* A regular expression may match empty at the end of the text, e.g. $
+     * on a last line without a newline */
+    while (offset < length || (pattern->regex && offset == length)) {
+        if (pattern->regex) {
+            if (!g_regex_match_full (pattern->regex, text, length, offset, 0,
+                                     &info, NULL)) {
+                g_match_info_free (info);
+                return FALSE;
+            }
+            g_match_info_fetch_pos (info, 0, &rstart, &rend);
+            start = rstart;
+            end = rend;
+        } else {
+            if (!search_find_literal (pattern, text, length, offset, &start))
+                return FALSE;
+            end = start + pattern->length;
+        }
+
+        if (!pattern->wholeword ||
+                search_is_whole_word (text, length, start, end)) {
+            *mstart = start;
+            *mend = end;
+            if (match_info) *match_info = info;
+            else g_match_info_free (info);
+            return TRUE;
+        }
+        g_match_info_free (info);
+        info = NULL;
+        if (start >= length) break;
+        offset = g_utf8_next_char (text + start) - text;
+    }
+    return FALSE;
+}
+
+/**
+ * Finds the first match of pattern in the length bytes of text, starting
+ * at the byte offset offset, and sets mstart and mend to its byte offsets.
+ * Matches of a regular expression may be empty.
+ */
+gboolean search_pattern_find (GuSearchPattern* pattern, const gchar* text,
+                              gsize length, gsize offset,
+                              gsize* mstart, gsize* mend) {
+    return search_find (pattern, text, length, offset, mstart, mend, NULL);
+}
+
+static void search_append_replacement (GuSearchPattern* pattern,
+                                       GString* result, GMatchInfo* info,
+                                       const gchar* replacement) {
+    gchar* expanded = NULL;
+
+    if (pattern->expand && info &&
+            (expanded = g_match_info_expand_references (info, replacement,
+                                                        NULL))) {
+        g_string_append (result, expanded);
+        g_free (expanded);
+    } else {
+        g_string_append (result, replacement);
+    }
+}
+
+/**
+ * Returns the replacement of the match of pattern which starts at the byte
+ * offset mstart of text, with references to groups expanded.
+ */
+gchar* search_pattern_expand (GuSearchPattern* pattern, const gchar* text,
+                              gsize length, gsize mstart,
+                              const gchar* replacement) {
+    GString* result = g_string_new (NULL);
+    GMatchInfo* info = NULL;
+
+    if (pattern->expand) {
+        g_regex_match_full (pattern->regex, text, length, mstart,
+                            G_REGEX_MATCH_ANCHORED, &info, NULL);
+    }
+    search_append_replacement (pattern, result,
+            info && g_match_info_matches (info)? info: NULL, replacement);
+    g_match_info_free (info);
+    return g_string_free (result, FALSE);
+}
+
+static void search_edit_clear (GuSearchEdit* edit) {
+    g_free (edit->text);
+}
+
+/**
+ * Returns the edits replacing every match of pattern in text, in order, as
+ * an array of GuSearchEdit with byte offsets, from a single pass.
+ */
+GArray* search_pattern_replace_edits (GuSearchPattern* pattern,
+                                      const gchar* text, gsize length,
+                                      const gchar* replacement) {
+    GArray* edits = g_array_new (FALSE, FALSE, sizeof (GuSearchEdit));
+    GMatchInfo* info = NULL;
+    GString* expanded = g_string_new (NULL);
+    GuSearchEdit edit;
+    gsize offset = 0;
+
+    g_array_set_clear_func (edits, (GDestroyNotify)search_edit_clear);
+
+    while (search_find (pattern, text, length, offset, &edit.start,
+                        &edit.end, &info)) {
+        g_string_truncate (expanded, 0);
+        search_append_replacement (pattern, expanded, info, replacement);
+        g_match_info_free (info);
+        info = NULL;
+
+        /* Step over a character after an empty match */
+        if (edit.end == edit.start)
+            offset = g_utf8_next_char (text + edit.end) - text;
+        else
+            offset = edit.end;
+
+        /* an empty match replaced by nothing changes nothing */
+        if (edit.end == edit.start && expanded->len == 0) continue;
+        edit.text = g_strndup (expanded->str, expanded->len);
+        g_array_append_val (edits, edit);
+    }
+    g_string_free (expanded, TRUE);
+    return edits;
+}
+
+/**
+ * Returns text with every match of pattern replaced, and sets count to the
+ * number of replacements.
+ */
+gchar* search_pattern_replace_all (GuSearchPattern* pattern,
+                                   const gchar* text, gsize length,
+                                   const gchar* replacement, guint* count) {
+    GArray* edits = search_pattern_replace_edits (pattern, text, length,
+                                                  replacement);
+    GString* result = g_string_sized_new (length);
+    gsize copied = 0;
+    guint i;
+
+    for (i = 0; i < edits->len; ++i) {
+        GuSearchEdit* edit = &g_array_index (edits, GuSearchEdit, i);
+        g_string_append_len (result, text + copied, edit->start - copied);
+        g_string_append (result, edit->text);
+        copied = edit->end;
+    }
+    g_string_append_len (result, text + copied, length - copied);
+
+    if (count) *count = edits->len;
+    g_array_unref (edits);
+    return g_string_free (result, FALSE);
+}
+
+/* Searching several files runs in a task, which searches each of them
+ * from a thread pool. The matches of a file are passed to the main thread
+ * in batches as soon as they are found, so that they can be shown while
+ * the search goes on. */
+
+#define SEARCH_BATCH_SIZE 256
+
+typedef struct _SearchJob {
+    GuSearchPattern* pattern;
+    GPtrArray* files;
+    gchar* replacement;
+    GCancellable* cancellable;
+    GuSearchMatchFunc func;
+    gpointer func_data;
+    gint count;
+} SearchJob;
+
+typedef struct _SearchBatch {
+    GTask* task;
+    GPtrArray* matches;
+} SearchBatch;
+
+GuSearchFile* search_file_new (const gchar* filename, gchar* snapshot) {
+    GuSearchFile* file = g_new0 (GuSearchFile, 1);
+
+    file->filename = g_strdup (filename);
+    file->snapshot = snapshot;
+    return file;
+}
+
+void search_file_free (GuSearchFile* file) {
+    if (!file) return;
+    g_free (file->filename);
+    g_free (file->snapshot);
+    g_free (file);
+}
+
+void search_match_free (GuSearchMatch* match) {
+    if (!match) return;
+    g_free (match->filename);
+    g_free (match->text);
+    g_free (match);
+}
+
+static void search_job_free (SearchJob* job) {
+    search_pattern_free (job->pattern);
+    g_ptr_array_unref (job->files);
+    g_free (job->replacement);
+    g_free (job);
+}
+
+static gboolean search_deliver_batch (gpointer data) {
+    SearchBatch* batch = data;
+    SearchJob* job = g_task_get_task_data (batch->task);
+
+    if (!g_cancellable_is_cancelled (job->cancellable))
+        job->func (batch->matches, job->func_data);
+    g_ptr_array_unref (batch->matches);
+    g_object_unref (batch->task);
+    g_free (batch);
+    return FALSE;
+}
+
+static void search_post_batch (GTask* task, GPtrArray* matches) {
+    SearchBatch* batch = g_new0 (SearchBatch, 1);
+
+    batch->task = g_object_ref (task);
+    batch->matches = matches;
+    g_idle_add (search_deliver_batch, batch);
+}
+
+/* Files on disk are decoded from the locale's encoding, like documents
+ * opened in the editor, and skipped if that fails */
+static gchar* search_read_file (GuSearchFile* file, gsize* length) {
+    GError* err = NULL;
+    gchar* content = NULL;
+    gchar* decoded = NULL;
+    gsize size = 0;
+
+    if (file->snapshot) {
+        *length = strlen (file->snapshot);
+        return file->snapshot;
+    }
+    if (!g_file_get_contents (file->filename, &content, &size, &err)) {
+        slog (L_WARNING, "%s\n", err->message);
+        g_error_free (err);
+        return NULL;
+    }
+    if (!(decoded = g_locale_to_utf8 (content, size, NULL, length, &err))) {
+        slog (L_WARNING, "%s: %s, skipped\n", file->filename, err->message);
+        g_error_free (err);
+    }
+    g_free (content);
+    return decoded;
+}
+
+/* Lists the matches of a file, keeping track of the line of each match as
+ * the scan goes */
+static void search_file_list (GTask* task, GuSearchFile* file,
+                              const gchar* content, gsize length) {
+    SearchJob* job = g_task_get_task_data (task);
+    GPtrArray* matches = NULL;
+    const gchar* linestart = NULL;
+    const gchar* lineend = NULL;
+    const gchar* p = NULL;
+    gsize offset = 0, mstart = 0, mend = 0;
+    gint line = 0;
+    guint count = 0;
+
+    linestart = p = content;
+    while (search_pattern_find (job->pattern, content, length, offset,
+                                &mstart, &mend)) {
+        GuSearchMatch* match = NULL;
+
+        if (mstart == mend) {
+            offset = g_utf8_next_char (content + mstart) - content;
+            continue;
+        }
+        offset = mend;
+
+        /* count the lines up to the match */
+        while ((p = memchr (p, '\n', content + mstart - p))) {
+            linestart = ++p;
+            ++line;
+        }
+        p = content + mstart;
+        if (!(lineend = memchr (linestart, '\n', content + length - linestart)))
+            lineend = content + length;
+
+        match = g_new0 (GuSearchMatch, 1);
+        match->filename = g_strdup (file->filename);
+        match->line = line;
+        match->text = g_strndup (linestart, lineend - linestart);
+        match->start = g_utf8_pointer_to_offset (linestart, content + mstart);
+        match->end = g_utf8_pointer_to_offset (linestart,
+                MIN (content + mend, lineend));
+
+        if (!matches)
+            matches = g_ptr_array_new_with_free_func (
+                    (GDestroyNotify)search_match_free);
+        g_ptr_array_add (matches, match);
+        ++count;
+
+        if (matches->len == SEARCH_BATCH_SIZE) {
+            if (g_cancellable_is_cancelled (job->cancellable)) break;
+            search_post_batch (task, matches);
+            matches = NULL;
+        }
+    }
+    if (matches) search_post_batch (task, matches);
+    g_atomic_int_add (&job->count, count);
+}
+
+/* Rewrites a file with its matches replaced, encoded back like a document
+ * saved from the editor. The matches are counted, not listed: they are
+ * gone once replaced. */
+static void search_file_replace (SearchJob* job, GuSearchFile* file,
+                                 const gchar* content, gsize length) {
+    gchar* result = NULL;
+    gchar* encoded = NULL;
+    gsize written = 0;
+    guint count = 0;
+    GError* err = NULL;
+
+    if (file->snapshot || g_cancellable_is_cancelled (job->cancellable))
+        return;
+
+    result = search_pattern_replace_all (job->pattern, content, length,
+                                         job->replacement, &count);
+    if (count == 0) {
+        /* nothing to write */
+    } else if (!(encoded = g_locale_from_utf8 (result, -1, NULL, &written,
+                                               &err))) {
+        slog (L_WARNING, "%s: %s, not replaced\n", file->filename,
+              err->message);
+        g_error_free (err);
+    } else if (!g_file_set_contents (file->filename, encoded, written, &err)) {
+        slog (L_ERROR, "%s\n", err->message);
+        g_error_free (err);
+    } else {
+        g_atomic_int_add (&job->count, count);
+    }
+    g_free (encoded);
+    g_free (result);
+}
+
+static void search_file_worker (gpointer data, gpointer user) {
+    GTask* task = user;
+    SearchJob* job = g_task_get_task_data (task);
+    GuSearchFile* file = data;
+    gchar* content = NULL;
+    gsize length = 0;
+
+    if (g_cancellable_is_cancelled (job->cancellable)) return;
+    if (!(content = search_read_file (file, &length))) return;
+
+    if (job->replacement)
+        search_file_replace (job, file, content, length);
+    else
+        search_file_list (task, file, content, length);
+
+    if (content != file->snapshot) g_free (content);
+}
+
+static void search_files_thread (GTask* task, gpointer source,
+                                 gpointer data, GCancellable* cancellable) {
+    SearchJob* job = data;
+    GThreadPool* pool = NULL;
+    guint i;
+
+    pool = g_thread_pool_new (search_file_worker, task,
+                              MAX (1, MIN (job->files->len,
+                                           g_get_num_processors ())),
+                              FALSE, NULL);
+    for (i = 0; i < job->files->len; ++i)
+        g_thread_pool_push (pool, g_ptr_array_index (job->files, i), NULL);
+    g_thread_pool_free (pool, FALSE, TRUE);
+
+    if (!g_task_return_error_if_cancelled (task))
+        g_task_return_int (task, g_atomic_int_get (&job->count));
+}
+
+/**
+ * Searches files for pattern on a thread pool, and passes their matches
+ * in batches to func on the main thread. Files with a snapshot are searched
+ * from it, the others are read from disk. If replacement is set, the
+ * matches in the files read from disk are replaced there and only counted,
+ * and the files with a snapshot are left alone.
+ *
+ * Takes ownership of pattern and files.
+ */
+void search_files_async (GuSearchPattern* pattern, GPtrArray* files,
+                         const gchar* replacement, GCancellable* cancellable,
+                         GuSearchMatchFunc func, gpointer func_data,
+                         GAsyncReadyCallback callback, gpointer user) {
+    GTask* task = g_task_new (NULL, cancellable, callback, user);
+    SearchJob* job = g_new0 (SearchJob, 1);
+
+    job->pattern = pattern;
+    job->files = files;
+    job->replacement = g_strdup (replacement);
+    job->cancellable = cancellable;
+    job->func = func;
+    job->func_data = func_data;
+    g_task_set_task_data (task, job, (GDestroyNotify)search_job_free);
+    g_task_run_in_thread (task, search_files_thread);
+    g_object_unref (task);
+}
+
+/**
+ * Returns the number of matches in the files, or -1 if the search was
+ * cancelled.
+ */
+gint search_files_finish (GAsyncResult* result, GError** err) {
+    return g_task_propagate_int (G_TASK (result), err);
+}
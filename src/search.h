@@ -0,0 +1,98 @@
+/**
+ * @file   search.h
+ * @brief  text search shared by the editor and the search window
+ *
+ * Copyright (C) 2009 Gummi Developers
+ * All Rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __GUMMI_SEARCH_H__
+#define __GUMMI_SEARCH_H__
+
+#include <glib.h>
+#include <gio/gio.h>
+
+#define GU_SEARCH_PATTERN(x) ((GuSearchPattern*)x)
+typedef struct _GuSearchPattern GuSearchPattern;
+
+#define GU_SEARCH_FILE(x) ((GuSearchFile*)x)
+typedef struct _GuSearchFile GuSearchFile;
+
+struct _GuSearchFile {
+    gchar* filename;
+    gchar* snapshot;    /* text of an open document, or NULL */
+};
+
+#define GU_SEARCH_MATCH(x) ((GuSearchMatch*)x)
+typedef struct _GuSearchMatch GuSearchMatch;
+
+struct _GuSearchMatch {
+    gchar* filename;
+    gint line;          /* from 0 */
+    gint start;         /* character offsets of the match in the line */
+    gint end;
+    gchar* text;        /* the line of the match */
+};
+
+#define GU_SEARCH_EDIT(x) ((GuSearchEdit*)x)
+typedef struct _GuSearchEdit GuSearchEdit;
+
+struct _GuSearchEdit {
+    gsize start;        /* offsets of the replaced match */
+    gsize end;
+    gchar* text;        /* its replacement */
+};
+
+typedef void (*GuSearchMatchFunc) (GPtrArray* matches, gpointer user);
+
+GuSearchPattern* search_pattern_new (const gchar* term, gboolean matchcase,
+                                     gboolean wholeword, gboolean regex,
+                                     GError** err);
+void search_pattern_free (GuSearchPattern* pattern);
+gboolean search_pattern_check_replacement (GuSearchPattern* pattern,
+                                           const gchar* replacement,
+                                           GError** err);
+gboolean search_pattern_find (GuSearchPattern* pattern, const gchar* text,
+                              gsize length, gsize offset,
+                              gsize* mstart, gsize* mend);
+gchar* search_pattern_expand (GuSearchPattern* pattern, const gchar* text,
+                              gsize length, gsize mstart,
+                              const gchar* replacement);
+GArray* search_pattern_replace_edits (GuSearchPattern* pattern,
+                                      const gchar* text, gsize length,
+                                      const gchar* replacement);
+gchar* search_pattern_replace_all (GuSearchPattern* pattern,
+                                   const gchar* text, gsize length,
+                                   const gchar* replacement, guint* count);
+
+GuSearchFile* search_file_new (const gchar* filename, gchar* snapshot);
+void search_file_free (GuSearchFile* file);
+void search_match_free (GuSearchMatch* match);
+void search_files_async (GuSearchPattern* pattern, GPtrArray* files,
+                         const gchar* replacement, GCancellable* cancellable,
+                         GuSearchMatchFunc func, gpointer func_data,
+                         GAsyncReadyCallback callback, gpointer user);
+gint search_files_finish (GAsyncResult* result, GError** err);
+
+#endif /* __GUMMI_SEARCH_H__ */
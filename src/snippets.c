@@ -56,8 +56,14 @@ GuSnippets* snippets_init () {
     s->filename = g_strdup (filename);
     s->accel_group = gtk_accel_group_new ();
     s->stackframe = NULL;
-
-    snippets_load (s);
+    s->strings = g_string_chunk_new (4096);
+    s->edited = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+                                       g_free, NULL);
+    s->index = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+    s->templates = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+            (GDestroyNotify)snippet_template_free);
+
+    /* The snippets are loaded by snippets_load after startup */
     return s;
 }
 
@@ -87,10 +93,16 @@ void snippets_set_default (GuSnippets* sc) {
     g_free (snip);
 }
 
+/* The snippets file is read at once and split in place. Each snippet is
+ * stored as a single copy in the string chunk of sc, and indexed by its
+ * key for the lookups on every Tab press. */
 void snippets_load (GuSnippets* sc) {
-    FILE* fh = 0;
-    gchar buf[BUFSIZ];
-    gchar* rot = NULL;
+    GError* err = NULL;
+    GString* body = NULL;
+    gboolean inbody = FALSE;
+    gchar* content = NULL;
+    gchar* line = NULL;
+    gchar* next = NULL;
     gchar* seg = NULL;
     slist* current = NULL;
     slist* prev = NULL;
@@ -98,43 +110,61 @@ void snippets_load (GuSnippets* sc) {
     if (sc->head)
         snippets_clean_up (sc);
 
-    if (! (fh = fopen (sc->filename, "r"))) {
+    if (!g_file_get_contents (sc->filename, &content, NULL, &err)) {
         slog (L_ERROR, "can't find snippets file, reseting to default\n");
+        g_error_free (err);
         snippets_set_default (sc);
         return;
     }
 
-    while (fgets (buf, BUFSIZ, fh)) {
+    body = g_string_new (NULL);
+    for (line = content; line; line = next) {
+        if ((next = strchr (line, '\n'))) *next++ = 0;
+        else if (!*line) break;
+
+        if (line[0] == '\t') {
+            /* Lines of a snippet, appended to the previous node */
+            if (!prev) continue;
+            if (inbody) g_string_append_c (body, '\n');
+            g_string_append (body, line + 1);
+            inbody = TRUE;
+            continue;
+        }
+        if (inbody) {
+            prev->second = g_string_chunk_insert (sc->strings, body->str);
+            g_string_truncate (body, 0);
+            inbody = FALSE;
+        }
+
         current = g_new0 (slist, 1);
-        if (!sc->head)
-            sc->head = prev = current;
-        prev->next = current;
-        buf[strlen (buf) -1] = 0; /* remove trailing '\n' */
-
-        if (buf[0] != '\t') {
-            if ('#' == buf[0] || !strlen(buf)) {
-                current->first = g_strdup (buf);
-            } else {
-                seg = strstr (buf, " ") + 1;
-                current->first = g_strdup ((seg == buf)? "Invalid": seg);
-                snippets_set_accelerator (sc, current->first);
-            }
+        if ('#' == line[0] || !strlen (line)) {
+            current->first = g_string_chunk_insert (sc->strings, line);
         } else {
-            if (!prev->second) {
-                prev->second = g_strdup (buf + 1);
-                continue;
-            }
-            rot = g_strdup (prev->second);
-            g_free (prev->second);
-            prev->second = g_strconcat (rot, "\n", buf + 1, NULL);
-            g_free (rot);
-            g_free (current);
-            current = prev;
+            seg = strchr (line, ' ');
+            current->first = g_string_chunk_insert (sc->strings,
+                    seg? seg + 1: "Invalid");
+            snippets_set_accelerator (sc, current->first);
         }
+        if (prev) prev->next = current;
+        else sc->head = current;
         prev = current;
     }
-    if (prev) prev->next = NULL;
-    fclose (fh);
+    if (inbody)
+        prev->second = g_string_chunk_insert (sc->strings, body->str);
+    g_string_free (body, TRUE);
+    g_free (content);
+
+    snippets_index (sc);
+
+    /* Parse every snippet once, expanding one is then only a copy */
+    for (current = sc->head; current; current = current->next) {
+        if (current->second) {
+            gchar* key = g_strndup (current->first,
+                                    strcspn (current->first, ","));
+            g_hash_table_replace (sc->templates, key,
+                                  snippets_parse (current->second));
+        }
+    }
 }
 
 void snippets_save (GuSnippets* sc) {
@@ -186,12 +216,52 @@ void snippets_clean_up (GuSnippets* sc) {
         prev = current;
     }
     sc->head = NULL;
+    g_hash_table_remove_all (sc->index);
+    g_hash_table_remove_all (sc->templates);
+    g_hash_table_remove_all (sc->edited);
+    g_string_chunk_clear (sc->strings);
+}
+
+/**
+ * Rebuilds the index of the snippets by key, to be called after keys are
+ * changed or snippets are removed from the list. Every snippet with a key
+ * is indexed, with a body or not, the comments are not.
+ */
+void snippets_index (GuSnippets* sc) {
+    slist* current = NULL;
+
+    g_hash_table_remove_all (sc->index);
+    for (current = sc->head; current; current = current->next) {
+        gchar* key = NULL;
+
+        if ('#' == current->first[0] || ',' == current->first[0]
+                || !current->first[0])
+            continue;
+        key = g_strndup (current->first, strcspn (current->first, ","));
+        if (g_hash_table_contains (sc->index, key))
+            g_free (key);
+        else
+            g_hash_table_insert (sc->index, key, current);
+    }
+}
+
+/**
+ * Sets a config or snippet of the list, field, to a copy of text owned by
+ * sc. The copy it replaces is freed if it was set this way too, the ones
+ * loaded from the file are freed when the snippets are reloaded.
+ */
+void snippets_set_string (GuSnippets* sc, gchar** field, const gchar* text) {
+    if (*field) g_hash_table_remove (sc->edited, *field);
+    *field = g_strdup (text);
+    g_hash_table_add (sc->edited, *field);
+}
+
+slist* snippets_find (GuSnippets* sc, const gchar* key) {
+    return g_hash_table_lookup (sc->index, key);
 }
 
 gchar* snippets_get_value (GuSnippets* sc, const gchar* term) {
-    gchar* key = g_strdup_printf ("%s,", term);
-    slist* index = slist_find (sc->head, key, TRUE, FALSE);
-    g_free (key);
+    slist* index = snippets_find (sc, term);
     return (index)? index->second: NULL;
 }
 
@@ -228,6 +298,20 @@ void snippets_set_accelerator (GuSnippets* sc, gchar* config) {
     g_strfreev (configs);
 }
 
+/* Returns the template of the snippet of key, parsing it again if the
+ * snippet was edited since */
+static GuSnippetTemplate* snippets_get_template (GuSnippets* sc,
+                                                 const gchar* key,
+                                                 const gchar* snippet) {
+    GuSnippetTemplate* templ = g_hash_table_lookup (sc->templates, key);
+
+    if (!templ || !STR_EQU (templ->snippet, snippet)) {
+        templ = snippets_parse (snippet);
+        g_hash_table_replace (sc->templates, g_strdup (key), templ);
+    }
+    return templ;
+}
+
 void snippets_activate (GuSnippets* sc, GuEditor* ec, gchar* key) {
     gchar* snippet = NULL;
     GuSnippetInfo* new_info = NULL;
@@ -238,7 +322,7 @@ void snippets_activate (GuSnippets* sc, GuEditor* ec, gchar* key) {
     snippet = snippets_get_value (sc, key);
     g_return_if_fail (snippet != NULL);
 
-    new_info = snippets_parse (snippet);
+    new_info = snippet_info_new (snippets_get_template (sc, key, snippet));
 
     gtk_text_buffer_get_selection_bounds (ec_buffer, &start, &end);
     new_info->start_offset = gtk_text_iter_get_offset (&start);
@@ -334,60 +418,102 @@ gboolean snippets_key_release_cb (GuSnippets* sc, GuEditor* ec, GdkEventKey* ev)
     return FALSE;
 }
 
-GuSnippetInfo* snippets_parse (char* snippet) {
-    gint i, start, end;
-    GError* err = NULL;
-    gchar** result = NULL;
-    GRegex* regex = NULL;
+/* The placeholders of a snippet: the macros ${NAME} or $NAME, then
+ * ${N:text} and $N, in a single pattern so that a snippet is parsed in
+ * one pass */
+#define SNIPPET_MACROS "(FILENAME|BASENAME|SELECTED_TEXT)"
+#define SNIPPET_HOLDERS "\\$\\{" SNIPPET_MACROS "\\}|\\$" SNIPPET_MACROS \
+                        "|\\$\\{([0-9]*):?([^}]*)\\}|\\$([0-9]+)"
+
+static GRegex* holder_regex = NULL;
+
+/* Returns capture group n of a match, or NULL if it did not take part */
+static gchar* snippets_fetch_group (GMatchInfo* match_info, gint n) {
+    gint start = -1, end = -1;
+
+    if (!g_match_info_fetch_pos (match_info, n, &start, &end) || start < 0)
+        return NULL;
+    return g_match_info_fetch (match_info, n);
+}
+
+GuSnippetTemplate* snippets_parse (const gchar* snippet) {
+    GuSnippetTemplate* templ = g_new0 (GuSnippetTemplate, 1);
+    GHashTable* leaders = g_hash_table_new (NULL, NULL);
+    GString* expanded = g_string_new (NULL);
     GMatchInfo* match_info = NULL;
-    const gchar* holders[] = { "\\$([0-9]+)", "\\${([0-9]*):?([^}]*)}",
-                               "\\$(FILENAME)", "\\${(FILENAME)}",
-                               "\\$(BASENAME)", "\\${(BASENAME)}",
-                               "\\$(SELECTED_TEXT)", "\\${(SELECTED_TEXT)}"
-                               /* Anyway to combine these? */
-                            };
-
-    GuSnippetInfo* info = snippet_info_new (snippet);
-
-    for (i = 0; i < sizeof(holders) / sizeof(holders[0]); ++i) {
-        if (! (regex = g_regex_new (holders[i], G_REGEX_DOTALL, 0, &err))) {
-            slog (L_ERROR, "g_regex_new (): %s\n", err->message);
-            g_error_free (err);
-            return info;
-        }
-        g_regex_match (regex, snippet, 0, &match_info);
-        while (g_match_info_matches (match_info)) {
-            result = g_match_info_fetch_all (match_info);
-            g_match_info_fetch_pos (match_info, 0, &start, &end);
-
-            /* Convert start, end to UTF8 offset */
-            char* s_start = g_substr(snippet, 0, start);
-            char* s_end = g_substr(snippet, 0, end);
-            start = g_utf8_strlen(s_start, -1);
-            end = g_utf8_strlen(s_end, -1);
-            g_free(s_start);
-            g_free(s_end);
-
-            if (i < 2) {
-                snippet_info_append_holder (info, atoi (result[1]), start,
-                        end -start, result[2]);
-            } else {
-                snippet_info_append_holder (info, -1, start, end -start,
-                        result[1]);
+    gint start = 0, end = 0, copied = 0;
+    glong chars = 0;
+
+    if (g_once_init_enter (&holder_regex)) {
+        g_once_init_leave (&holder_regex, g_regex_new (SNIPPET_HOLDERS,
+                G_REGEX_DOTALL | G_REGEX_OPTIMIZE, 0, NULL));
+    }
+
+    templ->snippet = g_strdup (snippet);
+    templ->holders = g_ptr_array_new ();
+
+    g_regex_match (holder_regex, snippet, 0, &match_info);
+    while (g_match_info_matches (match_info)) {
+        GuSnippetExpandInfo* einfo = g_new0 (GuSnippetExpandInfo, 1);
+        GuSnippetExpandInfo* leader = NULL;
+        gchar* group = NULL;
+
+        g_match_info_fetch_pos (match_info, 0, &start, &end);
+        g_string_append_len (expanded, snippet + copied, start - copied);
+        chars += g_utf8_strlen (snippet + copied, start - copied);
+        copied = end;
+        einfo->start = chars;
+
+        if ((einfo->text = snippets_fetch_group (match_info, 1))
+                || (einfo->text = snippets_fetch_group (match_info, 2))) {
+            /* Macros are expanded on activation */
+            einfo->group_number = -1;
+        } else {
+            if (!(group = snippets_fetch_group (match_info, 3)))
+                group = snippets_fetch_group (match_info, 5);
+            einfo->group_number = atoi (group);
+            einfo->text = snippets_fetch_group (match_info, 4);
+            if (!einfo->text) einfo->text = g_strdup ("");
+            g_free (group);
+
+            /* Expand text of same group with text of group leader */
+            leader = g_hash_table_lookup (leaders,
+                                          (gpointer)einfo->group_number);
+            if (!leader) {
+                leader = einfo;
+                g_hash_table_insert (leaders, (gpointer)einfo->group_number,
+                                     einfo);
             }
-            slog (L_DEBUG, "Placeholder: (%s, %s, %s)\n", result[0], result[1],
-                    result[2]);
-            g_match_info_next (match_info, NULL);
-            g_strfreev (result);
+            einfo->len = g_utf8_strlen (leader->text, -1);
+            g_string_append (expanded, leader->text);
+            chars += einfo->len;
         }
-        g_regex_unref (regex);
-        g_match_info_free (match_info);
+        slog (L_DEBUG, "Placeholder: (%ld, %d, %s)\n", einfo->group_number,
+              einfo->start, einfo->text);
+        g_ptr_array_add (templ->holders, einfo);
+        g_match_info_next (match_info, NULL);
     }
-    info->einfo = g_list_sort (info->einfo, snippet_info_pos_cmp);
-    info->einfo_sorted = g_list_copy (info->einfo);
-    info->einfo_sorted = g_list_sort (info->einfo_sorted, snippet_info_num_cmp);
+    g_match_info_free (match_info);
+    g_string_append (expanded, snippet + copied);
 
-    return info;
+    templ->expanded = g_string_free (expanded, FALSE);
+    g_hash_table_destroy (leaders);
+    return templ;
+}
+
+void snippet_template_free (GuSnippetTemplate* templ) {
+    guint i;
+
+    if (!templ) return;
+    for (i = 0; i < templ->holders->len; ++i) {
+        GuSnippetExpandInfo* einfo = g_ptr_array_index (templ->holders, i);
+        g_free (einfo->text);
+        g_free (einfo);
+    }
+    g_ptr_array_free (templ->holders, TRUE);
+    g_free (templ->snippet);
+    g_free (templ->expanded);
+    g_free (templ);
 }
 
 void snippets_accel_cb (GtkAccelGroup* accel_group, GObject* obj,
@@ -436,12 +562,24 @@ void snippets_accel_disconnect (GuSnippets* sc, const gchar* key) {
     }
 }
 
-GuSnippetInfo* snippet_info_new (gchar* snippet) {
+GuSnippetInfo* snippet_info_new (GuSnippetTemplate* templ) {
     GuSnippetInfo* info = g_new0 (GuSnippetInfo, 1);
-    info->snippet = g_strdup (snippet);
-    info->expanded = g_strdup (snippet);
+    gint i;
+
+    info->snippet = g_strdup (templ->snippet);
+    info->expanded = g_strdup (templ->expanded);
     info->einfo = NULL;
-    info->einfo_sorted = NULL;
+    for (i = templ->holders->len - 1; i >= 0; --i) {
+        GuSnippetExpandInfo* holder = g_ptr_array_index (templ->holders, i);
+        GuSnippetExpandInfo* einfo = g_new0 (GuSnippetExpandInfo, 1);
+        einfo->group_number = holder->group_number;
+        einfo->start = holder->start;
+        einfo->len = holder->len;
+        einfo->text = g_strdup (holder->text);
+        info->einfo = g_list_prepend (info->einfo, einfo);
+    }
+    info->einfo_sorted = g_list_copy (info->einfo);
+    info->einfo_sorted = g_list_sort (info->einfo_sorted, snippet_info_num_cmp);
     return info;
 }
 
@@ -450,11 +588,15 @@ void snippet_info_free (GuSnippetInfo* info, GuEditor* ec) {
     GList* current = g_list_first (info->einfo);
     while (current) {
         g_free (GU_SNIPPET_EXPAND_INFO (current->data)->text);
+        g_free (current->data);
         current = g_list_next (current);
     }
     g_list_free (info->einfo);
     g_list_free (info->einfo_unique);
     g_list_free (info->einfo_sorted);
+    g_free (info->snippet);
+    g_free (info->expanded);
+    g_free (info->sel_text);
     g_free (info);
 }
 
@@ -576,19 +718,23 @@ void snippet_info_initial_expand (GuSnippetInfo* info, GuEditor* ec) {
         current = g_list_next (current);
     }
     info->einfo_unique = g_list_sort (info->einfo_unique, snippet_info_num_cmp);
+    g_hash_table_destroy (map);
 
+    /* The groups were expanded when the snippet was parsed, only the
+     * macros are left */
     current = g_list_first (info->einfo);
     info->offset = 0;
 
     while (current) {
         GuSnippetExpandInfo* einfo = GU_SNIPPET_EXPAND_INFO (current->data);
-        g_hash_table_lookup_extended (map, (gpointer)einfo->group_number,
-                (gpointer)&key, (gpointer)&value);
+        current = g_list_next (current);
+        if (einfo->group_number != -1) continue;
+
         gtk_text_buffer_get_iter_at_mark (ec_buffer, &start, einfo->left_mark);
         gtk_text_buffer_get_iter_at_mark (ec_buffer, &end, einfo->right_mark);
 
         /* Expand macros */
-        text = GU_SNIPPET_EXPAND_INFO(current->data)->text;
+        text = einfo->text;
         if (STR_EQU (text, "SELECTED_TEXT")) {
             GtkTextIter ms, me;
             gtk_text_buffer_delete (ec_buffer, &start, &end);
@@ -606,15 +752,8 @@ void snippet_info_initial_expand (GuSnippetInfo* info, GuEditor* ec) {
             gtk_text_buffer_delete (ec_buffer, &start, &end);
             gtk_text_buffer_insert (ec_buffer, &start, basename, -1);
             g_free (basename);
-        } else {
-            /* Expand text of same group with with text of group leader */
-            gtk_text_buffer_delete (ec_buffer, &start, &end);
-            gtk_text_buffer_insert (ec_buffer, &start, value->text, -1);
         }
-
-        current = g_list_next (current);
     }
-    g_hash_table_destroy (map);
 }
 
 void snippet_info_sync_group (GuSnippetInfo* info, GuEditor* ec) {
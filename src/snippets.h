@@ -52,6 +52,18 @@ struct _GuSnippetExpandInfo {
 };
 
 
+/* A snippet parsed once: its text with the placeholders expanded to the
+ * text of their group, and the placeholders with offsets in characters */
+#define GU_SNIPPET_TEMPLATE(x) ((GuSnippetTemplate*)x)
+typedef struct _GuSnippetTemplate GuSnippetTemplate;
+
+struct _GuSnippetTemplate {
+    gchar* snippet;
+    gchar* expanded;
+    GPtrArray* holders; /* GuSnippetExpandInfo sorted by start pos */
+};
+
+
 /* Storing single snippet info */
 #define GU_SNIPPET_INFO(x) ((GuSnippetInfo*)x)
 typedef struct _GuSnippetInfo GuSnippetInfo;
@@ -78,6 +90,10 @@ typedef struct _GuSnippets GuSnippets;
 struct _GuSnippets {
     gchar* filename;
     slist* head;
+    GStringChunk* strings;  /* the configs and snippets of head */
+    GHashTable* edited;     /* those set since, owned */
+    GHashTable* index;      /* key -> node of head */
+    GHashTable* templates;  /* key -> GuSnippetTemplate */
     GuSnippetInfo* info;
     GtkAccelGroup* accel_group;
     GList* stackframe;
@@ -89,20 +105,24 @@ void snippets_set_default (GuSnippets* sc);
 void snippets_load (GuSnippets* sc);
 void snippets_save (GuSnippets* sc);
 void snippets_clean_up (GuSnippets* sc);
+void snippets_index (GuSnippets* sc);
+void snippets_set_string (GuSnippets* sc, gchar** field, const gchar* text);
+slist* snippets_find (GuSnippets* sc, const gchar* key);
 gchar* snippets_get_value (GuSnippets* sc, const gchar* term);
 void snippets_set_accelerator (GuSnippets* sc, gchar* config);
 void snippets_activate (GuSnippets* sc, GuEditor* ec, gchar* key);
 void snippets_deactivate (GuSnippets* sc, GuEditor* ec);
 gboolean snippets_key_press_cb (GuSnippets* sc, GuEditor* ec, GdkEventKey* ev);
 gboolean snippets_key_release_cb (GuSnippets* sc, GuEditor* ec, GdkEventKey* ev);
-GuSnippetInfo* snippets_parse (char* snippet);
+GuSnippetTemplate* snippets_parse (const gchar* snippet);
+void snippet_template_free (GuSnippetTemplate* templ);
 void snippets_accel_cb (GtkAccelGroup* accel_group, GObject* obj,
         guint keyval, GdkModifierType mods, Tuple2* udata);
 void snippets_accel_connect (GuSnippets* sc, guint keyval, GdkModifierType mod,
         GClosure* closure);
 void snippets_accel_disconnect (GuSnippets* sc, const gchar* key);
 
-GuSnippetInfo* snippet_info_new (gchar* snippet);
+GuSnippetInfo* snippet_info_new (GuSnippetTemplate* templ);
 void snippet_info_free (GuSnippetInfo* info, GuEditor* ec);
 void snippet_info_append_holder (GuSnippetInfo* info, gint group, gint start,
         gint len, gchar* text);
@@ -0,0 +1,212 @@
+/**
+ * @file   stats.c
+ * @brief  timing spans of the compile and preview pipeline
+ *
+ * Copyright (C) 2009 Gummi Developers
+ * All Rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "stats.h"
+
+#include <string.h>
+
+/* Each span keeps a histogram of its durations in microseconds. A power of
+ * two is split into 8 buckets, so a percentile is off by 12.5% at most. */
+#define STATS_SUB_BITS 3
+#define STATS_SUB_BUCKETS (1 << STATS_SUB_BITS)
+#define STATS_BUCKETS (40 * STATS_SUB_BUCKETS)
+
+typedef struct {
+    guint count;
+    gint64 total;
+    gint64 max;
+    guint buckets[STATS_BUCKETS];
+} GuStatsHistogram;
+
+static const gchar* span_names[STATS_N_SPANS] = {
+    "motion_idle_cb",
+    "latex_update_workfile",
+    "typesetter",
+    "latex_analyse_errors",
+    "previewgui_refresh",
+    "load_document",
+    "do_render",
+    "edit_to_preview",
+    "biblio_parse",
+    "package_scan"
+};
+
+static GuStatsHistogram histograms[STATS_N_SPANS];
+G_LOCK_DEFINE_STATIC (histograms);
+
+/* Time of the latest edit not shown in the preview yet, 0 if none */
+static gint64 pending_edit = 0;
+/* The latest change in the text taken by the compile running, or 0 */
+static gint64 compiled_edit = 0;
+
+static guint stats_bucket (gint64 usec) {
+    gint msb;
+
+    if (usec < STATS_SUB_BUCKETS) return (usec < 0)? 0: usec;
+    msb = g_bit_nth_msf ((gulong)usec, -1);
+    return MIN ((msb - STATS_SUB_BITS) * STATS_SUB_BUCKETS +
+                (usec >> (msb - STATS_SUB_BITS)), STATS_BUCKETS - 1);
+}
+
+/* The middle of the durations counted by a bucket */
+static gdouble stats_bucket_value (guint bucket) {
+    guint exp = 0;
+    gint64 low = bucket;
+
+    if (bucket < STATS_SUB_BUCKETS) return bucket;
+    exp = bucket / STATS_SUB_BUCKETS - 1;
+    low = (gint64)(bucket % STATS_SUB_BUCKETS + STATS_SUB_BUCKETS) << exp;
+    return low + ((1 << exp) - 1) / 2.0;
+}
+
+/**
+ * Records the time since start, taken with stats_start, for span.
+ */
+void stats_end (GuStatsSpan span, gint64 start) {
+    gint64 usec = g_get_monotonic_time () - start;
+    GuStatsHistogram* h = &histograms[span];
+
+    G_LOCK (histograms);
+    h->count++;
+    h->total += usec;
+    h->max = MAX (h->max, usec);
+    h->buckets[stats_bucket (usec)]++;
+    G_UNLOCK (histograms);
+}
+
+/**
+ * Forgets the durations of the compile and preview spans recorded so far.
+ */
+void stats_reset (void) {
+    G_LOCK (histograms);
+    memset (histograms, 0, STATS_BIBLIO_PARSE * sizeof (GuStatsHistogram));
+    pending_edit = 0;
+    compiled_edit = 0;
+    G_UNLOCK (histograms);
+}
+
+/**
+ * Notes a change of the document. Once a compile of the text with it is
+ * previewed, stats_mark_preview records the time since the change as
+ * edit_to_preview.
+ */
+void stats_mark_edit (void) {
+    G_LOCK (histograms);
+    pending_edit = g_get_monotonic_time ();
+    G_UNLOCK (histograms);
+}
+
+/**
+ * Notes that a compile took the text of the document, from the compile
+ * thread. The changes made after it wait for a later compile.
+ */
+void stats_mark_compile (void) {
+    G_LOCK (histograms);
+    compiled_edit = pending_edit;
+    G_UNLOCK (histograms);
+}
+
+void stats_mark_preview (void) {
+    gint64 start;
+
+    G_LOCK (histograms);
+    start = compiled_edit;
+    compiled_edit = 0;
+    if (pending_edit == start) pending_edit = 0;
+    G_UNLOCK (histograms);
+
+    if (start) stats_end (STATS_EDIT_TO_PREVIEW, start);
+}
+
+gboolean stats_edit_pending (void) {
+    gboolean pending;
+
+    G_LOCK (histograms);
+    pending = (pending_edit != 0);
+    G_UNLOCK (histograms);
+    return pending;
+}
+
+static gdouble stats_percentile (GuStatsHistogram* h, gdouble percent) {
+    guint rank = (guint)(h->count * percent / 100.0 + 0.5);
+    guint seen = 0;
+    guint i;
+
+    rank = CLAMP (rank, 1, h->count);
+    for (i = 0; i < STATS_BUCKETS; ++i) {
+        seen += h->buckets[i];
+        if (seen >= rank)
+            return MIN (stats_bucket_value (i), (gdouble)h->max);
+    }
+    return h->max;
+}
+
+void stats_get_summary (GuStatsSpan span, GuStatsSummary* summary) {
+    GuStatsHistogram* h = &histograms[span];
+
+    memset (summary, 0, sizeof (GuStatsSummary));
+    summary->name = span_names[span];
+
+    G_LOCK (histograms);
+    if (h->count) {
+        summary->count = h->count;
+        summary->mean = h->total / (gdouble)h->count / 1000;
+        summary->p50 = stats_percentile (h, 50) / 1000;
+        summary->p95 = stats_percentile (h, 95) / 1000;
+        summary->p99 = stats_percentile (h, 99) / 1000;
+        summary->max = h->max / 1000.0;
+    }
+    G_UNLOCK (histograms);
+}
+
+/**
+ * Returns the summaries of all spans as a JSON object, durations are in
+ * milliseconds.
+ */
+gchar* stats_to_json (void) {
+    GString* json = g_string_new ("{\n");
+    GuStatsSummary s;
+    gchar buf[5][G_ASCII_DTOSTR_BUF_SIZE];
+    guint i;
+
+    for (i = 0; i < STATS_N_SPANS; ++i) {
+        stats_get_summary (i, &s);
+        g_string_append_printf (json, "  \"%s\": {\"count\": %u, "
+                "\"mean_ms\": %s, \"p50_ms\": %s, \"p95_ms\": %s, "
+                "\"p99_ms\": %s, \"max_ms\": %s}%s\n", s.name, s.count,
+                g_ascii_formatd (buf[0], sizeof buf[0], "%.3f", s.mean),
+                g_ascii_formatd (buf[1], sizeof buf[1], "%.3f", s.p50),
+                g_ascii_formatd (buf[2], sizeof buf[2], "%.3f", s.p95),
+                g_ascii_formatd (buf[3], sizeof buf[3], "%.3f", s.p99),
+                g_ascii_formatd (buf[4], sizeof buf[4], "%.3f", s.max),
+                (i + 1 < STATS_N_SPANS)? ",": "");
+    }
+    g_string_append (json, "}\n");
+    return g_string_free (json, FALSE);
+}
@@ -0,0 +1,74 @@
+/**
+ * @file   stats.h
+ * @brief  timing spans of the compile and preview pipeline
+ *
+ * Copyright (C) 2009 Gummi Developers
+ * All Rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use,
+ * copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following
+ * conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT
+ * HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+ * WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __GUMMI_STATS_H__
+#define __GUMMI_STATS_H__
+
+#include <glib.h>
+
+/* The spans between a keystroke and the updated preview */
+typedef enum {
+    STATS_IDLE_COMPILE = 0, /* motion_idle_cb */
+    STATS_WORKFILE,         /* latex_update_workfile */
+    STATS_TYPESETTER,       /* typesetter run, wall time */
+    STATS_ANALYSE_ERRORS,   /* latex_analyse_errors */
+    STATS_PREVIEW_REFRESH,  /* previewgui_refresh */
+    STATS_LOAD_DOCUMENT,    /* load_document */
+    STATS_RENDER,           /* do_render */
+    STATS_EDIT_TO_PREVIEW,  /* last edit until its preview is shown */
+    /* scans of the document resources, kept by stats_reset */
+    STATS_BIBLIO_PARSE,     /* parsing the bibliographies of a document */
+    STATS_PACKAGE_SCAN,     /* scanning a local .sty file */
+    STATS_N_SPANS
+} GuStatsSpan;
+
+/* Durations in milliseconds */
+typedef struct {
+    const gchar* name;
+    guint count;
+    gdouble mean;
+    gdouble p50;
+    gdouble p95;
+    gdouble p99;
+    gdouble max;
+} GuStatsSummary;
+
+#define stats_start() g_get_monotonic_time ()
+
+void stats_end (GuStatsSpan span, gint64 start);
+void stats_get_summary (GuStatsSpan span, GuStatsSummary* summary);
+gchar* stats_to_json (void);
+void stats_reset (void);
+
+void stats_mark_edit (void);
+void stats_mark_compile (void);
+void stats_mark_preview (void);
+gboolean stats_edit_pending (void);
+
+#endif /* __GUMMI_STATS_H__ */
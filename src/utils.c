@@ -28,6 +28,8 @@
  */
 
 
+#include <fcntl.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdarg.h>
 #include <stdlib.h>
@@ -71,15 +73,280 @@
 #endif
 
 
-static gint slog_debug = 0;
+/* Messages are formatted by the logging thread into a record and pushed
+ * into a ring of that thread, without locking. A writer thread drains the
+ * rings in order and writes each batch to stderr at once, so the lines of
+ * different threads don't interleave. The last records written are kept
+ * for a crash dump. */
+#define SLOG_RING_SIZE 256
+#define SLOG_HISTORY_SIZE 256
+
+typedef struct {
+    guint seq;
+    gint level;
+    gboolean thread;            /* not logged by the main thread */
+    const gchar* subsystem;
+    gint64 duration;
+    gchar* message;
+} SlogRecord;
+
+/* Single producer (its thread) and single consumer (the drain) ring */
+typedef struct _SlogRing {
+    SlogRecord* slots[SLOG_RING_SIZE];
+    gint head;                  /* next slot written, by the producer */
+    gint tail;                  /* next slot read, by the consumer */
+    gint dead;                  /* the thread exited */
+    struct _SlogRing* next;
+} SlogRing;
+
+gint slog_debug = 0;
 static GtkWindow* parent = 0;
 GThread* main_thread = 0;
 extern pid_t typesetter_pid;
 
+static SlogRing* slog_rings = NULL;
+static GMutex slog_rings_lock;
+static GMutex slog_drain_lock;
+static GMutex slog_wake_lock;
+static GCond slog_wake_cond;
+static gint slog_writer_idle = 0;
+static gint slog_seq = 0;
+static GThread* slog_writer = NULL;
+static SlogRecord* slog_history[SLOG_HISTORY_SIZE];
+static guint slog_history_pos = 0;
+static gchar* slog_crash_file = NULL;
+
+static void slog_ring_release (gpointer ring) {
+    g_atomic_int_set (&((SlogRing*)ring)->dead, TRUE);
+}
+
+static GPrivate slog_ring_key = G_PRIVATE_INIT (slog_ring_release);
+
+static void slog_record_free (SlogRecord* record) {
+    if (!record) return;
+    g_free (record->message);
+    g_free (record);
+}
+
+static gchar* slog_record_format (SlogRecord* record) {
+    GString* line = g_string_new (NULL);
+    gint level = record->level;
+
+    if (record->thread)
+        g_string_append (line, slogmsg_thread);
+
+    if (L_IS_TYPE (level, L_DEBUG))
+        g_string_append (line, slogmsg_debug);
+    else if (L_IS_TYPE (level, L_FATAL) || L_IS_TYPE (level, L_G_FATAL))
+        g_string_append (line, slogmsg_fatal);
+    else if (L_IS_TYPE (level, L_ERROR) || L_IS_TYPE (level, L_G_ERROR))
+        g_string_append (line, slogmsg_error);
+    else if (L_IS_TYPE (level, L_WARNING))
+        g_string_append (line, slogmsg_warning);
+    else
+        g_string_append (line, slogmsg_info);
+
+    if (record->subsystem && record->duration >= 0)
+        g_string_append_printf (line, "[%s %.1f ms] ", record->subsystem,
+                                record->duration / 1000.0);
+    else if (record->subsystem)
+        g_string_append_printf (line, "[%s] ", record->subsystem);
+    else if (record->duration >= 0)
+        g_string_append_printf (line, "[%.1f ms] ",
+                                record->duration / 1000.0);
+    g_string_append (line, record->message);
+    return g_string_free (line, FALSE);
+}
+
+static gint slog_record_compare (gconstpointer a, gconstpointer b) {
+    guint x = (*(SlogRecord**)a)->seq;
+    guint y = (*(SlogRecord**)b)->seq;
+    return (gint)(x - y);
+}
+
+/* Writes the records of all rings in the order they were logged */
+static void slog_drain (void) {
+    GPtrArray* records = g_ptr_array_new ();
+    GString* output = NULL;
+    SlogRing** link = NULL;
+    guint i;
+
+    g_mutex_lock (&slog_drain_lock);
+    g_mutex_lock (&slog_rings_lock);
+    for (link = &slog_rings; *link;) {
+        SlogRing* ring = *link;
+        gint head = g_atomic_int_get (&ring->head);
+        gint tail = ring->tail;
+
+        for (; tail != head; ++tail)
+            g_ptr_array_add (records, ring->slots[tail % SLOG_RING_SIZE]);
+        g_atomic_int_set (&ring->tail, tail);
+
+        /* The thread can't push anymore once it is dead */
+        if (g_atomic_int_get (&ring->dead) &&
+            g_atomic_int_get (&ring->head) == tail) {
+            *link = ring->next;
+            g_free (ring);
+        } else {
+            link = &ring->next;
+        }
+    }
+    g_mutex_unlock (&slog_rings_lock);
+
+    if (records->len) {
+        g_ptr_array_sort (records, slog_record_compare);
+        output = g_string_new (NULL);
+        for (i = 0; i < records->len; ++i) {
+            SlogRecord* record = g_ptr_array_index (records, i);
+            gchar* line = slog_record_format (record);
+
+            g_string_append (output, line);
+            g_free (line);
+            slog_record_free (slog_history[slog_history_pos]);
+            slog_history[slog_history_pos] = record;
+            slog_history_pos = (slog_history_pos + 1) % SLOG_HISTORY_SIZE;
+        }
+        fwrite (output->str, 1, output->len, stderr);
+        fflush (stderr);
+        g_string_free (output, TRUE);
+    }
+    g_mutex_unlock (&slog_drain_lock);
+    g_ptr_array_free (records, TRUE);
+}
+
+static gboolean slog_pending (void) {
+    gboolean pending = FALSE;
+    SlogRing* ring = NULL;
+
+    g_mutex_lock (&slog_rings_lock);
+    for (ring = slog_rings; ring && !pending; ring = ring->next)
+        pending = g_atomic_int_get (&ring->head) !=
+                  g_atomic_int_get (&ring->tail);
+    g_mutex_unlock (&slog_rings_lock);
+    return pending;
+}
+
+static gpointer slog_writer_thread (gpointer data) {
+    while (TRUE) {
+        slog_drain ();
+
+        /* Sleep until a producer finds the writer idle. Checking for records
+         * after going idle catches the ones pushed meanwhile. */
+        g_mutex_lock (&slog_wake_lock);
+        g_atomic_int_set (&slog_writer_idle, TRUE);
+        if (slog_pending ())
+            g_atomic_int_set (&slog_writer_idle, FALSE);
+        while (g_atomic_int_get (&slog_writer_idle))
+            g_cond_wait (&slog_wake_cond, &slog_wake_lock);
+        g_mutex_unlock (&slog_wake_lock);
+    }
+    return NULL;
+}
+
+static SlogRing* slog_get_ring (void) {
+    SlogRing* ring = g_private_get (&slog_ring_key);
+
+    if (!ring) {
+        ring = g_new0 (SlogRing, 1);
+        g_private_set (&slog_ring_key, ring);
+        g_mutex_lock (&slog_rings_lock);
+        ring->next = slog_rings;
+        slog_rings = ring;
+        g_mutex_unlock (&slog_rings_lock);
+    }
+    return ring;
+}
+
+static void slog_push (SlogRecord* record) {
+    SlogRing* ring = NULL;
+    gint head;
+
+    if (!slog_writer) {
+        /* Not initialized yet, nothing else is logging */
+        gchar* line = slog_record_format (record);
+        fputs (line, stderr);
+        g_free (line);
+        slog_record_free (record);
+        return;
+    }
+
+    ring = slog_get_ring ();
+    head = ring->head;
+    while (head - g_atomic_int_get (&ring->tail) >= SLOG_RING_SIZE) {
+        /* Full, write out the records of all threads in this one */
+        slog_drain ();
+    }
+    ring->slots[head % SLOG_RING_SIZE] = record;
+    g_atomic_int_set (&ring->head, head + 1);
+
+    if (g_atomic_int_compare_and_exchange (&slog_writer_idle, TRUE, FALSE)) {
+        g_mutex_lock (&slog_wake_lock);
+        g_cond_signal (&slog_wake_cond);
+        g_mutex_unlock (&slog_wake_lock);
+    }
+}
+
+/**
+ * Writes the pending messages of all threads out.
+ */
+void slog_flush (void) {
+    if (slog_writer) slog_drain ();
+}
+
+static void slog_crash_write (int fd, SlogRecord* record) {
+    /* Only async-signal-safe calls here */
+    const gchar* message = NULL;
+
+    if (!record || !(message = record->message)) return;
+    if (write (fd, message, strlen (message)) < 0) return;
+}
+
+static void slog_crash_handler (int sig) {
+    SlogRing* ring = NULL;
+    guint i;
+    int fd;
+
+    signal (sig, SIG_DFL);
+    fd = open (slog_crash_file, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (fd >= 0) {
+        for (i = 0; i < SLOG_HISTORY_SIZE; ++i)
+            slog_crash_write (fd, slog_history[(slog_history_pos + i)
+                                              % SLOG_HISTORY_SIZE]);
+        /* The messages not written out yet, in the order of each thread */
+        for (ring = slog_rings; ring; ring = ring->next) {
+            gint tail;
+            for (tail = ring->tail; tail != ring->head; ++tail)
+                slog_crash_write (fd, ring->slots[tail % SLOG_RING_SIZE]);
+        }
+        close (fd);
+    }
+    raise (sig);
+}
+
+/**
+ * Dumps the last messages logged to filename if Gummi crashes, including
+ * the ones not written out yet.
+ */
+void slog_set_crash_dump (const gchar* filename) {
+    g_free (slog_crash_file);
+    slog_crash_file = g_strdup (filename);
+
+    signal (SIGSEGV, slog_crash_handler);
+    signal (SIGABRT, slog_crash_handler);
+    signal (SIGFPE, slog_crash_handler);
+    signal (SIGILL, slog_crash_handler);
+#ifdef SIGBUS
+    signal (SIGBUS, slog_crash_handler);
+#endif
+}
 
 void slog_init (gint debug) {
     slog_debug = debug;
     main_thread = g_thread_self ();
+    if (!slog_writer) {
+        slog_writer = g_thread_new ("slog", slog_writer_thread, NULL);
+        atexit (slog_flush);
+    }
 }
 
 gboolean in_debug_mode() {
@@ -90,30 +357,27 @@ void slog_set_gui_parent (GtkWindow* p) {
     parent = p;
 }
 
-void slog (gint level, const gchar *fmt, ...) {
-    gchar message[BUFSIZ];
+/**
+ * Use the slog and slog_fields macros instead, they skip the disabled
+ * levels without evaluating the arguments.
+ */
+void slog_write (gint level, const gchar* subsystem, gint64 duration,
+                 const gchar *fmt, ...) {
+    SlogRecord* record = g_new0 (SlogRecord, 1);
+    gchar* message = NULL;
     va_list vap;
 
-    if (L_IS_TYPE (level, L_DEBUG) && !slog_debug) return;
-
-    if (g_thread_self () != main_thread)
-        g_fprintf (stderr, "%s", slogmsg_thread);
-
-    if (L_IS_TYPE (level, L_DEBUG))
-        g_fprintf (stderr, "%s", slogmsg_debug);
-    else if (L_IS_TYPE (level, L_FATAL) || L_IS_TYPE (level, L_G_FATAL))
-        g_fprintf (stderr, "%s", slogmsg_fatal);
-    else if (L_IS_TYPE (level, L_ERROR) || L_IS_TYPE (level, L_G_ERROR))
-        g_fprintf (stderr, "%s", slogmsg_error);
-    else if (L_IS_TYPE (level, L_WARNING))
-        g_fprintf (stderr, "%s", slogmsg_warning);
-    else
-        g_fprintf (stderr, "%s", slogmsg_info);
-
     va_start (vap, fmt);
-    vsnprintf (message, BUFSIZ, fmt, vap);
+    message = g_strdup_vprintf (fmt, vap);
     va_end (vap);
-    fprintf (stderr, "%s", message);
+
+    record->seq = (guint)g_atomic_int_add (&slog_seq, 1);
+    record->level = level;
+    record->thread = main_thread && g_thread_self () != main_thread;
+    record->subsystem = subsystem;
+    record->duration = duration;
+    record->message = L_IS_GUI (level)? g_strdup (message): message;
+    slog_push (record);
 
     if (L_IS_GUI (level)) {
         GtkWidget* dialog;
@@ -133,6 +397,7 @@ void slog (gint level, const gchar *fmt, ...) {
 
         gtk_dialog_run (GTK_DIALOG (dialog));
         gtk_widget_destroy (dialog);
+        g_free (message);
     }
 
     if (!L_IS_TYPE (level, L_INFO) &&
@@ -490,85 +755,191 @@ slist* slist_remove (slist* head, slist* node) {
     return head;
 }
 
-void scan_for_labels (gchar* content) {
-    GRegex* regex = NULL;
-    GMatchInfo* match_info;
-    
-    regex = g_regex_new ("\\\\label{\\s*([^{}\\s]*)\\s*}",
-        G_REGEX_MULTILINE, 0, NULL);
-    g_regex_match (regex, content, 0, &match_info);
-    while (g_match_info_matches (match_info)) {
-        gchar** result = g_match_info_fetch_all (match_info);
-        if (result[1]) gu_completion_add_ref_choice (gu_completion_get_default (), result[1]);
-        g_match_info_next (match_info, NULL);
-        g_strfreev (result);
+/* The scanning regexes are compiled once and shared, matching with a GRegex
+ * is thread-safe. */
+static GRegex* label_regex = NULL;
+static GRegex* bibitem_regex = NULL;
+static GRegex* newenv_regex = NULL;
+static GRegex* newcmd_regex = NULL;
+
+static GRegex* scan_regex (GRegex** regex, const gchar* pattern) {
+    if (g_once_init_enter (regex)) {
+        g_once_init_leave (regex, g_regex_new (pattern,
+            G_REGEX_MULTILINE | G_REGEX_OPTIMIZE, 0, NULL));
     }
-    
-    g_match_info_free (match_info);
-    g_regex_unref (regex);
+    return *regex;
 }
 
-void scan_for_bibitems (gchar* content) {
-    GRegex* regex = NULL;
+/* Collect the first capture group of every match of regex in content.
+ * The matches are handed to the completion provider in a single call per
+ * scan, see scan_for_labels () and friends. */
+static GPtrArray* scan_for_matches (GRegex* regex, const gchar* content) {
     GMatchInfo* match_info;
-    
-    regex = g_regex_new ("\\\\bibitem{\\s*([^{}\\s]*)\\s*}",
-        G_REGEX_MULTILINE, 0, NULL);
+    GPtrArray* matches = g_ptr_array_new_with_free_func (g_free);
+
     g_regex_match (regex, content, 0, &match_info);
     while (g_match_info_matches (match_info)) {
-        gchar** result = g_match_info_fetch_all (match_info);
-        if (result[1]) gu_completion_add_citation_choice (gu_completion_get_default (), result[1]);
+        gchar* result = g_match_info_fetch (match_info, 1);
+        if (result) g_ptr_array_add (matches, result);
         g_match_info_next (match_info, NULL);
-        g_strfreev (result);
     }
-    
+
     g_match_info_free (match_info);
-    g_regex_unref (regex);
+    return matches;
 }
 
-void scan_for_new_envs (gchar* content, gchar* package) {
-    GRegex* regex = NULL;
+static GPtrArray* scan_for_label_names (const gchar* content) {
+    return scan_for_matches (scan_regex (&label_regex,
+        "\\\\label{\\s*([^{}\\s]*)\\s*}"), content);
+}
+
+static GPtrArray* scan_for_bibitem_names (const gchar* content) {
+    return scan_for_matches (scan_regex (&bibitem_regex,
+        "\\\\bibitem{\\s*([^{}\\s]*)\\s*}"), content);
+}
+
+static GPtrArray* scan_for_env_definitions (const gchar* content) {
+    return scan_for_matches (scan_regex (&newenv_regex,
+        "\\\\newenvironment\\*?{\\s*([^{}\\s]*)\\s*}"), content);
+}
+
+/* Add (name, number of arguments, first argument optional) to cmds for
+ * every \newcommand and \renewcommand in content. */
+static void scan_for_cmd_definitions (const gchar* content,
+                                      GVariantBuilder* cmds) {
     GMatchInfo* match_info;
-    
-    regex = g_regex_new ("\\\\newenvironment\\*?{\\s*([^{}\\s]*)\\s*}",
-        G_REGEX_MULTILINE, 0, NULL);
-    g_regex_match (regex, content, 0, &match_info);
+
+    g_regex_match (scan_regex (&newcmd_regex,
+        "\\\\(?:re)?newcommand\\*?{\\s*([^{}\\[\\]\\s]*)\\s*}\\s*(?:\\[\\s*(\\d)\\s*\\])?\\s*(?:\\[\\s*([^{}\\[\\]\\s]*)\\s*\\])?"),
+        content, 0, &match_info);
     while (g_match_info_matches (match_info)) {
         gchar** result = g_match_info_fetch_all (match_info);
-        if (result[1]) gu_completion_add_environment (gu_completion_get_default (), result[1], package);
+        if (result[1]) {
+            gint n_arg = result[2]? atoi (result[2]): 0;
+            g_variant_builder_add (cmds, "(sib)", result[1], n_arg,
+                                   result[2] != NULL && result[3] != NULL);
+        }
         g_match_info_next (match_info, NULL);
         g_strfreev (result);
     }
-    
+
     g_match_info_free (match_info);
-    g_regex_unref (regex);
 }
 
-void scan_for_new_cmds (gchar* content, gchar* package) {
-    GRegex* regex = NULL;
-    GMatchInfo* match_info;
-    
-    regex = g_regex_new ("\\\\(?:re)?newcommand\\*?{\\s*([^{}\\[\\]\\s]*)\\s*}\\s*(?:\\[\\s*(\\d)\\s*\\])?\\s*(?:\\[\\s*([^{}\\[\\]\\s]*)\\s*\\])?",
-        G_REGEX_MULTILINE, 0, NULL);
-    g_regex_match (regex, content, 0, &match_info);
-    while (g_match_info_matches (match_info)) {
-        gchar** result = g_match_info_fetch_all (match_info);
-        gint n_arg = 0;
+static void apply_cmd_definitions (GVariant* cmds, const gchar* package) {
+    GVariantIter iter;
+    const gchar* name = NULL;
+    gint n_arg = 0;
+    gboolean first_arg_opt = FALSE;
+    gint i;
+
+    g_variant_iter_init (&iter, cmds);
+    while (g_variant_iter_next (&iter, "(&sib)", &name, &n_arg, &first_arg_opt)) {
         gchar** arg_names = NULL;
-        gint i;
-        if (!result[1]) continue;
-        if (result[2]) n_arg = atoi (result[2]);
         if (n_arg != 0) {
             arg_names = g_malloc ((n_arg+1)*sizeof(gchar*));
             for (i = 0; i < n_arg; i++) arg_names[i] = g_strdup_printf ("arg%i", i);
             arg_names[n_arg] = NULL;
         }
-        gu_completion_add_command (gu_completion_get_default (), result[1], arg_names, n_arg, result[2] != NULL && result[3] != NULL, package);
-        g_match_info_next (match_info, NULL);
-        g_strfreev (result);
+        gu_completion_add_command (gu_completion_get_default (), name,
+                                   arg_names, n_arg, first_arg_opt, package);
         g_strfreev (arg_names);
     }
-    
-    g_match_info_free (match_info);
-    g_regex_unref (regex);
+}
+
+void scan_for_labels (gchar* content) {
+    GPtrArray* labels = scan_for_label_names (content);
+    gu_completion_add_ref_choices (gu_completion_get_default (),
+        (gchar**)labels->pdata, labels->len);
+    g_ptr_array_free (labels, TRUE);
+}
+
+void scan_for_bibitems (gchar* content) {
+    GPtrArray* bibitems = scan_for_bibitem_names (content);
+    gu_completion_add_citation_choices (gu_completion_get_default (),
+        (gchar**)bibitems->pdata, bibitems->len);
+    g_ptr_array_free (bibitems, TRUE);
+}
+
+void scan_for_new_envs (gchar* content, gchar* package) {
+    GPtrArray* envs = scan_for_env_definitions (content);
+    gu_completion_add_environments (gu_completion_get_default (),
+        (gchar**)envs->pdata, envs->len, package);
+    g_ptr_array_free (envs, TRUE);
+}
+
+void scan_for_new_cmds (gchar* content, gchar* package) {
+    GVariantBuilder cmds;
+    GVariant* definitions = NULL;
+
+    g_variant_builder_init (&cmds, G_VARIANT_TYPE ("a(sib)"));
+    scan_for_cmd_definitions (content, &cmds);
+    definitions = g_variant_ref_sink (g_variant_builder_end (&cmds));
+    apply_cmd_definitions (definitions, package);
+    g_variant_unref (definitions);
+}
+
+GVariant* scan_for_definitions (const gchar* content) {
+    GVariantBuilder cmds;
+    GPtrArray* envs = scan_for_env_definitions (content);
+    GVariant* result = NULL;
+
+    g_variant_builder_init (&cmds, G_VARIANT_TYPE ("a(sib)"));
+    scan_for_cmd_definitions (content, &cmds);
+    result = g_variant_new ("(@as@a(sib))",
+        g_variant_new_strv ((const gchar* const*)envs->pdata, envs->len),
+        g_variant_builder_end (&cmds));
+
+    g_ptr_array_free (envs, TRUE);
+    return result;
+}
+
+void scan_apply_definitions (GVariant* definitions, const gchar* package) {
+    GVariant* envs = g_variant_get_child_value (definitions, 0);
+    GVariant* cmds = g_variant_get_child_value (definitions, 1);
+    gsize n_envs = 0;
+    const gchar** env_names = g_variant_get_strv (envs, &n_envs);
+
+    gu_completion_add_environments (gu_completion_get_default (),
+        (gchar**)env_names, n_envs, package);
+    apply_cmd_definitions (cmds, package);
+
+    g_free (env_names);
+    g_variant_unref (envs);
+    g_variant_unref (cmds);
+}
+
+GVariant* scan_document (const gchar* content) {
+    GPtrArray* labels = scan_for_label_names (content);
+    GPtrArray* bibitems = scan_for_bibitem_names (content);
+    GVariant* result = g_variant_new ("(@as@as@" SCAN_DEFINITIONS_TYPE ")",
+        g_variant_new_strv ((const gchar* const*)labels->pdata, labels->len),
+        g_variant_new_strv ((const gchar* const*)bibitems->pdata,
+                            bibitems->len),
+        scan_for_definitions (content));
+
+    g_ptr_array_free (labels, TRUE);
+    g_ptr_array_free (bibitems, TRUE);
+    return result;
+}
+
+void scan_apply_document (GVariant* scan) {
+    GVariant* labels = g_variant_get_child_value (scan, 0);
+    GVariant* bibitems = g_variant_get_child_value (scan, 1);
+    GVariant* definitions = g_variant_get_child_value (scan, 2);
+    gsize n_labels = 0, n_bibitems = 0;
+    const gchar** label_names = g_variant_get_strv (labels, &n_labels);
+    const gchar** bibitem_names = g_variant_get_strv (bibitems, &n_bibitems);
+
+    gu_completion_add_ref_choices (gu_completion_get_default (),
+        (gchar**)label_names, n_labels);
+    gu_completion_add_citation_choices (gu_completion_get_default (),
+        (gchar**)bibitem_names, n_bibitems);
+    scan_apply_definitions (definitions, NULL);
+
+    g_free (label_names);
+    g_free (bibitem_names);
+    g_variant_unref (labels);
+    g_variant_unref (bibitems);
+    g_variant_unref (definitions);
 }
@@ -56,6 +56,29 @@
 
 #define L_F_DEBUG slog(L_DEBUG, "%s ()\n", __func__);
 
+/* Debug messages are left out of builds with -DSLOG_NO_DEBUG, and are only
+ * formatted at runtime with the -d flag. A disabled message costs a test. */
+#ifdef SLOG_NO_DEBUG
+#   define SLOG_COMPILED(level) (!((level) & L_DEBUG))
+#else
+#   define SLOG_COMPILED(level) TRUE
+#endif
+#define SLOG_ENABLED(level) \
+    (SLOG_COMPILED (level) && (!((level) & L_DEBUG) || slog_debug))
+
+#define slog(level, ...) \
+    slog_fields (level, NULL, -1, __VA_ARGS__)
+
+/* Logs a message of a subsystem, with the duration of what it reports in
+ * microseconds (-1 for none) */
+#define slog_fields(level, subsystem, duration, ...) \
+    G_STMT_START { \
+        if (SLOG_ENABLED (level)) \
+            slog_write (level, subsystem, duration, __VA_ARGS__); \
+    } G_STMT_END
+
+extern gint slog_debug;
+
 /**
  * Tuple2:
  * @first: a gpointer that points to the first field
@@ -115,7 +138,10 @@ typedef struct _slist {
 void slog_init (gint debug);
 gboolean in_debug_mode();
 void slog_set_gui_parent (GtkWindow* p);
-void slog (gint level, const gchar *fmt, ...);
+void slog_write (gint level, const gchar* subsystem, gint64 duration,
+                 const gchar *fmt, ...) G_GNUC_PRINTF (4, 5);
+void slog_flush (void);
+void slog_set_crash_dump (const gchar* filename);
 gint utils_yes_no_dialog (const gchar* message);
 gint utils_save_reload_dialog (const gchar* message);
 gboolean utils_path_exists (const gchar* path);
@@ -190,4 +216,31 @@ void scan_for_bibitems (gchar* content);
 void scan_for_new_envs (gchar* content, gchar* package);
 void scan_for_new_cmds (gchar* content, gchar* package);
 
+/**
+ * scan_for_definitions:
+ *
+ * Returns: a floating GVariant of type SCAN_DEFINITIONS_TYPE holding the
+ * environments and the commands (name, number of arguments, first argument
+ * optional) defined in content.
+ *
+ * Unlike the other scan functions it doesn't touch the completion provider,
+ * so it can be called from any thread. The result is applied on the main
+ * thread with scan_apply_definitions ().
+ */
+#define SCAN_DEFINITIONS_TYPE "(asa(sib))"
+GVariant* scan_for_definitions (const gchar* content);
+void scan_apply_definitions (GVariant* definitions, const gchar* package);
+
+/**
+ * scan_document:
+ *
+ * Returns: a floating GVariant of type SCAN_DOCUMENT_TYPE holding the
+ * labels, the bibitems and the definitions of a document, for any thread.
+ * All four are handed to the completion provider at once with
+ * scan_apply_document () on the main thread.
+ */
+#define SCAN_DOCUMENT_TYPE "(asas" SCAN_DEFINITIONS_TYPE ")"
+GVariant* scan_document (const gchar* content);
+void scan_apply_document (GVariant* scan);
+
 #endif /* __GUMMI_UTILS__ */